@@ -0,0 +1,657 @@
+#include "bvh.hpp"
+
+ThreeDL::Ray::Ray(const Vec3& origin, const Vec3& direction, double t_max)
+    : origin_(origin),
+      direction_(direction),
+      t_max_(t_max)
+{}
+
+void ThreeDL::AABB::grow(const Vec3& point) {
+    min_ = {std::min(min_.x, point.x), std::min(min_.y, point.y), std::min(min_.z, point.z)};
+    max_ = {std::max(max_.x, point.x), std::max(max_.y, point.y), std::max(max_.z, point.z)};
+}
+
+void ThreeDL::AABB::grow(const AABB& other) {
+    if (other.min_.x > other.max_.x) return; // empty
+
+    grow(other.min_);
+    grow(other.max_);
+}
+
+double ThreeDL::AABB::surface_area() const {
+    if (min_.x > max_.x) return 0;
+
+    Vec3 size = max_ - min_;
+    return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+ThreeDL::Vec3 ThreeDL::AABB::centre() const {
+    return (min_ + max_) / 2;
+}
+
+static double axis(const ThreeDL::Vec3& vector, int index) {
+    return (index == 0) ? vector.x : (index == 1) ? vector.y : vector.z;
+}
+
+// slab test, t_near is where the ray enters the box
+static bool ray_box(const ThreeDL::AABB& box, const ThreeDL::Vec3& origin, const ThreeDL::Vec3& inverse, double t_max, double& t_near) {
+    double tx1 = (box.min_.x - origin.x) * inverse.x;
+    double tx2 = (box.max_.x - origin.x) * inverse.x;
+    double ty1 = (box.min_.y - origin.y) * inverse.y;
+    double ty2 = (box.max_.y - origin.y) * inverse.y;
+    double tz1 = (box.min_.z - origin.z) * inverse.z;
+    double tz2 = (box.max_.z - origin.z) * inverse.z;
+
+    t_near = std::max({std::min(tx1, tx2), std::min(ty1, ty2), std::min(tz1, tz2), 0.0});
+    double t_far = std::min({std::max(tx1, tx2), std::max(ty1, ty2), std::max(tz1, tz2), t_max});
+
+    return t_near <= t_far;
+}
+
+static ThreeDL::Vec3 safe_inverse(const ThreeDL::Vec3& direction) {
+    auto invert = [](double value) {
+        return (std::abs(value) > 1e-30) ? 1 / value : std::copysign(ThreeDL::bvh_far, value);
+    };
+
+    return {invert(direction.x), invert(direction.y), invert(direction.z)};
+}
+
+static bool sphere_box(const ThreeDL::AABB& box, const ThreeDL::Vec3& centre, double radius) {
+    ThreeDL::Vec3 nearest = {
+        std::clamp(centre.x, box.min_.x, box.max_.x),
+        std::clamp(centre.y, box.min_.y, box.max_.y),
+        std::clamp(centre.z, box.min_.z, box.max_.z)
+    };
+
+    ThreeDL::Vec3 offset = nearest - centre;
+    return offset.dot(offset) <= radius * radius;
+}
+
+// Ericson, Real-Time Collision Detection 5.1.5
+static ThreeDL::Vec3 closest_point_on_triangle(const ThreeDL::Vec3& p, const ThreeDL::Vec3& a, const ThreeDL::Vec3& ab, const ThreeDL::Vec3& ac) {
+    ThreeDL::Vec3 ap = p - a;
+    double d1 = ab.dot(ap);
+    double d2 = ac.dot(ap);
+    if (d1 <= 0 && d2 <= 0) return a;
+
+    ThreeDL::Vec3 bp = ap - ab;
+    double d3 = ab.dot(bp);
+    double d4 = ac.dot(bp);
+    if (d3 >= 0 && d4 <= d3) return a + ab;
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+
+    ThreeDL::Vec3 cp = ap - ac;
+    double d5 = ab.dot(cp);
+    double d6 = ac.dot(cp);
+    if (d6 >= 0 && d5 <= d6) return a + ac;
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        ThreeDL::Vec3 bc = ac - ab;
+        return a + ab + bc * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    double denom = 1 / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+namespace {
+    constexpr int bin_count = 16;
+
+    class HierarchyBuilder {
+        public:
+            const std::vector<ThreeDL::AABB>& bounds_;
+            std::vector<ThreeDL::Vec3> centroids_;
+            uint32_t max_leaf_size_;
+            std::vector<ThreeDL::BVHNode>& nodes_;
+            std::vector<uint32_t>& order_;
+
+            uint32_t build(uint32_t first, uint32_t count, int depth);
+    };
+
+    uint32_t HierarchyBuilder::build(uint32_t first, uint32_t count, int depth) {
+        uint32_t node = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back({{}, first, count});
+
+        ThreeDL::AABB box;
+        ThreeDL::AABB centre_box;
+
+        for (uint32_t i = first; i < first + count; ++i) {
+            box.grow(bounds_[order_[i]]);
+            centre_box.grow(centroids_[order_[i]]);
+        }
+
+        nodes_[node].bounds_ = box;
+
+        // degenerate spreads, each split peeling off a few, would otherwise run the traversal stacks over
+        if (count <= max_leaf_size_ || depth >= ThreeDL::bvh_stack_size - 2) return node;
+
+        // cheapest binned split over all three axes, against the cost of leaving a leaf
+        double best_cost = box.surface_area() * count;
+        int best_axis = -1;
+        int best_split = 0;
+
+        for (int a = 0; a < 3; ++a) {
+            double low = axis(centre_box.min_, a);
+            double extent = axis(centre_box.max_, a) - low;
+            if (extent <= 0) continue;
+
+            ThreeDL::AABB bins[bin_count];
+            uint32_t bin_counts[bin_count] = {};
+
+            for (uint32_t i = first; i < first + count; ++i) {
+                int bin = std::min(bin_count - 1, static_cast<int>((axis(centroids_[order_[i]], a) - low) / extent * bin_count));
+                bins[bin].grow(bounds_[order_[i]]);
+                ++bin_counts[bin];
+            }
+
+            // sweep from the right for every right hand side, then from the left to cost each split
+            double right_area[bin_count];
+            uint32_t right_count[bin_count];
+            ThreeDL::AABB right;
+            uint32_t right_total = 0;
+
+            for (int b = bin_count - 1; b > 0; --b) {
+                right.grow(bins[b]);
+                right_total += bin_counts[b];
+                right_area[b] = right.surface_area();
+                right_count[b] = right_total;
+            }
+
+            ThreeDL::AABB left;
+            uint32_t left_total = 0;
+
+            for (int b = 0; b < bin_count - 1; ++b) {
+                left.grow(bins[b]);
+                left_total += bin_counts[b];
+
+                if (left_total == 0 || right_count[b + 1] == 0) continue;
+
+                double cost = left.surface_area() * left_total + right_area[b + 1] * right_count[b + 1];
+
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_split = b + 1;
+                }
+            }
+        }
+
+        if (best_axis < 0) return node;
+
+        double low = axis(centre_box.min_, best_axis);
+        double extent = axis(centre_box.max_, best_axis) - low;
+
+        auto middle = std::partition(order_.begin() + first, order_.begin() + first + count, [&](uint32_t index) {
+            int bin = std::min(bin_count - 1, static_cast<int>((axis(centroids_[index], best_axis) - low) / extent * bin_count));
+            return bin < best_split;
+        });
+
+        uint32_t left_count = static_cast<uint32_t>(middle - (order_.begin() + first));
+
+        // the left child is always node + 1, only the right child index is stored
+        build(first, left_count, depth + 1);
+        uint32_t right_node = build(first + left_count, count - left_count, depth + 1);
+
+        nodes_[node].first_ = right_node;
+        nodes_[node].count_ = 0;
+
+        return node;
+    }
+}
+
+void ThreeDL::build_hierarchy(const std::vector<AABB>& bounds, uint32_t max_leaf_size, std::vector<BVHNode>& nodes, std::vector<uint32_t>& order) {
+    nodes.clear();
+    order.resize(bounds.size());
+
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+
+    if (bounds.empty()) return;
+
+    HierarchyBuilder builder = {bounds, {}, max_leaf_size, nodes, order};
+    builder.centroids_.reserve(bounds.size());
+
+    for (const auto& box : bounds) {
+        builder.centroids_.push_back(box.centre());
+    }
+
+    nodes.reserve(bounds.size() * 2);
+    builder.build(0, static_cast<uint32_t>(bounds.size()), 0);
+}
+
+ThreeDL::MeshBVH::MeshBVH(const std::vector<GSPTriangle>& triangles) {
+    std::vector<AABB> bounds(triangles.size());
+
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        for (const auto& vertex : triangles[i].vertices_) {
+            bounds[i].grow(vertex);
+        }
+    }
+
+    build_hierarchy(bounds, max_leaf_size_, nodes_, triangle_ids_);
+
+    v0_.reserve(triangles.size());
+    e1_.reserve(triangles.size());
+    e2_.reserve(triangles.size());
+
+    for (uint32_t id : triangle_ids_) {
+        const auto& v = triangles[id].vertices_;
+        v0_.push_back(v[0]);
+        e1_.push_back(v[1] - v[0]);
+        e2_.push_back(v[2] - v[0]);
+    }
+}
+
+bool ThreeDL::MeshBVH::intersect_triangle(uint32_t index, const Ray& ray, double t_max, double& t, double& u, double& v) const {
+    Vec3 p = ray.direction_.cross(e2_[index]);
+    double det = e1_[index].dot(p);
+
+    // two sided, parallel rays miss
+    if (std::abs(det) < 1e-12) return false;
+
+    double inverse = 1 / det;
+    Vec3 s = ray.origin_ - v0_[index];
+
+    u = s.dot(p) * inverse;
+    if (u < 0 || u > 1) return false;
+
+    Vec3 q = s.cross(e1_[index]);
+
+    v = ray.direction_.dot(q) * inverse;
+    if (v < 0 || u + v > 1) return false;
+
+    t = e2_[index].dot(q) * inverse;
+    return t > 0 && t < t_max;
+}
+
+bool ThreeDL::MeshBVH::intersect(const Ray& ray, RayHit& hit, bool any_hit) const {
+    if (nodes_.empty()) return false;
+
+    Vec3 inverse = safe_inverse(ray.direction_);
+    double t_max = std::min(ray.t_max_, hit.t_);
+    bool found = false;
+
+    uint32_t stack[bvh_stack_size];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const BVHNode& node = nodes_[stack[--top]];
+
+        double t_near;
+        if (!ray_box(node.bounds_, ray.origin_, inverse, t_max, t_near)) continue;
+
+        if (node.count_ > 0) {
+            for (uint32_t i = node.first_; i < node.first_ + node.count_; ++i) {
+                double t, u, v;
+                if (!intersect_triangle(i, ray, t_max, t, u, v)) continue;
+
+                t_max = t;
+                found = true;
+
+                hit.hit_ = true;
+                hit.t_ = t;
+                hit.triangle_id_ = triangle_ids_[i];
+                hit.u_ = u;
+                hit.v_ = v;
+
+                if (any_hit) return true;
+            }
+
+            continue;
+        }
+
+        // visit the nearer child first so t_max shrinks sooner
+        uint32_t left = static_cast<uint32_t>(&node - nodes_.data()) + 1;
+        uint32_t right = node.first_;
+
+        double t_left, t_right;
+        bool hit_left = ray_box(nodes_[left].bounds_, ray.origin_, inverse, t_max, t_left);
+        bool hit_right = ray_box(nodes_[right].bounds_, ray.origin_, inverse, t_max, t_right);
+
+        if (hit_left && hit_right) {
+            if (t_left < t_right) std::swap(left, right);
+            stack[top++] = left;
+            stack[top++] = right;
+        } else if (hit_left) {
+            stack[top++] = left;
+        } else if (hit_right) {
+            stack[top++] = right;
+        }
+    }
+
+    return found;
+}
+
+void ThreeDL::MeshBVH::intersect_packet(const Ray* rays, RayHit* hits, int count) const {
+    if (nodes_.empty()) return;
+
+    Vec3 inverse[packet_size];
+    double t_max[packet_size];
+
+    for (int r = 0; r < count; ++r) {
+        inverse[r] = safe_inverse(rays[r].direction_);
+        t_max[r] = std::min(rays[r].t_max_, hits[r].t_);
+    }
+
+    // one traversal for the whole packet, a node is entered when any ray still wants it
+    uint32_t stack[bvh_stack_size];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        uint32_t index = stack[--top];
+        const BVHNode& node = nodes_[index];
+
+        uint32_t active = 0;
+
+        for (int r = 0; r < count; ++r) {
+            double t_near;
+            active |= static_cast<uint32_t>(ray_box(node.bounds_, rays[r].origin_, inverse[r], t_max[r], t_near)) << r;
+        }
+
+        if (active == 0) continue;
+
+        if (node.count_ == 0) {
+            stack[top++] = node.first_;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        for (uint32_t i = node.first_; i < node.first_ + node.count_; ++i) {
+            for (int r = 0; r < count; ++r) {
+                if (!(active & (1u << r))) continue;
+
+                double t, u, v;
+                if (!intersect_triangle(i, rays[r], t_max[r], t, u, v)) continue;
+
+                t_max[r] = t;
+
+                hits[r].hit_ = true;
+                hits[r].t_ = t;
+                hits[r].triangle_id_ = triangle_ids_[i];
+                hits[r].u_ = u;
+                hits[r].v_ = v;
+            }
+        }
+    }
+}
+
+void ThreeDL::MeshBVH::overlap_sphere(const Vec3& centre, double radius, std::vector<uint32_t>& triangles) const {
+    if (nodes_.empty()) return;
+
+    uint32_t stack[bvh_stack_size];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        uint32_t index = stack[--top];
+        const BVHNode& node = nodes_[index];
+
+        if (!sphere_box(node.bounds_, centre, radius)) continue;
+
+        if (node.count_ == 0) {
+            stack[top++] = node.first_;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        for (uint32_t i = node.first_; i < node.first_ + node.count_; ++i) {
+            Vec3 offset = closest_point_on_triangle(centre, v0_[i], e1_[i], e2_[i]) - centre;
+
+            if (offset.dot(offset) <= radius * radius) {
+                triangles.push_back(triangle_ids_[i]);
+            }
+        }
+    }
+}
+
+void ThreeDL::SceneBVH::build(const std::vector<Object*>& objects) {
+    instances_.clear();
+    ++build_count_;
+    std::vector<AABB> bounds;
+
+    for (const auto* object : objects) {
+        add_instance(*object, bounds);
+    }
+
+    finish_build(bounds);
+}
+
+void ThreeDL::SceneBVH::build(const PreparedScene& scene) {
+    instances_.clear();
+    ++build_count_;
+    std::vector<AABB> bounds;
+
+    for (const auto& prepared : scene.objects_) {
+        add_instance(*prepared.object_, bounds);
+    }
+
+    finish_build(bounds);
+}
+
+void ThreeDL::SceneBVH::add_instance(const Object& object, std::vector<AABB>& bounds) {
+    const Mesh* mesh = &object.mesh_;
+    auto found = meshes_.find(mesh->generation());
+
+    if (found == meshes_.end() && mesh->compressed_ != nullptr) {
+        // the hierarchy keeps its own full precision copy, the decoded list is only needed while building
+        found = meshes_.emplace(mesh->generation(), std::make_pair(std::make_unique<MeshBVH>(mesh->compressed_->decode()), 0)).first;
+    } else if (found == meshes_.end()) {
+        found = meshes_.emplace(mesh->generation(), std::make_pair(std::make_unique<MeshBVH>(mesh->triangles_), 0)).first;
+    }
+
+    found->second.second = build_count_;
+
+    Instance instance = {found->second.first.get(), object.position_, rotation_matrix(object.rotation_), object.has_transform()};
+    instances_.push_back(instance);
+
+    // world space box around the corners of the transformed mesh box
+    AABB world;
+    const auto& nodes = instance.bvh_->nodes();
+
+    if (!nodes.empty()) {
+        const AABB& local = nodes[0].bounds_;
+
+        for (int corner = 0; corner < 8; ++corner) {
+            Vec3 point = {
+                (corner & 1) ? local.max_.x : local.min_.x,
+                (corner & 2) ? local.max_.y : local.min_.y,
+                (corner & 4) ? local.max_.z : local.min_.z
+            };
+
+            world.grow(apply_rotation(instance.rotation_, point) + instance.position_);
+        }
+    }
+
+    bounds.push_back(world);
+}
+
+void ThreeDL::SceneBVH::finish_build(const std::vector<AABB>& bounds) {
+    // evicted chunks and rebuilt patches would otherwise keep their hierarchies forever
+    for (auto it = meshes_.begin(); it != meshes_.end();) {
+        it = it->second.second == build_count_ ? std::next(it) : meshes_.erase(it);
+    }
+
+    build_hierarchy(bounds, 1, nodes_, order_);
+}
+
+ThreeDL::Ray ThreeDL::SceneBVH::to_mesh_space(const Instance& instance, const Ray& ray) const {
+    if (!instance.transformed_) return ray;
+
+    return {point_to_mesh_space(instance, ray.origin_), apply_transpose(instance.rotation_, ray.direction_), ray.t_max_};
+}
+
+ThreeDL::Vec3 ThreeDL::SceneBVH::point_to_mesh_space(const Instance& instance, const Vec3& point) const {
+    if (!instance.transformed_) return point;
+
+    return apply_transpose(instance.rotation_, point - instance.position_);
+}
+
+bool ThreeDL::SceneBVH::trace(const Ray& ray, RayHit& hit, bool any_hit) const {
+    if (nodes_.empty()) return false;
+
+    Vec3 inverse = safe_inverse(ray.direction_);
+    bool found = false;
+
+    uint32_t stack[bvh_stack_size];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        uint32_t index = stack[--top];
+        const BVHNode& node = nodes_[index];
+
+        double t_near;
+        if (!ray_box(node.bounds_, ray.origin_, inverse, std::min(ray.t_max_, hit.t_), t_near)) continue;
+
+        if (node.count_ == 0) {
+            stack[top++] = node.first_;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        for (uint32_t i = node.first_; i < node.first_ + node.count_; ++i) {
+            uint32_t object_id = order_[i];
+            const Instance& instance = instances_[object_id];
+
+            // rotation keeps lengths, so t found in mesh space is the same t in world space
+            if (!instance.bvh_->intersect(to_mesh_space(instance, ray), hit, any_hit)) continue;
+
+            hit.object_id_ = object_id;
+            found = true;
+
+            if (any_hit) return true;
+        }
+    }
+
+    return found;
+}
+
+ThreeDL::RayHit ThreeDL::SceneBVH::closest_hit(const Ray& ray) const {
+    RayHit hit;
+    trace(ray, hit, false);
+    return hit;
+}
+
+bool ThreeDL::SceneBVH::any_hit(const Ray& ray) const {
+    RayHit hit;
+    return trace(ray, hit, true);
+}
+
+void ThreeDL::SceneBVH::closest_hits(const std::vector<Ray>& rays, std::vector<RayHit>& hits) const {
+    hits.assign(rays.size(), RayHit());
+
+    if (nodes_.empty()) return;
+
+    for (size_t first = 0; first < rays.size(); first += packet_size) {
+        int count = static_cast<int>(std::min<size_t>(packet_size, rays.size() - first));
+        const Ray* packet_rays = rays.data() + first;
+        RayHit* packet_hits = hits.data() + first;
+
+        Vec3 inverse[packet_size];
+        for (int r = 0; r < count; ++r) {
+            inverse[r] = safe_inverse(packet_rays[r].direction_);
+        }
+
+        // the top level is walked by the whole packet as well, then each reached mesh gets the packet
+        uint32_t stack[bvh_stack_size];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            uint32_t index = stack[--top];
+            const BVHNode& node = nodes_[index];
+
+            bool any = false;
+
+            for (int r = 0; r < count && !any; ++r) {
+                double t_near;
+                any = ray_box(node.bounds_, packet_rays[r].origin_, inverse[r], std::min(packet_rays[r].t_max_, packet_hits[r].t_), t_near);
+            }
+
+            if (!any) continue;
+
+            if (node.count_ == 0) {
+                stack[top++] = node.first_;
+                stack[top++] = index + 1;
+                continue;
+            }
+
+            for (uint32_t i = node.first_; i < node.first_ + node.count_; ++i) {
+                uint32_t object_id = order_[i];
+                const Instance& instance = instances_[object_id];
+
+                Ray local[packet_size] = {
+                    packet_rays[0], packet_rays[0], packet_rays[0], packet_rays[0],
+                    packet_rays[0], packet_rays[0], packet_rays[0], packet_rays[0]
+                };
+
+                RayHit packet[packet_size];
+
+                for (int r = 0; r < count; ++r) {
+                    local[r] = to_mesh_space(instance, packet_rays[r]);
+                    packet[r].t_ = packet_hits[r].t_;
+                }
+
+                instance.bvh_->intersect_packet(local, packet, count);
+
+                for (int r = 0; r < count; ++r) {
+                    if (!packet[r].hit_) continue;
+
+                    packet_hits[r] = packet[r];
+                    packet_hits[r].object_id_ = object_id;
+                }
+            }
+        }
+    }
+}
+
+bool ThreeDL::SceneBVH::segment_hit(const Vec3& a, const Vec3& b) const {
+    return any_hit({a, b - a, 1});
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> ThreeDL::SceneBVH::overlap_sphere(const Vec3& centre, double radius) const {
+    std::vector<std::pair<uint32_t, uint32_t>> result;
+    std::vector<uint32_t> triangles;
+
+    if (nodes_.empty()) return result;
+
+    uint32_t stack[bvh_stack_size];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        uint32_t index = stack[--top];
+        const BVHNode& node = nodes_[index];
+
+        if (!sphere_box(node.bounds_, centre, radius)) continue;
+
+        if (node.count_ == 0) {
+            stack[top++] = node.first_;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        for (uint32_t i = node.first_; i < node.first_ + node.count_; ++i) {
+            uint32_t object_id = order_[i];
+            const Instance& instance = instances_[object_id];
+
+            triangles.clear();
+            instance.bvh_->overlap_sphere(point_to_mesh_space(instance, centre), radius, triangles);
+
+            for (uint32_t triangle : triangles) {
+                result.emplace_back(object_id, triangle);
+            }
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "objects.hpp"
+#include "scene.hpp"
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // stands in for infinity, -ffast-math does not promise IEEE infinities survive comparisons
+    constexpr double bvh_far = 1e30;
+
+    class Ray {
+        public:
+            Ray(const Vec3& origin, const Vec3& direction, double t_max = bvh_far);
+            Ray() = delete;
+
+            Vec3 origin_;
+            Vec3 direction_; // need not be normalised, hits are reported in multiples of it
+            double t_max_;
+
+            ~Ray() = default;
+    };
+
+    class RayHit {
+        public:
+            bool hit_ = false;
+            double t_ = bvh_far;
+
+            uint32_t object_id_ = 0;   // index into the objects given to SceneBVH::build
+            uint32_t triangle_id_ = 0; // index into that object's Mesh::triangles_
+
+            // barycentrics of vertices 1 and 2
+            double u_ = 0;
+            double v_ = 0;
+    };
+
+    class AABB {
+        public:
+            Vec3 min_ = {bvh_far, bvh_far, bvh_far};
+            Vec3 max_ = {-bvh_far, -bvh_far, -bvh_far};
+
+            void grow(const Vec3& point);
+            void grow(const AABB& other);
+            double surface_area() const;
+            Vec3 centre() const;
+    };
+
+    // flattened depth first, an interior node's left child directly follows it
+    class BVHNode {
+        public:
+            AABB bounds_;
+            uint32_t first_; // leaf: first primitive, interior: right child
+            uint32_t count_; // primitives in a leaf, 0 for interior nodes
+    };
+
+    // rays per packet for the batched queries
+    constexpr int packet_size = 8;
+
+    // entries in the fixed traversal stacks, a walk holds at most one pending sibling per level plus the two
+    // children just pushed, so builds stop splitting this many levels down less two
+    constexpr int bvh_stack_size = 64;
+
+    // binned SAH build over arbitrary boxes, order receives the primitive index of each leaf slot, nothing is
+    // split below bvh_stack_size - 2 levels, what is left there becomes one leaf however large
+    void build_hierarchy(const std::vector<AABB>& bounds, uint32_t max_leaf_size, std::vector<BVHNode>& nodes, std::vector<uint32_t>& order);
+
+    // bounding volume hierarchy over one mesh in mesh space
+    class MeshBVH {
+        public:
+            explicit MeshBVH(const std::vector<GSPTriangle>& triangles);
+            MeshBVH() = delete;
+
+            // closest hit inside ray.t_max_, or any hit when any_hit is set, hit is only written on success
+            bool intersect(const Ray& ray, RayHit& hit, bool any_hit) const;
+            // closest hits for up to packet_size rays that traverse the tree together
+            void intersect_packet(const Ray* rays, RayHit* hits, int count) const;
+            // every triangle touching the sphere
+            void overlap_sphere(const Vec3& centre, double radius, std::vector<uint32_t>& triangles) const;
+
+            const std::vector<BVHNode>& nodes() const {
+                return nodes_;
+            }
+
+            ~MeshBVH() = default;
+        private:
+            static constexpr uint32_t max_leaf_size_ = 4;
+
+            std::vector<BVHNode> nodes_;
+
+            // triangles in leaf order, stored as a vertex and two edges for Moller-Trumbore
+            std::vector<Vec3> v0_, e1_, e2_;
+            std::vector<uint32_t> triangle_ids_;
+
+            bool intersect_triangle(uint32_t index, const Ray& ray, double t_max, double& t, double& u, double& v) const;
+    };
+
+    // top level hierarchy over world space object bounds, each object keeps a MeshBVH in mesh space,
+    // mesh hierarchies are cached by Mesh::generation() across builds and finish_build prunes any the last build didn't use
+    class SceneBVH {
+        public:
+            SceneBVH() = default;
+
+            // mesh hierarchies are built once per mesh generation and reused, only the top level is rebuilt, and
+            // those of meshes the build did not see are dropped
+            void build(const std::vector<Object*>& objects);
+            // same, object ids then index scene.objects_
+            void build(const PreparedScene& scene);
+
+            RayHit closest_hit(const Ray& ray) const;
+            bool any_hit(const Ray& ray) const;
+            void closest_hits(const std::vector<Ray>& rays, std::vector<RayHit>& hits) const;
+
+            // true if anything lies on the segment from a to b
+            bool segment_hit(const Vec3& a, const Vec3& b) const;
+            // (object, triangle) of every triangle touching the sphere
+            std::vector<std::pair<uint32_t, uint32_t>> overlap_sphere(const Vec3& centre, double radius) const;
+
+            ~SceneBVH() = default;
+        private:
+            class Instance {
+                public:
+                    const MeshBVH* bvh_;
+                    Vec3 position_;
+                    std::array<Vec3, 3> rotation_;  // mesh to world
+                    bool transformed_;
+            };
+
+            // by Mesh::generation, with the last build that used it
+            std::unordered_map<uint64_t, std::pair<std::unique_ptr<MeshBVH>, uint64_t>> meshes_;
+            uint64_t build_count_ = 0;
+            std::vector<Instance> instances_;
+            std::vector<BVHNode> nodes_;
+            std::vector<uint32_t> order_;
+
+            void add_instance(const Object& object, std::vector<AABB>& bounds);
+            void finish_build(const std::vector<AABB>& bounds);
+            Ray to_mesh_space(const Instance& instance, const Ray& ray) const;
+            Vec3 point_to_mesh_space(const Instance& instance, const Vec3& point) const;
+            bool trace(const Ray& ray, RayHit& hit, bool any_hit) const;
+    };
+};
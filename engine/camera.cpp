@@ -13,6 +13,20 @@ void ThreeDL::Camera::calculate_dirs() {
     right_.rotate(0, -rotation_.y, 0);
 }
 
+std::array<ThreeDL::Vec3, 3> ThreeDL::Camera::view_rotation() const {
+    return rotation_matrix(rotation_);
+}
+
+ThreeDL::Vec3 ThreeDL::Camera::to_view(const Vec3& point, const std::array<Vec3, 3>& rotation) const {
+    Vec3 relative = point - position_;
+
+    return {
+        rotation[0].dot(relative),
+        rotation[1].dot(relative),
+        rotation[2].dot(relative)
+    };
+}
+
 void ThreeDL::Camera::move_forward(double delta) {
     position_ = position_ + (forward_ * delta);
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include "utils.hpp"
 
 namespace ThreeDL {
@@ -15,6 +17,10 @@ namespace ThreeDL {
 
             void calculate_dirs();
 
+            // rows of the world to view rotation the renderer applies to every vertex
+            std::array<Vec3, 3> view_rotation() const;
+            Vec3 to_view(const Vec3& point, const std::array<Vec3, 3>& rotation) const;
+
             void move_forward(double delta);
             void move_right(double delta);
 
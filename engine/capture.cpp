@@ -0,0 +1,168 @@
+#include "capture.hpp"
+
+namespace {
+    // depth buffers are cleared to -INFINITY, compared against a finite bound as -ffast-math may fold infinity checks
+    bool empty_depth(double depth) {
+        return depth < -1e30;
+    }
+
+    const char depth_magic[4] = {'3', 'D', 'L', 'Z'};
+}
+
+ThreeDL::ImageDiff ThreeDL::compare_frames(const std::vector<Uint32>& frame, const std::vector<Uint32>& reference, int tolerance) {
+    if (frame.size() != reference.size()) {
+        throw std::runtime_error("Cannot compare frames of different sizes");
+    }
+
+    ImageDiff diff;
+    double total = 0;
+
+    for (size_t i = 0; i < frame.size(); ++i) {
+        int error = 0;
+
+        for (int shift = 0; shift < 32; shift += 8) {
+            error = std::max(error, std::abs(static_cast<int>((frame[i] >> shift) & 0xff) - static_cast<int>((reference[i] >> shift) & 0xff)));
+        }
+
+        total += error;
+        diff.max_error_ = std::max(diff.max_error_, static_cast<double>(error));
+        diff.pixels_over_ += error > tolerance;
+    }
+
+    diff.pixels_compared_ = frame.size();
+    diff.mean_error_ = frame.empty() ? 0 : total / frame.size();
+
+    return diff;
+}
+
+ThreeDL::ImageDiff ThreeDL::compare_depths(const std::vector<double>& depth, const std::vector<double>& reference, double tolerance) {
+    if (depth.size() != reference.size()) {
+        throw std::runtime_error("Cannot compare depth buffers of different sizes");
+    }
+
+    ImageDiff diff;
+    double total = 0;
+
+    for (size_t i = 0; i < depth.size(); ++i) {
+        bool empty = empty_depth(depth[i]);
+        bool reference_empty = empty_depth(reference[i]);
+
+        if (empty && reference_empty) continue;
+
+        double error = 1;
+
+        if (!empty && !reference_empty) {
+            double scale = std::max(std::abs(depth[i]), std::abs(reference[i]));
+            error = scale > 0 ? std::abs(depth[i] - reference[i]) / scale : 0;
+        }
+
+        total += error;
+        diff.max_error_ = std::max(diff.max_error_, error);
+        diff.pixels_over_ += error > tolerance;
+    }
+
+    diff.pixels_compared_ = depth.size();
+    diff.mean_error_ = depth.empty() ? 0 : total / depth.size();
+
+    return diff;
+}
+
+void ThreeDL::save_frame(const std::string& filename, const std::vector<Uint32>& pixels, int width, int height) {
+    // SDL only reads from the pixels while saving
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom(
+        const_cast<Uint32*>(pixels.data()), width, height, 32, width * sizeof(Uint32), SDL_PIXELFORMAT_ARGB8888
+    );
+
+    if (surface == nullptr) {
+        throw std::runtime_error("Could not create surface for frame: " + filename);
+    }
+
+    bool png = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".png") == 0;
+    int result = png ? IMG_SavePNG(surface, filename.c_str()) : SDL_SaveBMP(surface, filename.c_str());
+
+    SDL_FreeSurface(surface);
+
+    if (result != 0) {
+        throw std::runtime_error("Could not write frame: " + filename);
+    }
+}
+
+std::vector<Uint32> ThreeDL::load_frame(const std::string& filename, int width, int height) {
+    SDL_Surface* loaded = IMG_Load(filename.c_str());
+
+    if (loaded == nullptr) {
+        throw std::runtime_error("Could not load frame: " + filename);
+    }
+
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loaded);
+
+    if (converted == nullptr) {
+        throw std::runtime_error("Could not convert frame: " + filename);
+    }
+
+    if (converted->w != width || converted->h != height) {
+        SDL_FreeSurface(converted);
+        throw std::runtime_error("Frame has the wrong size: " + filename);
+    }
+
+    std::vector<Uint32> pixels(width * height);
+
+    for (int y = 0; y < height; ++y) {
+        const Uint32* row = reinterpret_cast<const Uint32*>(static_cast<const Uint8*>(converted->pixels) + y * converted->pitch);
+        std::copy(row, row + width, pixels.begin() + y * width);
+    }
+
+    SDL_FreeSurface(converted);
+
+    return pixels;
+}
+
+void ThreeDL::save_depth(const std::string& filename, const std::vector<double>& depth, int width, int height) {
+    std::ofstream file(filename, std::ios::binary);
+
+    if (!file) {
+        throw std::runtime_error("Could not write depth: " + filename);
+    }
+
+    int32_t size[2] = {width, height};
+    file.write(depth_magic, sizeof(depth_magic));
+    file.write(reinterpret_cast<const char*>(size), sizeof(size));
+
+    std::vector<float> values(depth.begin(), depth.end());
+    file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+
+    if (!file) {
+        throw std::runtime_error("Could not write depth: " + filename);
+    }
+}
+
+std::vector<double> ThreeDL::load_depth(const std::string& filename, int width, int height) {
+    std::ifstream file(filename, std::ios::binary);
+
+    if (!file) {
+        throw std::runtime_error("Could not load depth: " + filename);
+    }
+
+    char magic[4];
+    int32_t size[2];
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(size), sizeof(size));
+
+    if (!file || !std::equal(magic, magic + 4, depth_magic)) {
+        throw std::runtime_error("Not a depth file: " + filename);
+    }
+
+    if (size[0] != width || size[1] != height) {
+        throw std::runtime_error("Depth has the wrong size: " + filename);
+    }
+
+    std::vector<float> values(width * height);
+    file.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(float));
+
+    if (!file) {
+        throw std::runtime_error("Depth file is truncated: " + filename);
+    }
+
+    return {values.begin(), values.end()};
+}
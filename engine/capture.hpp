@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ThreeDL {
+    // result of comparing a frame or depth buffer against a reference of the same size
+    class ImageDiff {
+        public:
+            uint64_t pixels_compared_ = 0;
+            uint64_t pixels_over_ = 0; // differing by more than the tolerance
+            double max_error_ = 0;
+            double mean_error_ = 0;
+
+            // true while at most max_fraction of the pixels are over the tolerance
+            bool passed(double max_fraction = 0) const {
+                return pixels_over_ <= max_fraction * pixels_compared_;
+            }
+    };
+
+    // error is the largest per channel difference, 0-255, alpha included
+    ImageDiff compare_frames(const std::vector<Uint32>& frame, const std::vector<Uint32>& reference, int tolerance);
+    // error is relative to the larger of the two depths, a pixel empty in only one buffer always counts as over
+    ImageDiff compare_depths(const std::vector<double>& depth, const std::vector<double>& reference, double tolerance);
+
+    // .png through SDL_image, anything else as .bmp
+    void save_frame(const std::string& filename, const std::vector<Uint32>& pixels, int width, int height);
+    // throws unless the image is exactly width x height
+    std::vector<Uint32> load_frame(const std::string& filename, int width, int height);
+
+    // raw little endian floats behind a small header, empty pixels are stored as -INFINITY
+    void save_depth(const std::string& filename, const std::vector<double>& depth, int width, int height);
+    std::vector<double> load_depth(const std::string& filename, int width, int height);
+};
@@ -0,0 +1,144 @@
+#include "compression.hpp"
+
+namespace {
+    uint16_t quantise(double value, double min, double step) {
+        if (step == 0) return 0;
+        return static_cast<uint16_t>(std::clamp(std::lround((value - min) / step), 0L, 65535L));
+    }
+
+    int16_t to_snorm(double value) {
+        return static_cast<int16_t>(std::lround(std::clamp(value, -1.0, 1.0) * 32767));
+    }
+
+    double sign_of(double value) {
+        return value >= 0 ? 1 : -1;
+    }
+}
+
+void ThreeDL::encode_octahedral(const Vec3& normal, int16_t encoded[2]) {
+    double length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+
+    if (length == 0) {
+        encoded[0] = 0;
+        encoded[1] = 0;
+        return;
+    }
+
+    double x = normal.x / length;
+    double y = normal.y / length;
+
+    // the lower half folds over the diagonals of the square
+    if (normal.z < 0) {
+        double folded_x = (1 - std::abs(y)) * sign_of(x);
+        double folded_y = (1 - std::abs(x)) * sign_of(y);
+        x = folded_x;
+        y = folded_y;
+    }
+
+    encoded[0] = to_snorm(x);
+    encoded[1] = to_snorm(y);
+}
+
+ThreeDL::Vec3 ThreeDL::decode_octahedral(const int16_t encoded[2]) {
+    double x = encoded[0] / 32767.0;
+    double y = encoded[1] / 32767.0;
+    double z = 1 - std::abs(x) - std::abs(y);
+
+    double fold = std::max(-z, 0.0);
+    x += x >= 0 ? -fold : fold;
+    y += y >= 0 ? -fold : fold;
+
+    Vec3 normal = {x, y, z};
+    normal.normalise();
+
+    return normal;
+}
+
+ThreeDL::CompressedTriangles::CompressedTriangles(const std::vector<GSPTriangle>& triangles) {
+    if (triangles.empty()) return;
+
+    Vec3 position_max = triangles[0].vertices_[0];
+    Vec2 uv_max = triangles[0].uvs_[0];
+    position_min_ = position_max;
+    uv_min_ = uv_max;
+
+    for (const auto& triangle : triangles) {
+        for (int v = 0; v < 3; ++v) {
+            const Vec3& p = triangle.vertices_[v];
+            const Vec2& uv = triangle.uvs_[v];
+
+            position_min_ = {std::min(position_min_.x, p.x), std::min(position_min_.y, p.y), std::min(position_min_.z, p.z)};
+            position_max = {std::max(position_max.x, p.x), std::max(position_max.y, p.y), std::max(position_max.z, p.z)};
+            uv_min_ = {std::min(uv_min_.x, uv.x), std::min(uv_min_.y, uv.y)};
+            uv_max = {std::max(uv_max.x, uv.x), std::max(uv_max.y, uv.y)};
+        }
+    }
+
+    position_step_ = (position_max - position_min_) / 65535;
+    uv_step_ = {(uv_max.x - uv_min_.x) / 65535, (uv_max.y - uv_min_.y) / 65535};
+
+    vertices_.resize(triangles.size() * 3);
+
+    for (size_t t = 0; t < triangles.size(); ++t) {
+        for (int v = 0; v < 3; ++v) {
+            const GSPTriangle& triangle = triangles[t];
+            PackedVertex& packed = vertices_[t * 3 + v];
+
+            packed.position_[0] = quantise(triangle.vertices_[v].x, position_min_.x, position_step_.x);
+            packed.position_[1] = quantise(triangle.vertices_[v].y, position_min_.y, position_step_.y);
+            packed.position_[2] = quantise(triangle.vertices_[v].z, position_min_.z, position_step_.z);
+            packed.uv_[0] = quantise(triangle.uvs_[v].x, uv_min_.x, uv_step_.x);
+            packed.uv_[1] = quantise(triangle.uvs_[v].y, uv_min_.y, uv_step_.y);
+
+            encode_octahedral(triangle.normals_[v], packed.normal_);
+        }
+    }
+}
+
+ThreeDL::Vec3 ThreeDL::CompressedTriangles::decode_position(const PackedVertex& vertex) const {
+    return {
+        position_min_.x + vertex.position_[0] * position_step_.x,
+        position_min_.y + vertex.position_[1] * position_step_.y,
+        position_min_.z + vertex.position_[2] * position_step_.z
+    };
+}
+
+ThreeDL::GSPTriangle ThreeDL::CompressedTriangles::triangle(size_t index) const {
+    GSPTriangle triangle;
+
+    for (int v = 0; v < 3; ++v) {
+        const PackedVertex& packed = vertices_[index * 3 + v];
+
+        triangle.vertices_[v] = decode_position(packed);
+        triangle.uvs_[v] = {uv_min_.x + packed.uv_[0] * uv_step_.x, uv_min_.y + packed.uv_[1] * uv_step_.y};
+        triangle.normals_[v] = decode_octahedral(packed.normal_);
+    }
+
+    return triangle;
+}
+
+std::vector<ThreeDL::GSPTriangle> ThreeDL::CompressedTriangles::decode() const {
+    std::vector<GSPTriangle> triangles;
+    triangles.reserve(size());
+
+    for (size_t t = 0; t < size(); ++t) {
+        triangles.push_back(triangle(t));
+    }
+
+    return triangles;
+}
+
+void ThreeDL::CompressedTriangles::decode_positions(const uint32_t* ids, uint32_t first, size_t count, Vec3* out) const {
+    const double min_x = position_min_.x, min_y = position_min_.y, min_z = position_min_.z;
+    const double step_x = position_step_.x, step_y = position_step_.y, step_z = position_step_.z;
+
+    for (size_t i = 0; i < count; ++i) {
+        const PackedVertex* packed = &vertices_[(ids != nullptr ? ids[i] : first + i) * 3];
+
+        for (int v = 0; v < 3; ++v) {
+            out[i * 3 + v].x = min_x + packed[v].position_[0] * step_x;
+            out[i * 3 + v].y = min_y + packed[v].position_[1] * step_y;
+            out[i * 3 + v].z = min_z + packed[v].position_[2] * step_z;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // 14 bytes, position and uv quantised across the mesh bounds, normal octahedral encoded
+    class PackedVertex {
+        public:
+            uint16_t position_[3];
+            uint16_t uv_[2];
+            int16_t normal_[2];
+    };
+
+    // compact copy of a triangle list, three PackedVertex per triangle, decoded on the fly
+    class CompressedTriangles {
+        public:
+            explicit CompressedTriangles(const std::vector<GSPTriangle>& triangles);
+            CompressedTriangles() = delete;
+
+            size_t size() const {
+                return vertices_.size() / 3;
+            }
+
+            GSPTriangle triangle(size_t index) const;
+            std::vector<GSPTriangle> decode() const;
+
+            // positions of count triangles, taken from ids or running from first without it, three per triangle
+            void decode_positions(const uint32_t* ids, uint32_t first, size_t count, Vec3* out) const;
+
+            size_t memory_bytes() const {
+                return sizeof(*this) + vertices_.capacity() * sizeof(PackedVertex);
+            }
+
+            ~CompressedTriangles() = default;
+        private:
+            // value = min + quantised * step, per axis
+            Vec3 position_min_ = {0, 0, 0};
+            Vec3 position_step_ = {0, 0, 0};
+            Vec2 uv_min_ = {0, 0};
+            Vec2 uv_step_ = {0, 0};
+
+            std::vector<PackedVertex> vertices_;
+
+            Vec3 decode_position(const PackedVertex& vertex) const;
+    };
+
+    // unit vector to two snorm16 values on the octahedron folded onto a square, and back
+    void encode_octahedral(const Vec3& normal, int16_t encoded[2]);
+    Vec3 decode_octahedral(const int16_t encoded[2]);
+};
@@ -0,0 +1,199 @@
+#include "depth.hpp"
+
+ThreeDL::DepthBuffer::DepthBuffer(int width, int height, DepthFormat format)
+    : format_(format),
+      size_(static_cast<size_t>(width) * height)
+{
+    map_range();
+    allocate();
+}
+
+void ThreeDL::DepthBuffer::set_format(DepthFormat format) {
+    if (format == format_) return;
+
+    format_ = format;
+    map_range();
+
+    std::vector<double>().swap(float64_);
+    std::vector<float>().swap(float32_);
+    std::vector<uint32_t>().swap(unorm24_);
+    std::vector<uint16_t>().swap(unorm16_);
+
+    allocate();
+}
+
+void ThreeDL::DepthBuffer::resize(int width, int height) {
+    size_ = static_cast<size_t>(width) * height;
+    allocate();
+}
+
+void ThreeDL::DepthBuffer::set_range(double near, double far) {
+    if (near == near_ && far == far_) return;
+
+    near_ = near;
+    far_ = far;
+    map_range();
+}
+
+bool ThreeDL::DepthBuffer::holds(double near, double far) const {
+    if (format_ == DepthFormat::float64 || format_ == DepthFormat::float32) return true;
+
+    return near >= near_ && far <= far_;
+}
+
+void ThreeDL::DepthBuffer::map_range() {
+    double steps = 0;
+
+    switch (format_) {
+        case DepthFormat::float64: break;
+        case DepthFormat::float32: break;
+        case DepthFormat::unorm24: steps = 16777214; break;
+        case DepthFormat::unorm16: steps = 65534; break;
+    }
+
+    if (steps == 0) {
+        scale_ = 1;
+        offset_ = 0;
+        return;
+    }
+
+    // -1/z of far lands on 1 and of near on the largest value
+    scale_ = steps / (1 / near_ - 1 / far_);
+    offset_ = 1 - scale_ / far_;
+}
+
+void ThreeDL::DepthBuffer::allocate() {
+    // new pixels come in cleared, the ones kept hold whatever they had
+    switch (format_) {
+        case DepthFormat::float64: float64_.resize(size_, -INFINITY); break;
+        case DepthFormat::float32: float32_.resize(size_, 0); break;
+        case DepthFormat::unorm24: unorm24_.resize(size_, 0); break;
+        case DepthFormat::unorm16: unorm16_.resize(size_, 0); break;
+    }
+}
+
+size_t ThreeDL::DepthBuffer::bytes_per_pixel() const {
+    switch (format_) {
+        case DepthFormat::float64: return sizeof(double);
+        case DepthFormat::float32: return sizeof(float);
+        case DepthFormat::unorm24: return sizeof(uint32_t);
+        case DepthFormat::unorm16: return sizeof(uint16_t);
+    }
+
+    return sizeof(double);
+}
+
+void ThreeDL::DepthBuffer::clear(const Kernels& kernels) {
+    // empty is all zero bits in every compact format
+    switch (format_) {
+        case DepthFormat::float64: kernels.fill_depth(float64_.data(), size_, -INFINITY); break;
+        case DepthFormat::float32: std::memset(float32_.data(), 0, size_ * sizeof(float)); break;
+        case DepthFormat::unorm24: std::memset(unorm24_.data(), 0, size_ * sizeof(uint32_t)); break;
+        case DepthFormat::unorm16: std::memset(unorm16_.data(), 0, size_ * sizeof(uint16_t)); break;
+    }
+}
+
+void ThreeDL::DepthBuffer::clear_span(size_t index, size_t count, const Kernels& kernels) {
+    switch (format_) {
+        case DepthFormat::float64: kernels.fill_depth(&float64_[index], count, -INFINITY); break;
+        case DepthFormat::float32: std::memset(&float32_[index], 0, count * sizeof(float)); break;
+        case DepthFormat::unorm24: std::memset(&unorm24_[index], 0, count * sizeof(uint32_t)); break;
+        case DepthFormat::unorm16: std::memset(&unorm16_[index], 0, count * sizeof(uint16_t)); break;
+    }
+}
+
+int ThreeDL::DepthBuffer::test_span(size_t index, uint8_t* pass, int count, int x_start, const Vec2& a, const Vec2& b, const Kernels& kernels, bool write) {
+    switch (format_) {
+        case DepthFormat::float64: return kernels.depth_span(&float64_[index], pass, count, x_start, a, b, write);
+        case DepthFormat::float32: return kernels.depth_span_f32(&float32_[index], pass, count, x_start, a, b, scale_, offset_, write);
+        case DepthFormat::unorm24: return kernels.depth_span_u32(&unorm24_[index], pass, count, x_start, a, b, scale_, offset_, write);
+        case DepthFormat::unorm16: return kernels.depth_span_u16(&unorm16_[index], pass, count, x_start, a, b, scale_, offset_, write);
+    }
+
+    return 0;
+}
+
+void ThreeDL::DepthBuffer::write(size_t index, double depth) {
+    // rounded and clamped the same way the span kernels do
+    double scaled = depth * scale_ + offset_;
+
+    switch (format_) {
+        case DepthFormat::float64: float64_[index] = depth; break;
+        case DepthFormat::float32: float32_[index] = static_cast<float>(scaled); break;
+        case DepthFormat::unorm24: unorm24_[index] = static_cast<uint32_t>(std::clamp(scaled + 0.5, 1.0, 16777215.0)); break;
+        case DepthFormat::unorm16: unorm16_[index] = static_cast<uint16_t>(std::clamp(scaled + 0.5, 1.0, 65535.0)); break;
+    }
+}
+
+double ThreeDL::DepthBuffer::read(size_t index) const {
+    double stored = 0;
+
+    switch (format_) {
+        case DepthFormat::float64: return float64_[index];
+        case DepthFormat::float32: stored = float32_[index]; break;
+        case DepthFormat::unorm24: stored = unorm24_[index]; break;
+        case DepthFormat::unorm16: stored = unorm16_[index]; break;
+    }
+
+    return stored > 0 ? (stored - offset_) / scale_ : -INFINITY;
+}
+
+bool ThreeDL::DepthBuffer::covered(size_t index) const {
+    switch (format_) {
+        case DepthFormat::float64: return float64_[index] > -1e30;
+        case DepthFormat::float32: return float32_[index] > 0;
+        case DepthFormat::unorm24: return unorm24_[index] != 0;
+        case DepthFormat::unorm16: return unorm16_[index] != 0;
+    }
+
+    return false;
+}
+
+size_t ThreeDL::DepthBuffer::covered_count() const {
+    size_t count = 0;
+
+    for (size_t i = 0; i < size_; ++i) {
+        count += covered(i);
+    }
+
+    return count;
+}
+
+void ThreeDL::DepthBuffer::resolve_samples(DepthBuffer& samples, size_t from, size_t stride, int sample_count, size_t index, size_t count) {
+    // larger is nearer in every format, and empty is the smallest value, a sample at a time so each loop vectorises
+    auto resolve = [&](auto& out, auto& in, auto empty) {
+        auto* nearest = &out[index];
+        std::copy_n(&in[from], count, nearest);
+        std::fill_n(&in[from], count, empty);
+
+        for (int s = 1; s < sample_count; ++s) {
+            auto* sample = &in[from + s * stride];
+
+            for (size_t i = 0; i < count; ++i) {
+                nearest[i] = std::max(nearest[i], sample[i]);
+            }
+
+            std::fill_n(sample, count, empty);
+        }
+    };
+
+    switch (format_) {
+        case DepthFormat::float64: resolve(float64_, samples.float64_, static_cast<double>(-INFINITY)); break;
+        case DepthFormat::float32: resolve(float32_, samples.float32_, 0.0f); break;
+        case DepthFormat::unorm24: resolve(unorm24_, samples.unorm24_, uint32_t{0}); break;
+        case DepthFormat::unorm16: resolve(unorm16_, samples.unorm16_, uint16_t{0}); break;
+    }
+}
+
+void ThreeDL::DepthBuffer::copy_to(std::vector<double>& out) const {
+    if (format_ == DepthFormat::float64) {
+        out = float64_;
+        return;
+    }
+
+    out.resize(size_);
+
+    for (size_t i = 0; i < size_; ++i) {
+        out[i] = read(i);
+    }
+}
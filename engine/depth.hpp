@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "kernels.hpp"
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // every format stores -1/z, larger is closer, the unorm ones mapped linearly from a far distance at 1 up to
+    // a near one at their largest value, with 0 left for empty, see DepthBuffer::set_range
+    enum class DepthFormat {
+        float64,  // -1/z as is, -INFINITY where empty
+        float32,
+        unorm24,  // low 24 bits of a 32 bit word
+        unorm16
+    };
+
+    class DepthBuffer {
+        public:
+            DepthBuffer(int width, int height, DepthFormat format = DepthFormat::float64);
+            DepthBuffer() = delete;
+
+            DepthFormat format() const {
+                return format_;
+            }
+
+            double near() const {
+                return near_;
+            }
+
+            double far() const {
+                return far_;
+            }
+
+            // drops the contents, the buffer comes back cleared
+            void set_format(DepthFormat format);
+            void resize(int width, int height);
+
+            // distances in front of the eye the unorm formats spread their steps over, 1/z resolves in steps of
+            // (1/near - 1/far) / 2^bits, nearer saturates and farther takes the farthest step, what is stored
+            // already is not remapped so the buffer should be cleared before it is drawn into again
+            void set_range(double near, double far);
+            // whether depth from near to far is stored without saturating, always for the float formats
+            bool holds(double near, double far) const;
+
+            size_t bytes_per_pixel() const;
+
+            // everything infinitely far, a memset for the compact formats
+            void clear(const Kernels& kernels);
+            // count pixels from index only, for redrawing part of a retained frame
+            void clear_span(size_t index, size_t count, const Kernels& kernels);
+
+            // depth tests count pixels from index, see Kernels::depth_span
+            int test_span(size_t index, uint8_t* pass, int count, int x_start, const Vec2& a, const Vec2& b, const Kernels& kernels, bool write = true);
+
+            // unconditional, depth is -1/z
+            void write(size_t index, double depth);
+            // -1/z, -INFINITY where nothing was drawn
+            double read(size_t index) const;
+
+            bool covered(size_t index) const;
+            size_t covered_count() const;
+
+            // count pixels from index each take the nearest of their sample_count samples, from from on and stride
+            // apart in samples, a buffer of the same format and near, and those samples are cleared
+            void resolve_samples(DepthBuffer& samples, size_t from, size_t stride, int sample_count, size_t index, size_t count);
+
+            // whole buffer as read() would give it
+            void copy_to(std::vector<double>& out) const;
+
+            ~DepthBuffer() = default;
+        private:
+            DepthFormat format_;
+            size_t size_;
+
+            // only the vector for format_ is ever non empty
+            std::vector<double> float64_;
+            std::vector<float> float32_;
+            std::vector<uint32_t> unorm24_;
+            std::vector<uint16_t> unorm16_;
+
+            // stored = -1/z * scale_ + offset_, by default from the clip near plane at z = -0.01 out to 1e6
+            double near_ = 0.01;
+            double far_ = 1e6;
+            double scale_ = 1;
+            double offset_ = 0;
+
+            void allocate();
+            void map_range();
+    };
+};
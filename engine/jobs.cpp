@@ -0,0 +1,198 @@
+#include "jobs.hpp"
+
+namespace {
+    // the pool and queue the current thread works for, so nested forks land on the worker's own deque
+    thread_local const ThreeDL::JobSystem* current_system = nullptr;
+    thread_local size_t current_queue = 0;
+}
+
+ThreeDL::JobSystem::JobSystem(int thread_count) {
+    thread_count = std::max(1, thread_count);
+
+    for (int i = 0; i < thread_count; ++i) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    for (int i = 1; i < thread_count; ++i) {
+        workers_.emplace_back(&JobSystem::work_loop, this, static_cast<size_t>(i));
+    }
+}
+
+size_t ThreeDL::JobSystem::own_queue() const {
+    return current_system == this ? current_queue : 0;
+}
+
+void ThreeDL::JobSystem::run(JobGroup& group, std::function<void()> job) {
+    group.pending_.fetch_add(1, std::memory_order_relaxed);
+
+    WorkerQueue& queue = *queues_[own_queue()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex_);
+        queue.jobs_.push_back({std::move(job), &group});
+    }
+
+    queued_.fetch_add(1, std::memory_order_release);
+
+    // taking the lock orders this against a worker between checking queued_ and going to sleep
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+    }
+    wake_.notify_one();
+}
+
+void ThreeDL::JobSystem::wait(JobGroup& group) {
+    size_t queue = own_queue();
+
+    while (group.pending_.load(std::memory_order_acquire) != 0) {
+        if (!run_one(queue)) {
+            std::this_thread::yield();
+        }
+    }
+
+    if (group.failed_.load(std::memory_order_acquire)) {
+        group.failed_ = false;
+        std::rethrow_exception(std::exchange(group.error_, nullptr));
+    }
+}
+
+void ThreeDL::JobSystem::parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t begin, size_t end)>& body) {
+    if (begin >= end) return;
+
+    grain = std::max<size_t>(grain, 1);
+
+    // nobody to share with, skip the queues entirely
+    if (end - begin <= grain || thread_count() == 1) {
+        for (size_t first = begin; first < end; first += std::min(grain, end - first)) {
+            body(first, first + std::min(grain, end - first));
+        }
+
+        return;
+    }
+
+    JobGroup group;
+
+    try {
+        split(group, begin, end, grain, body);
+    } catch (...) {
+        // the forked halves still reference body, let them finish before unwinding
+        while (group.pending_.load(std::memory_order_acquire) != 0) {
+            if (!run_one(own_queue())) std::this_thread::yield();
+        }
+
+        throw;
+    }
+
+    wait(group);
+}
+
+void ThreeDL::JobSystem::split(JobGroup& group, size_t begin, size_t end, size_t grain, const std::function<void(size_t begin, size_t end)>& body) {
+    while (end - begin > grain) {
+        size_t middle = begin + (end - begin) / 2;
+
+        run(group, [this, &group, middle, end, grain, &body] {
+            split(group, middle, end, grain, body);
+        });
+
+        end = middle;
+    }
+
+    body(begin, end);
+}
+
+bool ThreeDL::JobSystem::pop(size_t queue, Job& job) {
+    WorkerQueue& own = *queues_[queue];
+    std::lock_guard<std::mutex> lock(own.mutex_);
+
+    if (own.jobs_.empty()) return false;
+
+    // newest first, its data is most likely still in this core's cache
+    job = std::move(own.jobs_.back());
+    own.jobs_.pop_back();
+    return true;
+}
+
+bool ThreeDL::JobSystem::steal(size_t thief, Job& job) {
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        WorkerQueue& victim = *queues_[(thief + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex_);
+
+        if (victim.jobs_.empty()) continue;
+
+        // oldest first, for split ranges that is the biggest piece
+        job = std::move(victim.jobs_.front());
+        victim.jobs_.pop_front();
+        return true;
+    }
+
+    return false;
+}
+
+bool ThreeDL::JobSystem::run_one(size_t queue) {
+    if (queued_.load(std::memory_order_acquire) == 0) return false;
+
+    Job job;
+
+    if (!pop(queue, job) && !steal(queue, job)) return false;
+
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    execute(job);
+    return true;
+}
+
+void ThreeDL::JobSystem::execute(Job& job) {
+    JobGroup& group = *job.group_;
+
+    try {
+        job.work_();
+    } catch (...) {
+        if (!group.failed_.exchange(true, std::memory_order_acq_rel)) {
+            group.error_ = std::current_exception();
+        }
+    }
+
+    // the group may be gone as soon as pending_ reaches zero
+    group.pending_.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void ThreeDL::JobSystem::work_loop(size_t queue) {
+    current_system = this;
+    current_queue = queue;
+
+    while (true) {
+        if (run_one(queue)) continue;
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [this] {
+            return queued_.load(std::memory_order_acquire) != 0 || stopping_.load(std::memory_order_acquire);
+        });
+
+        if (stopping_.load(std::memory_order_acquire)) return;
+    }
+}
+
+ThreeDL::JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+ThreeDL::JobSystem& ThreeDL::jobs() {
+    static JobSystem system([] {
+        int count = std::max(1u, std::thread::hardware_concurrency());
+        const char* requested = std::getenv("THREEDL_THREADS");
+
+        if (requested != nullptr && std::atoi(requested) > 0) {
+            count = std::atoi(requested);
+        }
+
+        return count;
+    }());
+
+    return system;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ThreeDL {
+    // jobs forked together, JobSystem::wait on it is the join
+    class JobGroup {
+        public:
+            JobGroup() = default;
+            JobGroup(const JobGroup&) = delete;
+
+            ~JobGroup() = default;
+        private:
+            friend class JobSystem;
+
+            std::atomic<uint32_t> pending_ = 0;
+
+            // first exception thrown by any job, rethrown by wait
+            std::atomic<bool> failed_ = false;
+            std::exception_ptr error_;
+    };
+
+    // fixed pool of workers, each with its own deque, running jobs from the back of its own and
+    // stealing from the front of the others when it runs dry, threads waiting on a join help out
+    class JobSystem {
+        public:
+            // thread_count includes whichever thread waits, so thread_count - 1 workers are started
+            explicit JobSystem(int thread_count);
+            JobSystem() = delete;
+            JobSystem(const JobSystem&) = delete;
+
+            int thread_count() const {
+                return static_cast<int>(queues_.size());
+            }
+
+            void run(JobGroup& group, std::function<void()> job);
+            // runs queued jobs until every job in group is done, then rethrows the first one that threw
+            void wait(JobGroup& group);
+
+            // body(begin, end) over ranges of at most grain, halved as they are forked so a thief
+            // takes the largest piece left, returns once all of [begin, end) is done
+            void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t begin, size_t end)>& body);
+
+            ~JobSystem();
+        private:
+            class Job {
+                public:
+                    std::function<void()> work_;
+                    JobGroup* group_ = nullptr;
+            };
+
+            class WorkerQueue {
+                public:
+                    std::mutex mutex_;
+                    std::deque<Job> jobs_;
+            };
+
+            // queue 0 is shared by every thread outside the pool, the rest belong to one worker each
+            std::vector<std::unique_ptr<WorkerQueue>> queues_;
+            std::vector<std::thread> workers_;
+
+            std::atomic<uint32_t> queued_ = 0;
+            std::atomic<bool> stopping_ = false;
+            std::mutex sleep_mutex_;
+            std::condition_variable wake_;
+
+            size_t own_queue() const;
+            bool pop(size_t queue, Job& job);
+            bool steal(size_t thief, Job& job);
+            bool run_one(size_t queue);
+            void execute(Job& job);
+            void work_loop(size_t queue);
+            void split(JobGroup& group, size_t begin, size_t end, size_t grain, const std::function<void(size_t begin, size_t end)>& body);
+    };
+
+    // engine wide pool, started on first use with one thread per core unless THREEDL_THREADS in the environment says otherwise
+    JobSystem& jobs();
+};
@@ -0,0 +1,338 @@
+#include "kernels.hpp"
+
+// avx512f brings fma with it, keep every variant rounding the same way
+#pragma GCC optimize("fp-contract=off")
+
+// every variant inlines the same body below, only the instruction set the compiler may vectorise it with changes
+#define THREEDL_KERNEL inline __attribute__((always_inline))
+
+namespace {
+    THREEDL_KERNEL void fill_pixels_body(Uint32* pixels, size_t count, Uint32 value) {
+        for (size_t i = 0; i < count; ++i) {
+            pixels[i] = value;
+        }
+    }
+
+    THREEDL_KERNEL void fill_depth_body(double* depth, size_t count, double value) {
+        for (size_t i = 0; i < count; ++i) {
+            depth[i] = value;
+        }
+    }
+
+    THREEDL_KERNEL void transform_points_body(const ThreeDL::Vec3* in, ThreeDL::Vec3* out, size_t count, const std::array<ThreeDL::Vec3, 3>& rotation, const ThreeDL::Vec3& translation) {
+        const double r00 = rotation[0].x, r01 = rotation[0].y, r02 = rotation[0].z;
+        const double r10 = rotation[1].x, r11 = rotation[1].y, r12 = rotation[1].z;
+        const double r20 = rotation[2].x, r21 = rotation[2].y, r22 = rotation[2].z;
+        const double tx = translation.x, ty = translation.y, tz = translation.z;
+
+        for (size_t i = 0; i < count; ++i) {
+            double x = in[i].x - tx;
+            double y = in[i].y - ty;
+            double z = in[i].z - tz;
+
+            out[i].x = r00 * x + r01 * y + r02 * z;
+            out[i].y = r10 * x + r11 * y + r12 * z;
+            out[i].z = r20 * x + r21 * y + r22 * z;
+        }
+    }
+
+    THREEDL_KERNEL void clip_outcodes_body(const ThreeDL::Vec3* vertices, size_t count, const ThreeDL::Plane* planes, int plane_count, uint8_t* codes) {
+        for (size_t i = 0; i < count; ++i) {
+            codes[i] = 0;
+        }
+
+        for (int p = 0; p < plane_count; ++p) {
+            const double nx = planes[p].normal_.x, ny = planes[p].normal_.y, nz = planes[p].normal_.z;
+            const double px = planes[p].position_.x, py = planes[p].position_.y, pz = planes[p].position_.z;
+            const uint8_t bit = static_cast<uint8_t>(1 << p);
+
+            for (size_t i = 0; i < count; ++i) {
+                double side = nx * (vertices[i].x - px) + ny * (vertices[i].y - py) + nz * (vertices[i].z - pz);
+                codes[i] |= side > 0 ? bit : 0;
+            }
+        }
+    }
+
+    // Write false only tests, for geometry that must stay behind what is drawn without hiding anything itself
+    template <bool Write>
+    THREEDL_KERNEL int depth_span_body(double* depth, uint8_t* pass, int count, int x_start, const ThreeDL::Vec2& a, const ThreeDL::Vec2& b) {
+        // a span only has pixels when a.x != b.x, so the vertical fallback in calculate_z_index never applies
+        const double a_x = a.x;
+        const double denom = b.x - a.x;
+        const double a_depth = a.depth_info_;
+        const double depth_delta = b.depth_info_ - a.depth_info_;
+
+        int written = 0;
+
+        for (int i = 0; i < count; ++i) {
+            double t = (static_cast<double>(x_start + i) - a_x) / denom;
+            double z = a_depth + t * depth_delta;
+            bool passed = z > depth[i];
+
+            if constexpr (Write) depth[i] = passed ? z : depth[i];
+            pass[i] = passed;
+            written += passed;
+        }
+
+        return written;
+    }
+
+    template <typename T>
+    THREEDL_KERNEL T to_depth_format(double scaled) {
+        if constexpr (std::is_floating_point_v<T>) {
+            return static_cast<T>(scaled);
+        } else {
+            // past either end of the range saturates, and nothing drawn rounds down to 0, which is empty
+            return static_cast<T>(std::clamp(scaled + 0.5, 1.0, static_cast<double>(std::numeric_limits<T>::max())));
+        }
+    }
+
+    template <bool Write, typename T>
+    THREEDL_KERNEL int depth_span_compact_body(T* depth, uint8_t* pass, int count, int x_start, const ThreeDL::Vec2& a, const ThreeDL::Vec2& b, double scale, double offset) {
+        const double a_x = a.x;
+        const double denom = b.x - a.x;
+        const double a_depth = a.depth_info_ * scale + offset;
+        const double depth_delta = (b.depth_info_ - a.depth_info_) * scale;
+
+        int written = 0;
+
+        for (int i = 0; i < count; ++i) {
+            double t = (static_cast<double>(x_start + i) - a_x) / denom;
+            T z = to_depth_format<T>(a_depth + t * depth_delta);
+            bool passed = z > depth[i];
+
+            if constexpr (Write) depth[i] = passed ? z : depth[i];
+            pass[i] = passed;
+            written += passed;
+        }
+
+        return written;
+    }
+
+    THREEDL_KERNEL void project_points_body(const ThreeDL::Vec3* view, size_t count, double dtp, int width, int height, int32_t* xs, int32_t* ys, float* depths) {
+        const double half_width = static_cast<double>(width) / 2;
+        const double half_height = static_cast<double>(height) / 2;
+
+        for (size_t i = 0; i < count; ++i) {
+            double z = view[i].z;
+            double t = dtp / z;
+            double x = t * view[i].x + half_width;
+            double y = t * view[i].y + half_height;
+
+            bool inside = z < -0.01 && x >= 0 && x < width && y >= 0 && y < height;
+
+            xs[i] = inside ? static_cast<int32_t>(x) : -1;
+            ys[i] = inside ? static_cast<int32_t>(y) : 0;
+            depths[i] = static_cast<float>(-1 / z);
+        }
+    }
+
+    THREEDL_KERNEL void resolve_transparency_body(const float* accum, const float* revealage, Uint32* pixels, size_t count, size_t plane) {
+        const float* red = accum;
+        const float* green = accum + plane;
+        const float* blue = accum + 2 * plane;
+        const float* weight = accum + 3 * plane;
+
+        // branch free, so untouched pixels (weight 0, revealage 1) come back exactly as they were
+        for (size_t i = 0; i < count; ++i) {
+            float reveal = revealage[i];
+            float scale = (1 - reveal) / std::max(weight[i], 1e-5f);
+            Uint32 pixel = pixels[i];
+
+            float r = red[i] * scale + static_cast<float>((pixel >> 16) & 0xff) * reveal;
+            float g = green[i] * scale + static_cast<float>((pixel >> 8) & 0xff) * reveal;
+            float b = blue[i] * scale + static_cast<float>(pixel & 0xff) * reveal;
+
+            pixels[i] = 0xff000000 |
+                        (static_cast<Uint32>(std::min(r + 0.5f, 255.0f)) << 16) |
+                        (static_cast<Uint32>(std::min(g + 0.5f, 255.0f)) << 8) |
+                         static_cast<Uint32>(std::min(b + 0.5f, 255.0f));
+        }
+    }
+
+    THREEDL_KERNEL void resolve_samples_body(Uint32* samples, Uint32* pixels, size_t count, size_t stride, Uint32 clear) {
+        Uint32* s0 = samples;
+        Uint32* s1 = samples + stride;
+        Uint32* s2 = samples + 2 * stride;
+        Uint32* s3 = samples + 3 * stride;
+
+        // red and blue summed together in one word and green in another, four 8 bit values never carry out of 10 bits
+        for (size_t i = 0; i < count; ++i) {
+            Uint32 red_blue = (s0[i] & 0xff00ff) + (s1[i] & 0xff00ff) + (s2[i] & 0xff00ff) + (s3[i] & 0xff00ff) + 0x20002;
+            Uint32 green = (s0[i] & 0xff00) + (s1[i] & 0xff00) + (s2[i] & 0xff00) + (s3[i] & 0xff00) + 0x200;
+
+            pixels[i] = 0xff000000 | ((red_blue >> 2) & 0xff00ff) | ((green >> 2) & 0xff00);
+
+            // cleared while still in cache, rather than in a pass of its own at the start of the next frame
+            s0[i] = clear;
+            s1[i] = clear;
+            s2[i] = clear;
+            s3[i] = clear;
+        }
+    }
+
+    THREEDL_KERNEL void occluder_span_body(float* depth, int count, float start, float step) {
+        for (int i = 0; i < count; ++i) {
+            depth[i] = std::max(depth[i], start + static_cast<float>(i) * step);
+        }
+    }
+
+    THREEDL_KERNEL bool occlusion_test_body(const float* depths, int count, float depth) {
+        // no early out, a whole row is a few vectors
+        int behind = 0;
+
+        for (int i = 0; i < count; ++i) {
+            behind |= depths[i] <= depth;
+        }
+
+        return behind != 0;
+    }
+}
+
+#define THREEDL_KERNEL_VARIANTS(suffix, isa) \
+    namespace { \
+        __attribute__((target(isa))) void fill_pixels_##suffix(Uint32* pixels, size_t count, Uint32 value) { \
+            fill_pixels_body(pixels, count, value); \
+        } \
+        __attribute__((target(isa))) void fill_depth_##suffix(double* depth, size_t count, double value) { \
+            fill_depth_body(depth, count, value); \
+        } \
+        __attribute__((target(isa))) void transform_points_##suffix(const ThreeDL::Vec3* in, ThreeDL::Vec3* out, size_t count, const std::array<ThreeDL::Vec3, 3>& rotation, const ThreeDL::Vec3& translation) { \
+            transform_points_body(in, out, count, rotation, translation); \
+        } \
+        __attribute__((target(isa))) void clip_outcodes_##suffix(const ThreeDL::Vec3* vertices, size_t count, const ThreeDL::Plane* planes, int plane_count, uint8_t* codes) { \
+            clip_outcodes_body(vertices, count, planes, plane_count, codes); \
+        } \
+        __attribute__((target(isa))) int depth_span_##suffix(double* depth, uint8_t* pass, int count, int x_start, const ThreeDL::Vec2& a, const ThreeDL::Vec2& b, bool write) { \
+            return write ? depth_span_body<true>(depth, pass, count, x_start, a, b) : depth_span_body<false>(depth, pass, count, x_start, a, b); \
+        } \
+        __attribute__((target(isa))) int depth_span_f32_##suffix(float* depth, uint8_t* pass, int count, int x_start, const ThreeDL::Vec2& a, const ThreeDL::Vec2& b, double scale, double offset, bool write) { \
+            return write ? depth_span_compact_body<true>(depth, pass, count, x_start, a, b, scale, offset) : depth_span_compact_body<false>(depth, pass, count, x_start, a, b, scale, offset); \
+        } \
+        __attribute__((target(isa))) int depth_span_u32_##suffix(uint32_t* depth, uint8_t* pass, int count, int x_start, const ThreeDL::Vec2& a, const ThreeDL::Vec2& b, double scale, double offset, bool write) { \
+            return write ? depth_span_compact_body<true>(depth, pass, count, x_start, a, b, scale, offset) : depth_span_compact_body<false>(depth, pass, count, x_start, a, b, scale, offset); \
+        } \
+        __attribute__((target(isa))) int depth_span_u16_##suffix(uint16_t* depth, uint8_t* pass, int count, int x_start, const ThreeDL::Vec2& a, const ThreeDL::Vec2& b, double scale, double offset, bool write) { \
+            return write ? depth_span_compact_body<true>(depth, pass, count, x_start, a, b, scale, offset) : depth_span_compact_body<false>(depth, pass, count, x_start, a, b, scale, offset); \
+        } \
+        __attribute__((target(isa))) void project_points_##suffix(const ThreeDL::Vec3* view, size_t count, double dtp, int width, int height, int32_t* xs, int32_t* ys, float* depths) { \
+            project_points_body(view, count, dtp, width, height, xs, ys, depths); \
+        } \
+        __attribute__((target(isa))) void resolve_transparency_##suffix(const float* accum, const float* revealage, Uint32* pixels, size_t count, size_t plane) { \
+            resolve_transparency_body(accum, revealage, pixels, count, plane); \
+        } \
+        __attribute__((target(isa))) void resolve_samples_##suffix(Uint32* samples, Uint32* pixels, size_t count, size_t stride, Uint32 clear) { \
+            resolve_samples_body(samples, pixels, count, stride, clear); \
+        } \
+        __attribute__((target(isa))) void occluder_span_##suffix(float* depth, int count, float start, float step) { \
+            occluder_span_body(depth, count, start, step); \
+        } \
+        __attribute__((target(isa))) bool occlusion_test_##suffix(const float* depths, int count, float depth) { \
+            return occlusion_test_body(depths, count, depth); \
+        } \
+        const ThreeDL::Kernels kernels_##suffix = { \
+            ThreeDL::SimdLevel::suffix, \
+            fill_pixels_##suffix, \
+            fill_depth_##suffix, \
+            transform_points_##suffix, \
+            clip_outcodes_##suffix, \
+            depth_span_##suffix, \
+            depth_span_f32_##suffix, \
+            depth_span_u32_##suffix, \
+            depth_span_u16_##suffix, \
+            project_points_##suffix, \
+            resolve_transparency_##suffix, \
+            resolve_samples_##suffix, \
+            occluder_span_##suffix, \
+            occlusion_test_##suffix \
+        }; \
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define THREEDL_X86 1
+    THREEDL_KERNEL_VARIANTS(sse2, "sse2")
+    THREEDL_KERNEL_VARIANTS(avx2, "avx2")
+    THREEDL_KERNEL_VARIANTS(avx512, "avx512f,avx512vl,avx512bw,avx512dq")
+#else
+    #define THREEDL_X86 0
+    // other architectures only get the baseline build, reported as sse2
+    THREEDL_KERNEL_VARIANTS(sse2, "default")
+#endif
+
+namespace {
+    std::atomic<const ThreeDL::Kernels*> forced_kernels = nullptr;
+
+    const ThreeDL::Kernels* kernels_for(ThreeDL::SimdLevel level) {
+    #if THREEDL_X86
+        switch (level) {
+            case ThreeDL::SimdLevel::avx512: return &kernels_avx512;
+            case ThreeDL::SimdLevel::avx2: return &kernels_avx2;
+            case ThreeDL::SimdLevel::sse2: return &kernels_sse2;
+        }
+    #endif
+
+        return &kernels_sse2;
+    }
+}
+
+bool ThreeDL::simd_supported(SimdLevel level) {
+#if THREEDL_X86
+    __builtin_cpu_init();
+
+    switch (level) {
+        case SimdLevel::avx512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+                   __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq");
+        case SimdLevel::avx2:
+            return __builtin_cpu_supports("avx2");
+        case SimdLevel::sse2:
+            return true;
+    }
+#endif
+
+    return level == SimdLevel::sse2;
+}
+
+const char* ThreeDL::simd_name(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::avx512: return "avx512";
+        case SimdLevel::avx2: return "avx2";
+        case SimdLevel::sse2: return "sse2";
+    }
+
+    return "sse2";
+}
+
+ThreeDL::SimdLevel ThreeDL::detect_simd_level() {
+    SimdLevel best = SimdLevel::sse2;
+
+    for (SimdLevel level : {SimdLevel::avx2, SimdLevel::avx512}) {
+        if (simd_supported(level)) best = level;
+    }
+
+    const char* cap = std::getenv("THREEDL_SIMD");
+    if (cap == nullptr) return best;
+
+    for (SimdLevel level : {SimdLevel::sse2, SimdLevel::avx2, SimdLevel::avx512}) {
+        if (std::string(cap) == simd_name(level)) {
+            return std::min(level, best);
+        }
+    }
+
+    return best;
+}
+
+const ThreeDL::Kernels& ThreeDL::kernels() {
+    static const Kernels* detected = kernels_for(detect_simd_level());
+    const Kernels* forced = forced_kernels.load(std::memory_order_relaxed);
+
+    return forced != nullptr ? *forced : *detected;
+}
+
+void ThreeDL::force_simd_level(SimdLevel level) {
+    if (!simd_supported(level)) {
+        throw std::runtime_error(std::string("CPU does not support ") + simd_name(level));
+    }
+
+    forced_kernels.store(kernels_for(level), std::memory_order_relaxed);
+}
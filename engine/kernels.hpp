@@ -0,0 +1,77 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // instruction sets the hot loops are built for, sse2 is the baseline every x86-64 build runs
+    enum class SimdLevel {
+        sse2,
+        avx2,
+        avx512
+    };
+
+    // one variant of every hot loop, all built from the same source so they give the same results
+    class Kernels {
+        public:
+            SimdLevel level_;
+
+            void (*fill_pixels)(Uint32* pixels, size_t count, Uint32 value);
+            void (*fill_depth)(double* depth, size_t count, double value);
+
+            // out = rotation * (in - translation), in and out may be the same array
+            void (*transform_points)(const Vec3* in, Vec3* out, size_t count, const std::array<Vec3, 3>& rotation, const Vec3& translation);
+
+            // bit p of codes[i] is set when vertex i is on the inside of plane p, at most 8 planes
+            void (*clip_outcodes)(const Vec3* vertices, size_t count, const Plane* planes, int plane_count, uint8_t* codes);
+
+            // depth tests count pixels from x_start, with depth interpolated as calculate_z_index does between a and b,
+            // stores passing depths unless write is false, sets pass[i] to 0 or 1 and returns how many passed
+            int (*depth_span)(double* depth, uint8_t* pass, int count, int x_start, const Vec2& a, const Vec2& b, bool write);
+
+            // depth_span on the compact formats, which store depth * scale + offset, unorm rounded to nearest and kept
+            // off 0, which is empty
+            int (*depth_span_f32)(float* depth, uint8_t* pass, int count, int x_start, const Vec2& a, const Vec2& b, double scale, double offset, bool write);
+            int (*depth_span_u32)(uint32_t* depth, uint8_t* pass, int count, int x_start, const Vec2& a, const Vec2& b, double scale, double offset, bool write);
+            int (*depth_span_u16)(uint16_t* depth, uint8_t* pass, int count, int x_start, const Vec2& a, const Vec2& b, double scale, double offset, bool write);
+
+            // pixel and -1/z of count view space points, projected as Renderer::project does,
+            // xs[i] is -1 for points off screen or nearer than the near plane
+            void (*project_points)(const Vec3* view, size_t count, double dtp, int width, int height, int32_t* xs, int32_t* ys, float* depths);
+
+            // weighted blended transparency over count pixels, accum holds premultiplied red, green, blue and the
+            // weight sum as planes plane floats apart, revealage what of the pixel still shows through
+            void (*resolve_transparency)(const float* accum, const float* revealage, Uint32* pixels, size_t count, size_t plane);
+
+            // count pixels each the rounded per channel mean of their four samples, stride pixels apart in samples,
+            // which are then set to clear for the next frame
+            void (*resolve_samples)(Uint32* samples, Uint32* pixels, size_t count, size_t stride, Uint32 clear);
+
+            // depth only, each of count depths keeps the larger of itself and start + i * step, see OcclusionBuffer
+            void (*occluder_span)(float* depth, int count, float start, float step);
+            // true when any of count depths is at or behind depth, -1/z so that is any not larger
+            bool (*occlusion_test)(const float* depths, int count, float depth);
+    };
+
+    // best level this CPU runs, THREEDL_SIMD=sse2|avx2|avx512 in the environment caps it
+    SimdLevel detect_simd_level();
+    bool simd_supported(SimdLevel level);
+    const char* simd_name(SimdLevel level);
+
+    // chosen on first use
+    const Kernels& kernels();
+    // for testing, swaps every kernel to one level, throws if the CPU cannot run it, not safe mid frame
+    void force_simd_level(SimdLevel level);
+};
@@ -0,0 +1,147 @@
+#include "lighting.hpp"
+
+ThreeDL::DirectionalLight::DirectionalLight(const Vec3& direction, const SDL_Color& color, double intensity)
+    : direction_(direction),
+      color_(color),
+      intensity_(intensity)
+{
+    direction_.normalise();
+}
+
+ThreeDL::PointLight::PointLight(const Vec3& position, const SDL_Color& color, double intensity, double range)
+    : position_(position),
+      color_(color),
+      intensity_(intensity),
+      range_(range)
+{}
+
+void ThreeDL::LightingBatch::resize(size_t count) {
+    for (auto* stream : {&x, &y, &z, &nx, &ny, &nz, &r, &g, &b}) {
+        stream->resize(count);
+    }
+}
+
+void ThreeDL::Lighting::prepare(const Camera& camera) {
+    std::array<Vec3, 3> rotation = camera.view_rotation();
+
+    for (int i = 0; i < 3; ++i) {
+        rotation_[i][0] = rotation[i].x;
+        rotation_[i][1] = rotation[i].y;
+        rotation_[i][2] = rotation[i].z;
+    }
+
+    dir_x_.clear(); dir_y_.clear(); dir_z_.clear();
+    dir_r_.clear(); dir_g_.clear(); dir_b_.clear();
+
+    for (const auto& light : directional_lights_) {
+        Vec3 direction = light.direction_;
+        direction.rotate(camera.rotation_.x, camera.rotation_.y, camera.rotation_.z);
+
+        // stored towards the light so the kernel can dot it straight with the normal
+        dir_x_.push_back(-direction.x);
+        dir_y_.push_back(-direction.y);
+        dir_z_.push_back(-direction.z);
+        dir_r_.push_back(light.color_.r / 255.0 * light.intensity_);
+        dir_g_.push_back(light.color_.g / 255.0 * light.intensity_);
+        dir_b_.push_back(light.color_.b / 255.0 * light.intensity_);
+    }
+
+    point_x_.clear(); point_y_.clear(); point_z_.clear();
+    point_r_.clear(); point_g_.clear(); point_b_.clear();
+    point_inv_range_.clear();
+
+    for (const auto& light : point_lights_) {
+        Vec3 position = light.position_ - camera.position_;
+        position.rotate(camera.rotation_.x, camera.rotation_.y, camera.rotation_.z);
+
+        point_x_.push_back(position.x);
+        point_y_.push_back(position.y);
+        point_z_.push_back(position.z);
+        point_r_.push_back(light.color_.r / 255.0 * light.intensity_);
+        point_g_.push_back(light.color_.g / 255.0 * light.intensity_);
+        point_b_.push_back(light.color_.b / 255.0 * light.intensity_);
+        point_inv_range_.push_back(light.range_ > 0 ? 1 / light.range_ : 0);
+    }
+}
+
+void ThreeDL::Lighting::light(LightingBatch& batch) const {
+    for (size_t start = 0; start < batch.size(); start += block_size_) {
+        light_block(batch, start, std::min(start + block_size_, batch.size()));
+    }
+}
+
+void ThreeDL::Lighting::light_block(LightingBatch& batch, size_t start, size_t end) const {
+    // every loop below walks plain float streams with no cross-lane dependencies so it vectorises
+    const size_t count = end - start;
+    const float* __restrict x = batch.x.data() + start;
+    const float* __restrict y = batch.y.data() + start;
+    const float* __restrict z = batch.z.data() + start;
+    const float* __restrict world_nx = batch.nx.data() + start;
+    const float* __restrict world_ny = batch.ny.data() + start;
+    const float* __restrict world_nz = batch.nz.data() + start;
+    float* __restrict r = batch.r.data() + start;
+    float* __restrict g = batch.g.data() + start;
+    float* __restrict b = batch.b.data() + start;
+    const uint32_t* __restrict occluded = batch.occluded.empty() ? nullptr : batch.occluded.data() + start;
+
+    const float ambient_r = ambient_.r / 255.0f;
+    const float ambient_g = ambient_.g / 255.0f;
+    const float ambient_b = ambient_.b / 255.0f;
+
+    // view space normals of the block, the batch keeps its world space ones so it can be lit again
+    float nx[block_size_];
+    float ny[block_size_];
+    float nz[block_size_];
+
+    for (size_t i = 0; i < count; ++i) {
+        float wx = world_nx[i];
+        float wy = world_ny[i];
+        float wz = world_nz[i];
+
+        nx[i] = rotation_[0][0] * wx + rotation_[0][1] * wy + rotation_[0][2] * wz;
+        ny[i] = rotation_[1][0] * wx + rotation_[1][1] * wy + rotation_[1][2] * wz;
+        nz[i] = rotation_[2][0] * wx + rotation_[2][1] * wy + rotation_[2][2] * wz;
+
+        r[i] = ambient_r;
+        g[i] = ambient_g;
+        b[i] = ambient_b;
+    }
+
+    for (size_t l = 0; l < dir_x_.size(); ++l) {
+        const float lx = dir_x_[l], ly = dir_y_[l], lz = dir_z_[l];
+        const float lr = dir_r_[l], lg = dir_g_[l], lb = dir_b_[l];
+        const uint32_t bit = l < 32 ? 1u << l : 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            float ndl = std::max(0.0f, nx[i] * lx + ny[i] * ly + nz[i] * lz);
+            if (occluded != nullptr && (occluded[i] & bit)) ndl = 0;
+
+            r[i] += ndl * lr;
+            g[i] += ndl * lg;
+            b[i] += ndl * lb;
+        }
+    }
+
+    for (size_t l = 0; l < point_x_.size(); ++l) {
+        const float px = point_x_[l], py = point_y_[l], pz = point_z_[l];
+        const float lr = point_r_[l], lg = point_g_[l], lb = point_b_[l];
+        const float inv_range = point_inv_range_[l];
+        const size_t index = dir_x_.size() + l;
+        const uint32_t bit = index < 32 ? 1u << index : 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            float dx = px - x[i];
+            float dy = py - y[i];
+            float dz = pz - z[i];
+
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz) + 1e-6f;
+            float ndl = std::max(0.0f, (nx[i] * dx + ny[i] * dy + nz[i] * dz) / distance);
+            float attenuation = std::max(0.0f, 1 - distance * inv_range);
+            if (occluded != nullptr && (occluded[i] & bit)) attenuation = 0;
+
+            r[i] += ndl * attenuation * lr;
+            g[i] += ndl * attenuation * lg;
+            b[i] += ndl * attenuation * lb;
+        }
+    }
+}
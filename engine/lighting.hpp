@@ -0,0 +1,91 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "camera.hpp"
+#include "utils.hpp"
+
+namespace ThreeDL {
+    enum class LightingMode {
+        unlit,   // mesh colour only
+        flat,    // one evaluation per triangle
+        gouraud  // one evaluation per vertex, interpolated across the triangle
+    };
+
+    class DirectionalLight {
+        public:
+            DirectionalLight(const Vec3& direction, const SDL_Color& color, double intensity);
+            DirectionalLight() = delete;
+
+            Vec3 direction_; // direction the light travels in
+            SDL_Color color_;
+            double intensity_;
+
+            ~DirectionalLight() = default;
+    };
+
+    class PointLight {
+        public:
+            PointLight(const Vec3& position, const SDL_Color& color, double intensity, double range);
+            PointLight() = delete;
+
+            Vec3 position_;
+            SDL_Color color_;
+            double intensity_;
+            double range_; // falls off linearly to nothing at this distance, <= 0 never falls off
+
+            ~PointLight() = default;
+    };
+
+    // structure of arrays vertex stream consumed by the lighting kernel
+    class LightingBatch {
+        public:
+            LightingBatch() = default;
+
+            std::vector<float> x, y, z;    // view space positions
+            std::vector<float> nx, ny, nz; // world space normals, left as they are
+            std::vector<float> r, g, b;    // output light intensity per channel
+
+            // optional, left empty by resize(), bit l set when light l is blocked,
+            // directional lights first then point lights, lights past 32 are never blocked
+            std::vector<uint32_t> occluded;
+
+            void resize(size_t count);
+            size_t size() const { return x.size(); }
+
+            ~LightingBatch() = default;
+    };
+
+    class Lighting {
+        public:
+            Lighting() = default;
+
+            std::vector<DirectionalLight> directional_lights_;
+            std::vector<PointLight> point_lights_;
+            SDL_Color ambient_ = {40, 40, 40, 255};
+
+            // moves the lights into view space, call once per frame before light()
+            void prepare(const Camera& camera);
+            void light(LightingBatch& batch) const;
+
+            ~Lighting() = default;
+        private:
+            // vertices are lit in blocks of this many so a block of every stream stays in L1
+            static constexpr size_t block_size_ = 256;
+
+            // world to view rotation, rows
+            float rotation_[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+            // view space lights, structure of arrays
+            std::vector<float> dir_x_, dir_y_, dir_z_, dir_r_, dir_g_, dir_b_;
+            std::vector<float> point_x_, point_y_, point_z_, point_r_, point_g_, point_b_, point_inv_range_;
+
+            void light_block(LightingBatch& batch, size_t start, size_t end) const;
+    };
+};
@@ -0,0 +1,72 @@
+#include "multiview.hpp"
+
+ThreeDL::MultiViewRenderer::MultiViewRenderer(SDL_Renderer* renderer, int width, int height)
+    : renderer_(renderer),
+      width_(width),
+      height_(height),
+      framebuffer_(width * height)
+{
+    if (renderer_ != nullptr) {
+        frame_texture_ = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width_, height_);
+    }
+}
+
+void ThreeDL::MultiViewRenderer::add(Object* object) {
+    objects_.push_back(object);
+}
+
+ThreeDL::Renderer& ThreeDL::MultiViewRenderer::add_view(Camera& camera, const SDL_Rect& viewport) {
+    views_.push_back(std::make_unique<Renderer>(camera, viewport.w, viewport.h));
+    viewports_.push_back(viewport);
+
+    return *views_.back();
+}
+
+void ThreeDL::MultiViewRenderer::render() {
+    // world space work happens once here, every view only pays for its own culling and pixels
+    scene_.build(objects_);
+
+    // each view is a job, its own geometry and shading jobs nest inside it
+    jobs().parallel_for(0, views_.size(), 1, [this](size_t begin, size_t end) {
+        render_views(begin, end);
+    });
+
+    // in view order so later viewports draw over earlier ones, eg. a minimap over the main view
+    std::fill(framebuffer_.begin(), framebuffer_.end(), 0xff000000);
+
+    for (size_t i = 0; i < views_.size(); ++i) {
+        composite(i);
+    }
+
+    if (renderer_ == nullptr) return;
+
+    SDL_UpdateTexture(frame_texture_, nullptr, framebuffer_.data(), width_ * sizeof(Uint32));
+    SDL_RenderCopy(renderer_, frame_texture_, nullptr, nullptr);
+    SDL_RenderPresent(renderer_);
+}
+
+void ThreeDL::MultiViewRenderer::render_views(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        views_[i]->render_prepared(scene_);
+    }
+}
+
+void ThreeDL::MultiViewRenderer::composite(size_t view) {
+    const SDL_Rect& viewport = viewports_[view];
+    const std::vector<Uint32>& pixels = views_[view]->frame();
+
+    int x_start = std::max(0, viewport.x);
+    int x_end = std::min(width_, viewport.x + viewport.w);
+    if (x_start >= x_end) return;
+
+    for (int y = std::max(0, viewport.y); y < std::min(height_, viewport.y + viewport.h); ++y) {
+        const Uint32* source = pixels.data() + (y - viewport.y) * viewport.w + (x_start - viewport.x);
+        std::copy(source, source + (x_end - x_start), framebuffer_.data() + y * width_ + x_start);
+    }
+}
+
+ThreeDL::MultiViewRenderer::~MultiViewRenderer() {
+    if (frame_texture_ != nullptr) {
+        SDL_DestroyTexture(frame_texture_);
+    }
+}
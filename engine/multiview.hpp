@@ -0,0 +1,51 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <memory>
+#include <vector>
+
+#include "camera.hpp"
+#include "jobs.hpp"
+#include "objects.hpp"
+#include "rendering.hpp"
+#include "scene.hpp"
+
+namespace ThreeDL {
+    // renders several cameras into viewports of one frame, sharing a single world space snapshot
+    class MultiViewRenderer {
+        public:
+            // renderer may be nullptr to keep frames in memory only
+            MultiViewRenderer(SDL_Renderer* renderer, int width, int height);
+            MultiViewRenderer() = delete;
+
+            void add(Object* object);
+
+            // the returned renderer draws just this view, use it to set lights and modes
+            Renderer& add_view(Camera& camera, const SDL_Rect& viewport);
+
+            void render();
+
+            const std::vector<Uint32>& frame() const {
+                return framebuffer_;
+            }
+
+            ~MultiViewRenderer();
+        private:
+            SDL_Renderer* renderer_;
+            SDL_Texture* frame_texture_ = nullptr;
+
+            int width_;
+            int height_;
+
+            std::vector<Object*> objects_;
+            std::vector<std::unique_ptr<Renderer>> views_;
+            std::vector<SDL_Rect> viewports_;
+
+            PreparedScene scene_;
+            std::vector<Uint32> framebuffer_;
+
+            void render_views(size_t begin, size_t end);
+            void composite(size_t view);
+    };
+};
@@ -1,25 +1,187 @@
 #include "objects.hpp"
 
-ThreeDL::Mesh::Mesh(std::vector<GSPTriangle> triangles, SDL_Surface* tex)
+namespace {
+    std::atomic<uint64_t> next_generation{1};
+
+    // centre of the bounding box, and the sphere through its corners
+    void bounding_sphere(const std::vector<ThreeDL::GSPTriangle>& triangles, ThreeDL::Vec3& centre, double& radius) {
+        ThreeDL::Vec3 min = triangles[0].vertices_[0];
+        ThreeDL::Vec3 max = min;
+
+        for (const auto& triangle : triangles) {
+            for (const auto& vertex : triangle.vertices_) {
+                min = {std::min(min.x, vertex.x), std::min(min.y, vertex.y), std::min(min.z, vertex.z)};
+                max = {std::max(max.x, vertex.x), std::max(max.y, vertex.y), std::max(max.z, vertex.z)};
+            }
+        }
+
+        centre = (min + max) / 2;
+        radius = (max - min).mag() / 2;
+    }
+}
+
+ThreeDL::Mesh::Mesh(std::vector<GSPTriangle> triangles, SDL_Surface* tex, const SDL_Color& color)
     : triangles_(triangles),
-      texture_(tex)
-{}
+      texture_(tex),
+      color_(color),
+      generation_(next_generation++)
+{
+    build_bounds();
+    build_clusters();
+}
 
 ThreeDL::Mesh::Mesh(const Mesh& other)
     : triangles_(other.triangles_),
-      texture_(other.texture_)
+      texture_(other.texture_),
+      color_(other.color_),
+      opacity_(other.opacity_),
+      centre_(other.centre_),
+      radius_(other.radius_),
+      cluster_triangles_(other.cluster_triangles_),
+      clusters_(other.clusters_),
+      compressed_(other.compressed_),
+      generation_(other.generation_)
 {}
 
+void ThreeDL::Mesh::compress() {
+    if (compressed_ != nullptr) return;
+
+    compressed_ = std::make_shared<CompressedTriangles>(triangles_);
+    std::vector<GSPTriangle>().swap(triangles_);
+
+    // quantised, so no longer quite what was cached
+    generation_ = next_generation++;
+}
+
+size_t ThreeDL::Mesh::triangle_count() const {
+    return compressed_ != nullptr ? compressed_->size() : triangles_.size();
+}
+
+ThreeDL::GSPTriangle ThreeDL::Mesh::triangle(size_t index) const {
+    return compressed_ != nullptr ? compressed_->triangle(index) : triangles_[index];
+}
+
+size_t ThreeDL::Mesh::memory_bytes() const {
+    // every GSPTriangle owns three heap blocks of three elements each, allocator overhead not counted
+    size_t heap_per_triangle = 3 * (2 * sizeof(Vec3) + sizeof(Vec2));
+    size_t bytes = triangles_.capacity() * sizeof(GSPTriangle) + triangles_.size() * heap_per_triangle;
+
+    if (compressed_ != nullptr) {
+        bytes += compressed_->memory_bytes();
+    }
+
+    return bytes;
+}
+
+uint64_t ThreeDL::Mesh::generation() const {
+    return generation_;
+}
+
+void ThreeDL::Mesh::changed() {
+    generation_ = next_generation++;
+
+    // compressed triangles cannot be edited, so what was built from them still holds
+    if (compressed_ != nullptr) return;
+
+    build_bounds();
+    build_clusters();
+}
+
+void ThreeDL::Mesh::build_bounds() {
+    centre_ = {0, 0, 0};
+    radius_ = 0;
+
+    if (triangles_.empty()) return;
+
+    bounding_sphere(triangles_, centre_, radius_);
+}
+
+// spreads the low 10 bits of value out to every third bit
+static uint32_t spread_bits(uint32_t value) {
+    value &= 0x3ff;
+    value = (value | (value << 16)) & 0x030000ff;
+    value = (value | (value << 8)) & 0x0300f00f;
+    value = (value | (value << 4)) & 0x030c30c3;
+    value = (value | (value << 2)) & 0x09249249;
+    return value;
+}
+
+std::vector<uint32_t> ThreeDL::Mesh::cluster_order(const std::vector<GSPTriangle>& triangles) {
+    std::vector<uint32_t> order;
+    if (triangles.empty()) return order;
+
+    Vec3 centre;
+    double radius;
+    bounding_sphere(triangles, centre, radius);
+
+    std::vector<std::pair<uint32_t, uint32_t>> codes;
+    codes.reserve(triangles.size());
+
+    Vec3 min = centre - Vec3{radius, radius, radius};
+    double scale = (radius > 0) ? 1023 / (radius * 2) : 0;
+
+    for (uint32_t i = 0; i < triangles.size(); ++i) {
+        const auto& v = triangles[i].vertices_;
+        Vec3 cell = (((v[0] + v[1] + v[2]) / 3) - min) * scale;
+
+        uint32_t code = spread_bits(static_cast<uint32_t>(cell.x)) |
+                        (spread_bits(static_cast<uint32_t>(cell.y)) << 1) |
+                        (spread_bits(static_cast<uint32_t>(cell.z)) << 2);
+        codes.emplace_back(code, i);
+    }
+
+    std::sort(codes.begin(), codes.end());
+    order.reserve(codes.size());
+
+    for (const auto& [code, index] : codes) {
+        order.push_back(index);
+    }
+
+    // each cluster in mesh order, which keeps whatever vertex reuse the loader ordered for
+    for (size_t first = 0; first < order.size(); first += cluster_size_) {
+        size_t count = std::min<size_t>(cluster_size_, order.size() - first);
+        std::sort(order.begin() + first, order.begin() + first + count);
+    }
+
+    return order;
+}
+
+void ThreeDL::Mesh::build_clusters() {
+    clusters_.clear();
+    cluster_triangles_ = cluster_order(triangles_);
+
+    for (uint32_t first = 0; first < cluster_triangles_.size(); first += cluster_size_) {
+        uint32_t count = std::min<uint32_t>(cluster_size_, cluster_triangles_.size() - first);
+
+        Vec3 min_c = triangles_[cluster_triangles_[first]].vertices_[0];
+        Vec3 max_c = min_c;
+
+        for (uint32_t i = first; i < first + count; ++i) {
+            for (const auto& vertex : triangles_[cluster_triangles_[i]].vertices_) {
+                min_c = {std::min(min_c.x, vertex.x), std::min(min_c.y, vertex.y), std::min(min_c.z, vertex.z)};
+                max_c = {std::max(max_c.x, vertex.x), std::max(max_c.y, vertex.y), std::max(max_c.z, vertex.z)};
+            }
+        }
+
+        clusters_.push_back({first, count, (min_c + max_c) / 2, (max_c - min_c).mag() / 2});
+    }
+}
+
 ThreeDL::Object::Object(const Mesh& mesh)
     : mesh_(mesh)
 {}
 
+bool ThreeDL::Object::has_transform() const {
+    return position_ != Vec3{0, 0, 0} || rotation_ != Vec3{0, 0, 0};
+}
+
 ThreeDL::OBJLoader::OBJLoader(const std::string& model_path, const std::string& texture_path)
     : model_path_(model_path),
       texture_path_(texture_path)
 {
-    load_model();
+    // texture first, load_model only reads face UVs once textured_ is set
     load_texture();
+    load_model();
 }
 
 ThreeDL::OBJLoader::OBJLoader(const std::string& filename, const SDL_Color& color)
@@ -41,12 +203,14 @@ void ThreeDL::OBJLoader::load_model() {
         return;
     }
 
-    // vertex & texture values for face indexing
+    // vertex, texture & normal values for face indexing
     int v_value = 1;
     int t_value = 1;
+    int n_value = 1;
 
     std::unordered_map<int, Vec3> vertices;
     std::unordered_map<int, Vec2> texture_coords;
+    std::unordered_map<int, Vec3> normals;
 
     while (getline(vertex_data, line)) {
         if (line.empty()) continue;
@@ -64,6 +228,18 @@ void ThreeDL::OBJLoader::load_model() {
             });
 
             ++t_value;
+        } else if (line[0] == 'v' && line[1] == 'n') {
+            std::vector<std::string> tokens = split(line.substr(3), ' ');
+            Vec3 normal = {
+                std::stod(tokens[0]),
+                std::stod(tokens[1]),
+                std::stod(tokens[2])
+            };
+
+            normal.normalise();
+            normals.insert({n_value, normal});
+
+            ++n_value;
         } else if (line[0] == 'v') {
             std::vector<std::string> tokens = split(line.substr(2), ' ');
             vertices.insert(
@@ -79,53 +255,86 @@ void ThreeDL::OBJLoader::load_model() {
 
             ++v_value;
         } else if (line[0] == 'f') {
-            if (textured_) {
-                std::vector<std::string> tokens = split(line.substr(2), ' ');
-                std::vector<std::string> first = split(tokens[0], '/');
-                std::vector<std::string> second = split(tokens[1], '/');
-                std::vector<std::string> third = split(tokens[2], '/');
-
-                triangles_.emplace_back(
-                    vertices[std::stoi(first[0])],
-                    vertices[std::stoi(second[0])],
-                    vertices[std::stoi(third[0])]
-                );
-
-                triangles_.back().uvs_ = {
+            // faces are v, v/vt, v/vt/vn or v//vn
+            std::vector<std::string> tokens = split(line.substr(2), ' ');
+            std::vector<std::string> first = split(tokens[0], '/');
+            std::vector<std::string> second = split(tokens[1], '/');
+            std::vector<std::string> third = split(tokens[2], '/');
+
+            triangles_.emplace_back(
+                vertices[std::stoi(first[0])],
+                vertices[std::stoi(second[0])],
+                vertices[std::stoi(third[0])]
+            );
+
+            GSPTriangle& triangle = triangles_.back();
+
+            if (textured_ && first.size() > 1 && !first[1].empty()) {
+                triangle.uvs_ = {
                     texture_coords[std::stoi(first[1])],
                     texture_coords[std::stoi(second[1])],
                     texture_coords[std::stoi(third[1])]
                 };
+            }
+
+            if (first.size() > 2 && !first[2].empty()) {
+                triangle.normals_ = {
+                    normals[std::stoi(first[2])],
+                    normals[std::stoi(second[2])],
+                    normals[std::stoi(third[2])]
+                };
             } else {
-                std::vector<std::string> tokens = split(line.substr(2), ' ');
-                triangles_.emplace_back(
-                    vertices[std::stoi(tokens[0])],
-                    vertices[std::stoi(tokens[1])],
-                    vertices[std::stoi(tokens[2])]
-                );
+                // no vn data, fall back to the face normal
+                Vec3 normal = triangle.face_normal();
+                triangle.normals_ = {normal, normal, normal};
             }
         }
     }
 }
 
 void ThreeDL::OBJLoader::load_texture() {
-    texture_data_ = IMG_Load(texture_path_.c_str());
+    SDL_Surface* loaded = IMG_Load(texture_path_.c_str());
 
-    if (texture_data_ == nullptr) {
+    if (loaded == nullptr) {
         throw std::runtime_error("Could not load texture: " + texture_path_);
         return;
     }
 
+    // the renderer samples texels directly, so keep every texture in the framebuffer format
+    texture_data_ = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loaded);
+
+    if (texture_data_ == nullptr) {
+        throw std::runtime_error("Could not convert texture: " + texture_path_);
+        return;
+    }
+
     textured_ = true;
 }
 
+ThreeDL::MeshOptimisationStats ThreeDL::OBJLoader::optimise(bool overdraw) {
+    // into the clusters the mesh will draw them in first, and reordered only within those, so the mesh
+    // draws them in exactly the optimised order
+    std::vector<uint32_t> order = Mesh::cluster_order(triangles_);
+    std::vector<GSPTriangle> clustered;
+    clustered.reserve(order.size());
+
+    for (uint32_t index : order) {
+        clustered.push_back(triangles_[index]);
+    }
+
+    triangles_.swap(clustered);
+
+    return optimise_triangles(triangles_, overdraw, Mesh::cluster_size_);
+}
+
 ThreeDL::Mesh ThreeDL::OBJLoader::export_mesh() {
     exported_ = true;
-    return {triangles_, texture_data_};
+    return {triangles_, texture_data_, color_};
 }
 
 ThreeDL::OBJLoader::~OBJLoader() {
     if (!exported_ && texture_data_ != nullptr) {
         SDL_FreeSurface(texture_data_);
     }
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -1,25 +1,84 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <fstream>
+#include <iostream>
+#include <memory>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "compression.hpp"
+#include "optimise.hpp"
 #include "utils.hpp"
 
 namespace ThreeDL {
+    // spatially coherent run of triangles, used to order drawing inside a mesh
+    class TriangleCluster {
+        public:
+            uint32_t first_; // offset into Mesh::cluster_triangles_
+            uint32_t count_;
+
+            Vec3 centre_;
+            double radius_;
+    };
+
     class Mesh {
         public:
             explicit Mesh(const Mesh& other);
-            Mesh(std::vector<GSPTriangle> triangles, SDL_Surface* tex);
+            Mesh(std::vector<GSPTriangle> triangles, SDL_Surface* tex, const SDL_Color& color = {255, 255, 255, 255});
             Mesh() = delete;
 
             std::vector<GSPTriangle> triangles_;
             SDL_Surface* texture_;
+            SDL_Color color_;
+            // below 1 the mesh is drawn in the transparency pass, blended without sorting and hiding nothing,
+            // texel alpha multiplies it there
+            double opacity_ = 1;
+
+            // bounding sphere of the whole mesh
+            Vec3 centre_ = {0, 0, 0};
+            double radius_ = 0;
+
+            // triangle indices in Morton order of their centroids, cut into clusters
+            std::vector<uint32_t> cluster_triangles_;
+            std::vector<TriangleCluster> clusters_;
+
+            // set by compress(), triangles_ is then empty and every stage decodes from here, shared between copies
+            std::shared_ptr<const CompressedTriangles> compressed_;
+
+            // quantises the triangles and frees the full precision ones, bounds and clusters are kept as they were
+            void compress();
+
+            size_t triangle_count() const;
+            // decoded when compressed
+            GSPTriangle triangle(size_t index) const;
+            // bytes held by the triangle storage
+            size_t memory_bytes() const;
+
+            // never reused, a new mesh takes the next one and a copy keeps its source's, so a cache keyed on it
+            // cannot mistake a mesh for one freed before it at the same address
+            uint64_t generation() const;
+            // after editing triangles_ in place, rebuilds the bounds and clusters and moves the generation on so
+            // caches keyed on it see a new mesh
+            void changed();
+
+            // what cluster_triangles_ would be for these triangles, Morton order cut into clusters of
+            // cluster_size_ with each in mesh order, so reordering triangles within a cluster moves none out of it
+            static std::vector<uint32_t> cluster_order(const std::vector<GSPTriangle>& triangles);
+
+            static constexpr uint32_t cluster_size_ = 64;
 
             ~Mesh() = default;
+        private:
+            uint64_t generation_;
+
+            void build_bounds();
+            void build_clusters();
     };
 
     class Object {
@@ -27,11 +86,21 @@ namespace ThreeDL {
             explicit Object(const Mesh& mesh);
             Object() = delete;
 
-            Vec3 position_;
-            Vec3 rotation_;
+            // applied as rotation then translation, mesh space to world space
+            Vec3 position_ = {0, 0, 0};
+            Vec3 rotation_ = {0, 0, 0};
 
             Mesh mesh_;
 
+            // drawn into the occlusion buffer before anything else so what it hides is never drawn,
+            // see Renderer::set_occlusion_culling, for large opaque objects such as walls and buildings
+            bool occluder_ = false;
+            // not owned, a simplified stand in drawn there instead of mesh_, in the same mesh space and
+            // nowhere outside mesh_ or it will hide what it should not
+            const Mesh* occluder_mesh_ = nullptr;
+
+            bool has_transform() const;
+
             ~Object() = default;
     };
 
@@ -43,6 +112,10 @@ namespace ThreeDL {
 
             void load_model();
             void load_texture();
+
+            // reorders triangles_ for vertex cache reuse within the clusters Mesh cuts them into, the stats
+            // measure the order the exported mesh draws them in, before and after
+            MeshOptimisationStats optimise(bool overdraw = false);
             
             Mesh export_mesh();
 
@@ -51,8 +124,8 @@ namespace ThreeDL {
             std::vector<GSPTriangle> triangles_;
         private:
             
-            SDL_Color color_;
-            SDL_Surface* texture_data_;
+            SDL_Color color_ = {255, 255, 255, 255};
+            SDL_Surface* texture_data_ = nullptr;
             
             std::string model_path_;
             std::string texture_path_;
@@ -60,4 +133,4 @@ namespace ThreeDL {
             bool textured_ = false;
             bool exported_ = false;
     };
-};
\ No newline at end of file
+};
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "occlusion.hpp"
+
+ThreeDL::OcclusionBuffer::OcclusionBuffer(int width, int height)
+    : width_(width),
+      height_(height),
+      depth_(static_cast<size_t>(width) * height, 0.0f)
+{}
+
+void ThreeDL::OcclusionBuffer::resize(int width, int height) {
+    width_ = std::max(1, width);
+    height_ = std::max(1, height);
+    depth_.assign(static_cast<size_t>(width_) * height_, 0.0f);
+}
+
+void ThreeDL::OcclusionBuffer::clear() {
+    std::fill(depth_.begin(), depth_.end(), 0.0f);
+}
+
+void ThreeDL::OcclusionBuffer::draw_triangle(const Vec2& a, const Vec2& b, const Vec2& c, const Kernels& kernels) {
+    double det = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+
+    // edge on, covers nothing
+    if (std::abs(det) < 1e-12) return;
+
+    // -1/z is linear on screen, so depth over the triangle is a plane in x and y
+    double dzdx = ((b.depth_info_ - a.depth_info_) * (c.y - a.y) - (c.depth_info_ - a.depth_info_) * (b.y - a.y)) / det;
+    double dzdy = ((b.x - a.x) * (c.depth_info_ - a.depth_info_) - (c.x - a.x) * (b.depth_info_ - a.depth_info_)) / det;
+
+    // from a pixel centre to the farthest corner of its square
+    double slack = 0.5 * (std::abs(dzdx) + std::abs(dzdy));
+
+    int y_start = std::max(0, static_cast<int>(std::ceil(std::min({a.y, b.y, c.y}) - 0.5)));
+    int y_end = std::min(height_ - 1, static_cast<int>(std::floor(std::max({a.y, b.y, c.y}) - 0.5)));
+
+    const Vec2* corners[3] = {&a, &b, &c};
+
+    for (int y = y_start; y <= y_end; ++y) {
+        double centre_y = y + 0.5;
+        // finite stand ins for infinity, -ffast-math may fold comparisons against it
+        double x_low = std::numeric_limits<double>::max();
+        double x_high = std::numeric_limits<double>::lowest();
+
+        // the row centre crosses two edges, or touches a corner where both meet
+        for (int e = 0; e < 3; ++e) {
+            const Vec2& p = *corners[e];
+            const Vec2& q = *corners[(e + 1) % 3];
+
+            if (p.y == q.y || centre_y < std::min(p.y, q.y) || centre_y > std::max(p.y, q.y)) continue;
+
+            double x = p.x + (centre_y - p.y) * (q.x - p.x) / (q.y - p.y);
+            x_low = std::min(x_low, x);
+            x_high = std::max(x_high, x);
+        }
+
+        int x_start = std::max(0, static_cast<int>(std::ceil(x_low - 0.5)));
+        int x_end = std::min(width_ - 1, static_cast<int>(std::floor(x_high - 0.5)));
+        if (x_start > x_end) continue;
+
+        double start = a.depth_info_ + (x_start + 0.5 - a.x) * dzdx + (centre_y - a.y) * dzdy - slack;
+        double end = start + (x_end - x_start) * dzdx;
+        start -= depth_epsilon_ * std::max(std::abs(start), std::abs(end));
+
+        kernels.occluder_span(&depth_[static_cast<size_t>(y) * width_ + x_start], x_end - x_start + 1, static_cast<float>(start), static_cast<float>(dzdx));
+    }
+}
+
+bool ThreeDL::OcclusionBuffer::rect_visible(int x_min, int y_min, int x_max, int y_max, double depth, const Kernels& kernels) const {
+    x_min = std::max(x_min, 0);
+    y_min = std::max(y_min, 0);
+    x_max = std::min(x_max, width_ - 1);
+    y_max = std::min(y_max, height_ - 1);
+
+    // off the buffer is for the frustum test to judge
+    if (x_min > x_max || y_min > y_max) return true;
+
+    for (int y = y_min; y <= y_max; ++y) {
+        if (kernels.occlusion_test(&depth_[static_cast<size_t>(y) * width_ + x_min], x_max - x_min + 1, static_cast<float>(depth))) {
+            return true;
+        }
+    }
+
+    return false;
+}
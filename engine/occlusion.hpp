@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "kernels.hpp"
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // low resolution depth of the occluders alone, for rejecting whole objects before any of their triangles are
+    // touched, -1/z as the depth buffer stores it with 0 where nothing was drawn
+    //
+    // coverage is sampled at pixel centres rather than only taking pixels a triangle wholly covers, which would
+    // leave a hole along every edge shared inside an occluder, so it is conservative over one occluder's surface
+    // but not across a gap between two, something seen only through a gap narrower than about a buffer pixel can
+    // be culled though it would show at full resolution
+    class OcclusionBuffer {
+        public:
+            OcclusionBuffer(int width, int height);
+            OcclusionBuffer() = delete;
+
+            // drops the contents
+            void resize(int width, int height);
+
+            int width() const {
+                return width_;
+            }
+
+            int height() const {
+                return height_;
+            }
+
+            void clear();
+
+            // corners in buffer pixels with -1/z, all in front of the near plane, either winding, a pixel is covered
+            // when its centre is inside and takes the farthest depth of the triangle's plane anywhere over it
+            void draw_triangle(const Vec2& a, const Vec2& b, const Vec2& c, const Kernels& kernels);
+
+            // false only when every pixel of the inclusive rectangle is nearer than depth, the rectangle should
+            // reach a pixel past what it bounds, a covered pixel's square can stick out past its triangle
+            bool rect_visible(int x_min, int y_min, int x_max, int y_max, double depth, const Kernels& kernels) const;
+
+            ~OcclusionBuffer() = default;
+        private:
+            int width_;
+            int height_;
+            std::vector<float> depth_;
+
+            // taken off every stored depth, more than a float span can drift over a row
+            static constexpr double depth_epsilon_ = 1e-5;
+    };
+};
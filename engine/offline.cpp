@@ -0,0 +1,244 @@
+#include "offline.hpp"
+
+namespace {
+    // the pattern is never handed to printf whole, only its one integer conversion is, so a stray %s or
+    // an overlong name can't misread the arguments or be cut short
+    std::string frame_name(const std::string& pattern, int frame) {
+        std::string name;
+        bool converted = false;
+
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            if (pattern[i] != '%') {
+                name += pattern[i];
+                continue;
+            }
+
+            if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+                name += '%';
+                ++i;
+                continue;
+            }
+
+            // flags and a width of at most two digits, then d or i
+            size_t end = i + 1;
+            while (end < pattern.size() && std::strchr("-+ 0", pattern[end])) ++end;
+
+            size_t width_start = end;
+            while (end < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[end]))) ++end;
+
+            if (end - width_start > 2 || end >= pattern.size() || (pattern[end] != 'd' && pattern[end] != 'i')) {
+                throw std::runtime_error("Output pattern must hold one integer conversion such as %04d: " + pattern);
+            }
+
+            if (converted) {
+                throw std::runtime_error("Output pattern holds more than one conversion: " + pattern);
+            }
+
+            char number[128];
+            snprintf(number, sizeof(number), pattern.substr(i, end + 1 - i).c_str(), frame);
+            name += number;
+
+            converted = true;
+            i = end;
+        }
+
+        if (!converted) {
+            throw std::runtime_error("Output pattern has no conversion for the frame number: " + pattern);
+        }
+
+        return name;
+    }
+}
+
+ThreeDL::CameraKey::CameraKey(double time, const Vec3& position, const Vec3& rotation)
+    : time_(time),
+      position_(position),
+      rotation_(rotation)
+{}
+
+void ThreeDL::CameraPath::add_key(double time, const Vec3& position, const Vec3& rotation) {
+    auto after = std::upper_bound(keys_.begin(), keys_.end(), time, [](double t, const CameraKey& key) {
+        return t < key.time_;
+    });
+
+    keys_.insert(after, CameraKey(time, position, rotation));
+}
+
+double ThreeDL::CameraPath::start() const {
+    return keys_.empty() ? 0 : keys_.front().time_;
+}
+
+double ThreeDL::CameraPath::end() const {
+    return keys_.empty() ? 0 : keys_.back().time_;
+}
+
+ThreeDL::Camera ThreeDL::CameraPath::at(double time) const {
+    if (keys_.empty()) {
+        return Camera({0, 0, 0}, {0, 0, 0});
+    }
+
+    if (time <= keys_.front().time_) return Camera(keys_.front().position_, keys_.front().rotation_);
+    if (time >= keys_.back().time_) return Camera(keys_.back().position_, keys_.back().rotation_);
+
+    size_t i = 1;
+    while (keys_[i].time_ < time) ++i;
+
+    const CameraKey& a = keys_[i - 1];
+    const CameraKey& b = keys_[i];
+    const Vec3& before = (i >= 2) ? keys_[i - 2].position_ : a.position_;
+    const Vec3& after = (i + 1 < keys_.size()) ? keys_[i + 1].position_ : b.position_;
+
+    double span = b.time_ - a.time_;
+    double t = (span > 0) ? (time - a.time_) / span : 0;
+    double t2 = t * t;
+    double t3 = t2 * t;
+
+    Vec3 position = (
+        a.position_ * 2 +
+        (b.position_ - before) * t +
+        (before * 2 - a.position_ * 5 + b.position_ * 4 - after) * t2 +
+        (a.position_ * 3 - before - b.position_ * 3 + after) * t3
+    ) * 0.5;
+
+    Vec3 rotation = a.rotation_ + (b.rotation_ - a.rotation_) * t;
+
+    return Camera(position, rotation);
+}
+
+ThreeDL::FrameWriter::FrameWriter(int width, int height, size_t max_queued)
+    : width_(width),
+      height_(height),
+      max_queued_(max_queued),
+      thread_(&FrameWriter::run, this)
+{}
+
+void ThreeDL::FrameWriter::push(const std::string& filename, const std::vector<Uint32>& pixels) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return queue_.size() < max_queued_; });
+
+    queue_.emplace_back(filename, pixels);
+    changed_.notify_all();
+}
+
+void ThreeDL::FrameWriter::finish() {
+    stop();
+
+    if (!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+}
+
+void ThreeDL::FrameWriter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+    }
+
+    changed_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void ThreeDL::FrameWriter::run() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] { return finished_ || !queue_.empty(); });
+
+        if (queue_.empty()) return;
+
+        auto [filename, pixels] = std::move(queue_.front());
+        queue_.pop_front();
+        changed_.notify_all();
+
+        lock.unlock();
+
+        try {
+            save_frame(filename, pixels, width_, height_);
+        } catch (const std::exception& e) {
+            // reported by finish() on the rendering thread, keep draining so push never blocks forever
+            if (error_.empty()) error_ = e.what();
+        }
+    }
+}
+
+ThreeDL::FrameWriter::~FrameWriter() {
+    stop();
+}
+
+ThreeDL::OfflineRenderer::OfflineRenderer(int width, int height, int thread_count)
+    : width_(width),
+      height_(height),
+      thread_count_(thread_count > 0 ? thread_count : jobs().thread_count())
+{}
+
+void ThreeDL::OfflineRenderer::add(Object* object) {
+    objects_.push_back(object);
+}
+
+void ThreeDL::OfflineRenderer::render(const CameraPath& path, int frame_count, const std::string& output_pattern) {
+    // a bad pattern fails here rather than on a worker after frames were drawn
+    frame_name(output_pattern, 0);
+
+    std::atomic<int> next_frame = 0;
+
+    // two frames in flight per worker keeps every core busy while the disk catches up
+    FrameWriter writer(width_, height_, thread_count_ * 2);
+
+    // workers on threads of their own, as pool jobs a worker waiting on its frame's jobs could steal another
+    // worker and render that one's frames to the end before its own
+    std::vector<std::thread> workers;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    for (int i = 0; i < thread_count_; ++i) {
+        workers.emplace_back([&] {
+            try {
+                render_worker(path, frame_count, output_pattern, next_frame, writer);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+
+                // the others stop after the frame they are on
+                next_frame = frame_count;
+            }
+        });
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    writer.finish();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreeDL::OfflineRenderer::render_worker(const CameraPath& path, int frame_count, const std::string& output_pattern, std::atomic<int>& next_frame, FrameWriter& writer) {
+    Camera camera = path.at(path.start());
+    Renderer renderer(camera, width_, height_);
+
+    for (auto* object : objects_) {
+        renderer.add(object);
+    }
+
+    if (setup_) {
+        setup_(renderer);
+    }
+
+    for (int frame = next_frame++; frame < frame_count; frame = next_frame++) {
+        double t = (frame_count > 1) ? static_cast<double>(frame) / (frame_count - 1) : 0;
+        Camera key = path.at(path.start() + t * (path.end() - path.start()));
+
+        camera.position_ = key.position_;
+        camera.rotation_ = key.rotation_;
+        camera.calculate_dirs();
+
+        renderer.render_frame();
+
+        writer.push(frame_name(output_pattern, frame), renderer.frame());
+    }
+}
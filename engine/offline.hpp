@@ -0,0 +1,112 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera.hpp"
+#include "capture.hpp"
+#include "jobs.hpp"
+#include "objects.hpp"
+#include "rendering.hpp"
+
+namespace ThreeDL {
+    class CameraKey {
+        public:
+            CameraKey(double time, const Vec3& position, const Vec3& rotation);
+            CameraKey() = delete;
+
+            double time_;
+            Vec3 position_;
+            Vec3 rotation_;
+
+            ~CameraKey() = default;
+    };
+
+    // keyframed camera, Catmull-Rom through the positions and linear between rotations
+    class CameraPath {
+        public:
+            CameraPath() = default;
+
+            void add_key(double time, const Vec3& position, const Vec3& rotation);
+            Camera at(double time) const;
+
+            double start() const;
+            double end() const;
+
+            ~CameraPath() = default;
+        private:
+            std::vector<CameraKey> keys_;
+    };
+
+    // saves frames on a background thread, push blocks once max_queued frames are waiting
+    class FrameWriter {
+        public:
+            FrameWriter(int width, int height, size_t max_queued);
+            FrameWriter() = delete;
+
+            void push(const std::string& filename, const std::vector<Uint32>& pixels);
+            // waits for every queued frame, throws if any failed to save
+            void finish();
+
+            ~FrameWriter();
+        private:
+            int width_;
+            int height_;
+            size_t max_queued_;
+
+            std::deque<std::pair<std::string, std::vector<Uint32>>> queue_;
+            std::mutex mutex_;
+            std::condition_variable changed_;
+            bool finished_ = false;
+            std::string error_;
+
+            std::thread thread_;
+
+            void run();
+            void stop();
+    };
+
+    // renders a camera path to an image sequence, one headless Renderer per worker thread, each taking the next
+    // frame as it finishes one and sharing the job system for the work inside a frame
+    class OfflineRenderer {
+        public:
+            OfflineRenderer(int width, int height, int thread_count = 0);
+            OfflineRenderer() = delete;
+
+            // objects are only read while rendering and shared by every worker
+            void add(Object* object);
+
+            // called on each worker's renderer before its first frame, for lights, modes etc.
+            void set_setup(const std::function<void(Renderer&)>& setup) {
+                setup_ = setup;
+            }
+
+            // output_pattern is printf style with one integer for the frame number, eg. "frames/%04d.bmp",
+            // any other conversion throws before a frame is drawn
+            void render(const CameraPath& path, int frame_count, const std::string& output_pattern);
+
+            ~OfflineRenderer() = default;
+        private:
+            int width_;
+            int height_;
+            int thread_count_;
+
+            std::vector<Object*> objects_;
+            std::function<void(Renderer&)> setup_;
+
+            void render_worker(const CameraPath& path, int frame_count, const std::string& output_pattern, std::atomic<int>& next_frame, FrameWriter& writer);
+    };
+};
@@ -0,0 +1,342 @@
+#include "optimise.hpp"
+
+namespace {
+    constexpr int forsyth_cache_size = 32;
+
+    // weights from Forsyth's "Linear-Speed Vertex Cache Optimisation"
+    constexpr double cache_decay_power = 1.5;
+    constexpr double last_triangle_score = 0.75;
+    constexpr double valence_boost_scale = 2.0;
+    constexpr double valence_boost_power = 0.5;
+
+    double vertex_score(int cache_position, uint32_t remaining) {
+        if (remaining == 0) return -1;
+
+        double score = 0;
+
+        if (cache_position >= 0) {
+            if (cache_position < 3) {
+                // the triangle just drawn, favoured slightly less so strips do not win outright
+                score = last_triangle_score;
+            } else {
+                double scale = 1.0 / (forsyth_cache_size - 3);
+                score = std::pow(1 - (cache_position - 3) * scale, cache_decay_power);
+            }
+        }
+
+        // finishing off vertices with few triangles left frees cache slots sooner
+        return score + valence_boost_scale * std::pow(static_cast<double>(remaining), -valence_boost_power);
+    }
+
+    // every GSPTriangle owns three heap blocks of three elements each, as Mesh::memory_bytes counts them
+    size_t triangle_bytes(const std::vector<ThreeDL::GSPTriangle>& triangles) {
+        return triangles.capacity() * sizeof(ThreeDL::GSPTriangle) + triangles.size() * 3 * (2 * sizeof(ThreeDL::Vec3) + sizeof(ThreeDL::Vec2));
+    }
+}
+
+ThreeDL::IndexedMesh ThreeDL::weld_vertices(const std::vector<GSPTriangle>& triangles) {
+    IndexedMesh mesh;
+    mesh.indices_.reserve(triangles.size() * 3);
+
+    std::unordered_map<BitwiseKey<8>, uint32_t, BitwiseKeyHash<8>> welded;
+    welded.reserve(triangles.size() * 3);
+
+    for (const auto& triangle : triangles) {
+        for (int v = 0; v < 3; ++v) {
+            const Vec3& p = triangle.vertices_[v];
+            const Vec2& uv = triangle.uvs_[v];
+            const Vec3& n = triangle.normals_[v];
+
+            BitwiseKey<8> key = {{p.x, p.y, p.z, uv.x, uv.y, n.x, n.y, n.z}};
+            auto [it, inserted] = welded.try_emplace(key, static_cast<uint32_t>(mesh.positions_.size()));
+
+            if (inserted) {
+                mesh.positions_.push_back(p);
+                mesh.uvs_.push_back(uv);
+                mesh.normals_.push_back(n);
+            }
+
+            mesh.indices_.push_back(it->second);
+        }
+    }
+
+    return mesh;
+}
+
+std::vector<ThreeDL::GSPTriangle> ThreeDL::expand_triangles(const IndexedMesh& mesh) {
+    std::vector<GSPTriangle> triangles(mesh.indices_.size() / 3);
+
+    for (size_t t = 0; t < triangles.size(); ++t) {
+        for (int v = 0; v < 3; ++v) {
+            uint32_t index = mesh.indices_[t * 3 + v];
+
+            triangles[t].vertices_[v] = mesh.positions_[index];
+            triangles[t].uvs_[v] = mesh.uvs_[index];
+            triangles[t].normals_[v] = mesh.normals_[index];
+        }
+    }
+
+    return triangles;
+}
+
+double ThreeDL::average_cache_miss_ratio(const std::vector<uint32_t>& indices, size_t vertex_count, int cache_size) {
+    if (indices.size() < 3) return 0;
+
+    // a vertex is cached while fewer than cache_size misses have happened since it was loaded
+    std::vector<size_t> loaded_at(vertex_count, 0);
+    size_t misses = 0;
+
+    for (uint32_t index : indices) {
+        if (loaded_at[index] == 0 || misses - loaded_at[index] >= static_cast<size_t>(cache_size)) {
+            ++misses;
+            loaded_at[index] = misses;
+        }
+    }
+
+    return static_cast<double>(misses) / (indices.size() / 3);
+}
+
+void ThreeDL::optimise_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count) {
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) return;
+
+    // triangles using each vertex, packed as offsets into one array
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    for (uint32_t index : indices) ++remaining[index];
+
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; ++v) offsets[v + 1] = offsets[v] + remaining[v];
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+
+    for (size_t t = 0; t < triangle_count; ++t) {
+        for (int v = 0; v < 3; ++v) {
+            adjacency[filled[indices[t * 3 + v]]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    std::vector<double> score(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v) score[v] = vertex_score(-1, remaining[v]);
+
+    std::vector<double> triangle_score(triangle_count);
+    for (size_t t = 0; t < triangle_count; ++t) {
+        triangle_score[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+
+    // most recently used first, up to three past the end before evicting
+    std::vector<uint32_t> cache, next_cache, evicted;
+    cache.reserve(forsyth_cache_size + 3);
+    next_cache.reserve(forsyth_cache_size + 3);
+
+    size_t scan = 0;
+    int64_t best = -1;
+
+    for (size_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count) {
+        if (best < 0) {
+            // nothing in the cache is worth drawing, start again from the next triangle in file order
+            while (emitted[scan]) ++scan;
+            best = static_cast<int64_t>(scan);
+        }
+
+        const uint32_t* triangle = &indices[best * 3];
+        output.insert(output.end(), triangle, triangle + 3);
+        emitted[best] = true;
+
+        // drop the triangle from its vertices' adjacency
+        for (int v = 0; v < 3; ++v) {
+            uint32_t vertex = triangle[v];
+            uint32_t* first = &adjacency[offsets[vertex]];
+            uint32_t* last = first + remaining[vertex];
+
+            *std::find(first, last, static_cast<uint32_t>(best)) = *(last - 1);
+            --remaining[vertex];
+        }
+
+        next_cache.assign(triangle, triangle + 3);
+        for (uint32_t vertex : cache) {
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+                next_cache.push_back(vertex);
+            }
+        }
+        std::swap(cache, next_cache);
+
+        // anything pushed past the end is evicted and only keeps its valence score
+        evicted.clear();
+        if (cache.size() > forsyth_cache_size) {
+            evicted.assign(cache.begin() + forsyth_cache_size, cache.end());
+            cache.resize(forsyth_cache_size);
+        }
+
+        for (uint32_t vertex : evicted) {
+            score[vertex] = vertex_score(-1, remaining[vertex]);
+        }
+
+        for (size_t i = 0; i < cache.size(); ++i) {
+            score[cache[i]] = vertex_score(static_cast<int>(i), remaining[cache[i]]);
+        }
+
+        // rescore the triangles whose vertices moved and pick the best of them
+        best = -1;
+        double best_score = -1;
+
+        auto rescore = [&](uint32_t vertex, bool candidate) {
+            for (uint32_t a = offsets[vertex]; a < offsets[vertex] + remaining[vertex]; ++a) {
+                uint32_t t = adjacency[a];
+                triangle_score[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+                if (candidate && triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        };
+
+        for (uint32_t vertex : evicted) rescore(vertex, false);
+        for (uint32_t vertex : cache) rescore(vertex, true);
+    }
+
+    indices.swap(output);
+}
+
+void ThreeDL::optimise_overdraw(std::vector<uint32_t>& indices, const std::vector<Vec3>& positions, double threshold) {
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) return;
+
+    double acmr_before = average_cache_miss_ratio(indices, positions.size());
+
+    // a run starts wherever the FIFO would miss on all three vertices, moving whole runs keeps their reuse
+    std::vector<size_t> loaded_at(positions.size(), 0);
+    std::vector<uint32_t> run_starts;
+    size_t misses = 0;
+
+    for (size_t t = 0; t < triangle_count; ++t) {
+        int triangle_misses = 0;
+
+        for (int v = 0; v < 3; ++v) {
+            uint32_t index = indices[t * 3 + v];
+
+            if (loaded_at[index] == 0 || misses - loaded_at[index] >= static_cast<size_t>(forsyth_cache_size)) {
+                ++misses;
+                ++triangle_misses;
+                loaded_at[index] = misses;
+            }
+        }
+
+        if (triangle_misses == 3 || t == 0) run_starts.push_back(static_cast<uint32_t>(t));
+    }
+
+    run_starts.push_back(static_cast<uint32_t>(triangle_count));
+
+    Vec3 mesh_centre = {0, 0, 0};
+    for (const auto& position : positions) mesh_centre = mesh_centre + position;
+    mesh_centre = mesh_centre / static_cast<double>(std::max<size_t>(positions.size(), 1));
+
+    // runs facing away from the middle of the mesh are likely to cover the rest, so they draw first
+    std::vector<std::pair<double, uint32_t>> order;
+    order.reserve(run_starts.size() - 1);
+
+    for (size_t r = 0; r + 1 < run_starts.size(); ++r) {
+        Vec3 centre = {0, 0, 0};
+        Vec3 normal = {0, 0, 0};
+        double area = 0;
+
+        for (uint32_t t = run_starts[r]; t < run_starts[r + 1]; ++t) {
+            const Vec3& a = positions[indices[t * 3]];
+            const Vec3& b = positions[indices[t * 3 + 1]];
+            const Vec3& c = positions[indices[t * 3 + 2]];
+
+            Vec3 weighted_normal = (b - a).cross(c - a);
+            double weight = weighted_normal.mag();
+
+            centre = centre + (a + b + c) * (weight / 3);
+            normal = normal + weighted_normal;
+            area += weight;
+        }
+
+        double score = 0;
+
+        if (area > 0) {
+            centre = centre / area;
+            score = (centre - mesh_centre).dot(normal / area);
+        }
+
+        order.emplace_back(-score, static_cast<uint32_t>(r));
+    }
+
+    std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+
+    for (const auto& [score, run] : order) {
+        output.insert(output.end(), indices.begin() + run_starts[run] * 3, indices.begin() + run_starts[run + 1] * 3);
+    }
+
+    if (average_cache_miss_ratio(output, positions.size()) <= acmr_before * threshold) {
+        indices.swap(output);
+    }
+}
+
+ThreeDL::MeshOptimisationStats ThreeDL::optimise_triangles(std::vector<GSPTriangle>& triangles, bool overdraw, size_t group_size) {
+    MeshOptimisationStats stats;
+    stats.triangles_ = triangles.size();
+    stats.vertices_before_ = triangles.size() * 3;
+    stats.bytes_before_ = triangle_bytes(triangles);
+
+    IndexedMesh mesh = weld_vertices(triangles);
+    stats.vertices_after_ = mesh.vertex_count();
+    stats.acmr_before_ = average_cache_miss_ratio(mesh.indices_, mesh.vertex_count());
+
+    // each group renumbered from 0 so the passes only size their tables by the vertices it uses
+    constexpr uint32_t unused = UINT32_MAX;
+    std::vector<uint32_t> local(mesh.vertex_count(), unused);
+    std::vector<uint32_t> global;
+    std::vector<Vec3> positions;
+    std::vector<uint32_t> indices;
+
+    size_t group = group_size > 0 ? group_size : triangles.size();
+
+    for (size_t first = 0; first < triangles.size(); first += group) {
+        size_t end = std::min(first + group, triangles.size()) * 3;
+        global.clear();
+        positions.clear();
+        indices.clear();
+
+        for (size_t i = first * 3; i < end; ++i) {
+            uint32_t vertex = mesh.indices_[i];
+
+            if (local[vertex] == unused) {
+                local[vertex] = static_cast<uint32_t>(global.size());
+                global.push_back(vertex);
+                positions.push_back(mesh.positions_[vertex]);
+            }
+
+            indices.push_back(local[vertex]);
+        }
+
+        optimise_vertex_cache(indices, global.size());
+        if (overdraw) optimise_overdraw(indices, positions);
+
+        for (size_t i = first * 3; i < end; ++i) {
+            mesh.indices_[i] = global[indices[i - first * 3]];
+        }
+
+        for (uint32_t vertex : global) {
+            local[vertex] = unused;
+        }
+    }
+
+    stats.acmr_after_ = average_cache_miss_ratio(mesh.indices_, mesh.vertex_count());
+
+    triangles = expand_triangles(mesh);
+    stats.bytes_after_ = triangle_bytes(triangles);
+
+    return stats;
+}
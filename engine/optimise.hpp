@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // triangles sharing welded vertices, three indices per triangle
+    class IndexedMesh {
+        public:
+            std::vector<Vec3> positions_;
+            std::vector<Vec2> uvs_;
+            std::vector<Vec3> normals_;
+            std::vector<uint32_t> indices_;
+
+            size_t vertex_count() const {
+                return positions_.size();
+            }
+    };
+
+    // merges vertices whose position, uv and normal are bit for bit identical
+    IndexedMesh weld_vertices(const std::vector<GSPTriangle>& triangles);
+    std::vector<GSPTriangle> expand_triangles(const IndexedMesh& mesh);
+
+    // average vertices transformed per triangle through a FIFO post transform cache, 0.5 is ideal, 3 is no reuse
+    double average_cache_miss_ratio(const std::vector<uint32_t>& indices, size_t vertex_count, int cache_size = 32);
+
+    // Forsyth's linear speed vertex cache optimisation, reorders triangles only
+    void optimise_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count);
+
+    // moves runs of triangles that start on a cold cache so the most outward facing runs draw first,
+    // undone if the miss ratio grows past threshold times what it was
+    void optimise_overdraw(std::vector<uint32_t>& indices, const std::vector<Vec3>& positions, double threshold = 1.05);
+
+    class MeshOptimisationStats {
+        public:
+            size_t triangles_ = 0;
+            size_t vertices_before_ = 0; // three per triangle
+            size_t vertices_after_ = 0;
+            double acmr_before_ = 0;
+            double acmr_after_ = 0;
+            size_t bytes_before_ = 0;    // GSPTriangle storage, as Mesh::memory_bytes counts it
+            size_t bytes_after_ = 0;
+    };
+
+    // welds, reorders the triangles within each consecutive run of group_size of them, or all of them when it
+    // is 0, and writes them back in their new order with identical values, the welded vertices are only
+    // used to find the order as triangles are stored and drawn unindexed
+    MeshOptimisationStats optimise_triangles(std::vector<GSPTriangle>& triangles, bool overdraw, size_t group_size = 0);
+};
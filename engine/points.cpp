@@ -0,0 +1,282 @@
+#include "points.hpp"
+
+namespace {
+    Uint32 pack_rgb(double r, double g, double b) {
+        auto channel = [](double value) {
+            return static_cast<Uint32>(std::clamp(value, 0.0, 255.0));
+        };
+
+        return 0xff000000 | (channel(r) << 16) | (channel(g) << 8) | channel(b);
+    }
+
+    // one scalar property of a ply element, offset_ is into a binary row
+    class PlyProperty {
+        public:
+            std::string name_;
+            std::string type_;
+            size_t size_ = 0;
+            size_t offset_ = 0;
+            bool list_ = false;
+    };
+
+    class PlyElement {
+        public:
+            std::string name_;
+            size_t count_ = 0;
+            size_t row_bytes_ = 0;
+            std::vector<PlyProperty> properties_;
+    };
+
+    size_t ply_type_size(const std::string& type, const std::string& filename) {
+        if (type == "char" || type == "uchar" || type == "int8" || type == "uint8") return 1;
+        if (type == "short" || type == "ushort" || type == "int16" || type == "uint16") return 2;
+        if (type == "int" || type == "uint" || type == "int32" || type == "uint32") return 4;
+        if (type == "float" || type == "float32") return 4;
+        if (type == "double" || type == "float64") return 8;
+
+        // a guessed size would misread every binary row after it
+        throw std::runtime_error("Unknown PLY property type in " + filename + ": " + type);
+    }
+
+    double ply_value(const char* bytes, const std::string& type) {
+        auto read = [bytes](auto value) {
+            std::memcpy(&value, bytes, sizeof(value));
+            return static_cast<double>(value);
+        };
+
+        if (type == "char" || type == "int8") return read(int8_t{});
+        if (type == "uchar" || type == "uint8") return read(uint8_t{});
+        if (type == "short" || type == "int16") return read(int16_t{});
+        if (type == "ushort" || type == "uint16") return read(uint16_t{});
+        if (type == "int" || type == "int32") return read(int32_t{});
+        if (type == "uint" || type == "uint32") return read(uint32_t{});
+        if (type == "float" || type == "float32") return read(float{});
+
+        return read(double{});
+    }
+
+    // colours stored as floats are 0-1, integer ones 0-255
+    double ply_channel(double value, const std::string& type) {
+        return (type.find("float") != std::string::npos || type == "double") ? value * 255 : value;
+    }
+}
+
+ThreeDL::PointCloud::PointCloud(std::vector<Vec3> positions, std::vector<Uint32> colors)
+    : positions_(std::move(positions)),
+      colors_(std::move(colors))
+{
+    if (colors_.size() != positions_.size()) {
+        throw std::runtime_error("Point cloud needs one colour per point");
+    }
+
+    build_bounds();
+}
+
+void ThreeDL::PointCloud::build_bounds() {
+    if (positions_.empty()) return;
+
+    Vec3 min = positions_[0];
+    Vec3 max = min;
+
+    for (const auto& position : positions_) {
+        min = {std::min(min.x, position.x), std::min(min.y, position.y), std::min(min.z, position.z)};
+        max = {std::max(max.x, position.x), std::max(max.y, position.y), std::max(max.z, position.z)};
+    }
+
+    centre_ = (min + max) / 2;
+    radius_ = (max - min).mag() / 2;
+}
+
+ThreeDL::PointCloud ThreeDL::load_xyz(const std::string& filename, const SDL_Color& color) {
+    std::ifstream file(filename);
+
+    if (!file) {
+        throw std::runtime_error("Could not open point file: " + filename);
+    }
+
+    std::vector<Vec3> positions;
+    std::vector<Uint32> colors;
+    Uint32 fallback = pack_rgb(color.r, color.g, color.b);
+
+    std::string line;
+
+    while (std::getline(file, line)) {
+        const char* cursor = line.c_str();
+        double values[6];
+        int count = 0;
+
+        // strtod rather than streams, files run to tens of millions of lines
+        for (; count < 6; ++count) {
+            char* end;
+            values[count] = std::strtod(cursor, &end);
+            if (end == cursor) break;
+            cursor = end;
+        }
+
+        if (count == 0) continue;
+
+        if (count < 3) {
+            throw std::runtime_error("Bad point in " + filename + ": " + line);
+        }
+
+        positions.push_back({values[0], values[1], values[2]});
+        colors.push_back(count >= 6 ? pack_rgb(values[3], values[4], values[5]) : fallback);
+    }
+
+    return {std::move(positions), std::move(colors)};
+}
+
+ThreeDL::PointCloud ThreeDL::load_ply(const std::string& filename, const SDL_Color& color) {
+    std::ifstream file(filename, std::ios::binary);
+
+    if (!file) {
+        throw std::runtime_error("Could not open point file: " + filename);
+    }
+
+    std::string line;
+    std::getline(file, line);
+
+    if (line.rfind("ply", 0) != 0) {
+        throw std::runtime_error("Not a PLY file: " + filename);
+    }
+
+    bool binary = false;
+    std::vector<PlyElement> elements;
+
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line == "end_header") break;
+
+        std::vector<std::string> words = split(line, ' ');
+        if (words.empty()) continue;
+
+        if (words[0] == "format") {
+            if (words.size() < 2 || (words[1] != "ascii" && words[1] != "binary_little_endian")) {
+                throw std::runtime_error("Unsupported PLY format in " + filename + ": " + line);
+            }
+
+            binary = words[1] == "binary_little_endian";
+        } else if (words[0] == "element" && words.size() >= 3) {
+            PlyElement element;
+            element.name_ = words[1];
+            element.count_ = std::stoull(words[2]);
+            elements.push_back(element);
+        } else if (words[0] == "property" && !elements.empty()) {
+            PlyElement& element = elements.back();
+            PlyProperty property;
+
+            if (words.size() >= 5 && words[1] == "list") {
+                // checked only, rows with lists are never stepped over by size
+                ply_type_size(words[2], filename);
+                ply_type_size(words[3], filename);
+                property = {words[4], words[3], 0, 0, true};
+            } else if (words.size() >= 3) {
+                property = {words[2], words[1], ply_type_size(words[1], filename), element.row_bytes_, false};
+                element.row_bytes_ += property.size_;
+            }
+
+            element.properties_.push_back(property);
+        }
+    }
+
+    if (!file) {
+        throw std::runtime_error("PLY header is truncated: " + filename);
+    }
+
+    std::vector<Vec3> positions;
+    std::vector<Uint32> colors;
+    Uint32 fallback = pack_rgb(color.r, color.g, color.b);
+
+    for (const PlyElement& element : elements) {
+        bool has_list = std::any_of(element.properties_.begin(), element.properties_.end(), [](const PlyProperty& p) {
+            return p.list_;
+        });
+
+        if (element.name_ != "vertex") {
+            // only fixed size rows can be stepped over in a binary file, faces usually come after the vertices anyway
+            if (binary && has_list) {
+                throw std::runtime_error("PLY elements with lists before the vertices are not supported: " + filename);
+            }
+
+            if (binary) {
+                file.seekg(element.count_ * element.row_bytes_, std::ios::cur);
+            } else {
+                for (size_t i = 0; i < element.count_ && std::getline(file, line); ++i) {}
+            }
+
+            continue;
+        }
+
+        if (has_list) {
+            throw std::runtime_error("PLY vertices with list properties are not supported: " + filename);
+        }
+
+        // property index of x, y, z, red, green, blue, -1 when missing
+        int fields[6] = {-1, -1, -1, -1, -1, -1};
+        const char* names[6] = {"x", "y", "z", "red", "green", "blue"};
+
+        for (int f = 0; f < 6; ++f) {
+            for (size_t p = 0; p < element.properties_.size(); ++p) {
+                if (element.properties_[p].name_ == names[f]) fields[f] = static_cast<int>(p);
+            }
+        }
+
+        if (fields[0] < 0 || fields[1] < 0 || fields[2] < 0) {
+            throw std::runtime_error("PLY vertices have no position: " + filename);
+        }
+
+        bool colored = fields[3] >= 0 && fields[4] >= 0 && fields[5] >= 0;
+
+        positions.reserve(element.count_);
+        colors.reserve(element.count_);
+
+        std::vector<char> row(element.row_bytes_);
+        std::vector<double> values(element.properties_.size());
+
+        for (size_t i = 0; i < element.count_; ++i) {
+            if (binary) {
+                if (!file.read(row.data(), row.size())) break;
+
+                for (size_t p = 0; p < values.size(); ++p) {
+                    values[p] = ply_value(&row[element.properties_[p].offset_], element.properties_[p].type_);
+                }
+            } else {
+                if (!std::getline(file, line)) break;
+
+                const char* cursor = line.c_str();
+
+                for (double& value : values) {
+                    char* end;
+                    value = std::strtod(cursor, &end);
+                    cursor = end;
+                }
+            }
+
+            positions.push_back({values[fields[0]], values[fields[1]], values[fields[2]]});
+
+            if (colored) {
+                colors.push_back(pack_rgb(
+                    ply_channel(values[fields[3]], element.properties_[fields[3]].type_),
+                    ply_channel(values[fields[4]], element.properties_[fields[4]].type_),
+                    ply_channel(values[fields[5]], element.properties_[fields[5]].type_)
+                ));
+            } else {
+                colors.push_back(fallback);
+            }
+        }
+
+        if (positions.size() != element.count_) {
+            throw std::runtime_error("PLY file is truncated: " + filename);
+        }
+
+        break;
+    }
+
+    return {std::move(positions), std::move(colors)};
+}
+
+ThreeDL::PointCloud ThreeDL::load_points(const std::string& filename, const SDL_Color& color) {
+    bool ply = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".ply") == 0;
+
+    return ply ? load_ply(filename, color) : load_xyz(filename, color);
+}
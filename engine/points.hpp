@@ -0,0 +1,47 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // world space points, drawn as splats straight into the frame rather than as geometry
+    class PointCloud {
+        public:
+            PointCloud(std::vector<Vec3> positions, std::vector<Uint32> colors);
+            PointCloud() = delete;
+
+            std::vector<Vec3> positions_;
+            // one per point, packed as pack_color does
+            std::vector<Uint32> colors_;
+
+            // bounding sphere
+            Vec3 centre_ = {0, 0, 0};
+            double radius_ = 0;
+
+            size_t size() const {
+                return positions_.size();
+            }
+
+            ~PointCloud() = default;
+        private:
+            void build_bounds();
+    };
+
+    // "x y z" or "x y z r g b" per line, channels 0-255, # starts a comment, color is for points without one
+    PointCloud load_xyz(const std::string& filename, const SDL_Color& color);
+    // ascii or binary little endian, vertex x, y, z and optionally red, green, blue, other elements are ignored
+    PointCloud load_ply(const std::string& filename, const SDL_Color& color);
+    // by extension, .ply or anything else as .xyz
+    PointCloud load_points(const std::string& filename, const SDL_Color& color);
+};
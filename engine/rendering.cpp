@@ -1,16 +1,105 @@
 #include "rendering.hpp"
 
+namespace {
+    // top to bottom, moved the other way to move where in each pixel it is sampled
+    std::array<ThreeDL::Vec2, 3> sorted_corners(const ThreeDL::SSPTriangle& triangle, double sample_x, double sample_y) {
+        std::array<ThreeDL::Vec2, 3> corners = {triangle.vertices_[0], triangle.vertices_[1], triangle.vertices_[2]};
+
+        for (ThreeDL::Vec2& corner : corners) {
+            corner.x -= sample_x;
+            corner.y -= sample_y;
+        }
+
+        std::sort(corners.begin(), corners.end(), [](const ThreeDL::Vec2& a, const ThreeDL::Vec2& b) {
+            return a.y > b.y;
+        });
+
+        return corners;
+    }
+}
+
+ThreeDL::VisibleTriangle::VisibleTriangle(const GSPTriangle& triangle, SDL_Surface* texture, uint32_t object_id, uint32_t triangle_id)
+    : triangle_(triangle),
+      texture_(texture),
+      object_id_(object_id),
+      triangle_id_(triangle_id)
+{
+    // Moller-Trumbore from the eye, with every term that does not depend on the ray hoisted out
+    Vec3 edge_one = triangle_.vertices_[1] - triangle_.vertices_[0];
+    Vec3 edge_two = triangle_.vertices_[2] - triangle_.vertices_[0];
+    Vec3 to_origin = triangle_.vertices_[0] * -1;
+
+    det_ = edge_two.cross(edge_one);
+    b1_ = edge_two.cross(to_origin);
+    b2_ = to_origin.cross(edge_one);
+}
+
+Uint32 ThreeDL::pack_color(const SDL_Color& color) {
+    return (static_cast<Uint32>(color.a) << 24) |
+           (static_cast<Uint32>(color.r) << 16) |
+           (static_cast<Uint32>(color.g) << 8) |
+            static_cast<Uint32>(color.b);
+}
+
 ThreeDL::Renderer::Renderer(SDL_Renderer* renderer, SDL_Window* window, Camera& camera, int width, int height)
     : renderer_(renderer),
       window_(window),
       camera_(camera),
       width_(width),
       height_(height),
-      zbuffer_(width * height)
+      render_width_(width),
+      render_height_(height),
+      zbuffer_(width, height),
+      framebuffer_(width * height),
+      vbuffer_(width * height, 0),
+      span_pass_(width)
+{
+    frame_texture_ = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width_, height_);
+}
+
+ThreeDL::Renderer::Renderer(Camera& camera, int width, int height)
+    : renderer_(nullptr),
+      window_(nullptr),
+      camera_(camera),
+      width_(width),
+      height_(height),
+      render_width_(width),
+      render_height_(height),
+      zbuffer_(width, height),
+      framebuffer_(width * height),
+      owns_textures_(false),
+      vbuffer_(width * height, 0),
+      span_pass_(width)
 {}
 
 void ThreeDL::Renderer::add(Object* object) {
     render_queue_.push_back(object);
+    redraw_all_ = true;
+}
+
+void ThreeDL::Renderer::add(StreamedScene* scene) {
+    streamed_scenes_.push_back(scene);
+    redraw_all_ = true;
+}
+
+void ThreeDL::Renderer::add(Terrain* terrain) {
+    terrains_.push_back(terrain);
+    redraw_all_ = true;
+}
+
+void ThreeDL::Renderer::add(PointCloud* cloud) {
+    point_clouds_.push_back(cloud);
+    redraw_all_ = true;
+}
+
+void ThreeDL::Renderer::add_light(const DirectionalLight& light) {
+    lighting_.directional_lights_.push_back(light);
+    redraw_all_ = true;
+}
+
+void ThreeDL::Renderer::add_light(const PointLight& light) {
+    lighting_.point_lights_.push_back(light);
+    redraw_all_ = true;
 }
 
 void ThreeDL::Renderer::main_loop() {
@@ -18,6 +107,14 @@ void ThreeDL::Renderer::main_loop() {
     render();
 }
 
+void ThreeDL::Renderer::render_frame() {
+    render();
+}
+
+const std::vector<Uint32>& ThreeDL::Renderer::frame() const {
+    return (render_width_ != width_ || render_height_ != height_) ? output_buffer_ : framebuffer_;
+}
+
 ////// DEBUG //////
 
 void ThreeDL::Renderer::track_keys(const SDL_Event& event) {
@@ -52,317 +149,2278 @@ void ThreeDL::Renderer::process_keys() {
 ////// END DEBUG //////
 
 void ThreeDL::Renderer::putpixel(int x, int y, const SDL_Color& color) {
-    SDL_SetRenderDrawColor(renderer_, color.r, color.g, color.b, color.a);
-    SDL_RenderDrawPoint(renderer_, x, y);
+    framebuffer_[y * render_width_ + x] = pack_color(color);
 }
 
 void ThreeDL::Renderer::clear(const SDL_Color& color) {
-    SDL_SetRenderDrawColor(renderer_, color.r, color.g, color.b, color.a);
-    SDL_RenderClear(renderer_);
+    kernels_->fill_pixels(framebuffer_.data(), framebuffer_.size(), pack_color(color));
+}
+
+void ThreeDL::Renderer::present() {
+    const std::vector<Uint32>* output = &framebuffer_;
+
+    if (render_width_ != width_ || render_height_ != height_) {
+        output_buffer_.resize(width_ * height_);
+        upscaler_.upscale(framebuffer_, render_width_, render_height_, output_buffer_, width_, height_);
+        output = &output_buffer_;
+    }
+
+    if (renderer_ == nullptr) return;
+
+    SDL_UpdateTexture(frame_texture_, nullptr, output->data(), width_ * sizeof(Uint32));
+    SDL_RenderCopy(renderer_, frame_texture_, nullptr, nullptr);
+    SDL_RenderPresent(renderer_);
+}
+
+void ThreeDL::Renderer::present_cached() {
+    if (renderer_ == nullptr) return;
+
+    // the texture still holds the last frame drawn
+    SDL_RenderCopy(renderer_, frame_texture_, nullptr, nullptr);
+    SDL_RenderPresent(renderer_);
+}
+
+void ThreeDL::Renderer::set_render_scale(double scale) {
+    resolution_.set_scale(scale);
+
+    // multiple of 8 wide keeps rows aligned for the wide kernels
+    int width = std::max(8, static_cast<int>(width_ * resolution_.scale()) / 8 * 8);
+    int height = std::max(1, static_cast<int>(std::lround(static_cast<double>(width) * height_ / width_)));
+
+    resize_render_target(std::min(width, width_), std::min(height, height_));
+}
+
+void ThreeDL::Renderer::resize_render_target(int width, int height) {
+    if (width == render_width_ && height == render_height_) return;
+
+    render_width_ = width;
+    render_height_ = height;
+
+    // the buffers were sized for the full window up front, so shrinking and growing back never reallocates
+    zbuffer_.resize(width, height);
+    framebuffer_.resize(width * height);
+    vbuffer_.resize(width * height);
+
+    zbuffer_.clear(*kernels_);
+    redraw_all_ = true;
 }
 
-void ThreeDL::Renderer::draw_line(const Line& line, const SDL_Color& color) {
-    int dx = abs(line.b.x - line.a.x);
-    int sx = line.a.x < line.b.x ? +1 : -1;
-    int dy = -abs(line.b.y - line.a.y);
-    int sy = line.a.y < line.b.y ? +1 : -1;
+void ThreeDL::Renderer::draw_line(Vec2 a, Vec2 b, Uint32 color) {
+    if (!clip_line(a, b, 0, 0, render_width_ - 1, render_height_ - 1)) return;
+
+    ++stats_.lines_drawn_;
+
+    int x = static_cast<int>(a.x);
+    int y = static_cast<int>(a.y);
+    int dx = std::abs(static_cast<int>(b.x) - x);
+    int dy = -std::abs(static_cast<int>(b.y) - y);
+    int sx = a.x < b.x ? 1 : -1;
+    int sy = a.y < b.y ? 1 : -1;
     int e = dx + dy;
-    
-	int x = line.a.x;
-	int y = line.a.y;
-	
-    while (1) {
-        if (x >= 0 && x < width_ && y >= 0 && y < height_)
-            putpixel(x, y, color);
-
-        if (x == line.b.x && y == line.b.y) break;
+
+    // Bresenham moves one pixel along the longer axis every step, and -1/z is linear on screen
+    int steps = std::max(dx, -dy);
+    double depth = a.depth_info_;
+    double depth_step = steps > 0 ? (b.depth_info_ - a.depth_info_) / steps : 0;
+
+    for (int k = 0; k <= steps; ++k) {
+        if (!line_depth_test_ || line_visible(x, y, depth)) {
+            framebuffer_[static_cast<size_t>(y) * render_width_ + x] = color;
+        }
+
         int e2 = 2 * e;
+
         if (e2 >= dy) {
-            if (x == static_cast<int>(line.b.x)) break;
             e += dy;
             x += sx;
         }
+
         if (e2 <= dx) {
-            if (y == static_cast<int>(line.b.y)) break;
             e += dx;
             y += sy;
         }
+
+        depth += depth_step;
     }
 }
 
-void ThreeDL::Renderer::render_object(const Object& object) {
-    for (const auto& triangle : object.mesh_.triangles_) {
-        GSPTriangle copy = triangle;
-        //copy.translate(object.position_);
-        render_triangle(copy, object.mesh_.texture_);
+std::pair<size_t, size_t> ThreeDL::Renderer::queue_batches(const PreparedObject& prepared, uint32_t object_id) {
+    const Mesh& mesh = prepared.object_->mesh_;
+    size_t triangle_count = mesh.triangle_count();
+
+    std::array<Vec3, 3> rotation = view_rotation_;
+    Vec3 translation = camera_.position_;
+
+    // compressed positions are in mesh space
+    if (prepared.triangles_ == nullptr) {
+        object_view_transform(prepared, rotation, translation);
     }
-}
 
-void ThreeDL::Renderer::render_triangle(const GSPTriangle& triangle, SDL_Surface* texture) {
-    GSPTriangle copy = triangle;
-    copy.translate(camera_.position_);
-    copy.rotate(camera_.rotation_);
+    size_t begin = batch_count_;
 
-    std::vector<ThreeDL::GSPTriangle> clipped_triangles = clip_triangle(copy);
+    auto add = [&](const uint32_t* ids, uint32_t first, size_t count) {
+        if (batch_count_ == batches_.size()) batches_.emplace_back();
 
-    for (const auto& clipped : clipped_triangles) {
-        SSPTriangle projected = project(clipped);
-        rasterise_triangle(projected, texture);
+        GeometryBatch& batch = batches_[batch_count_++];
+        batch.prepared_ = &prepared;
+        batch.object_id_ = object_id;
+        batch.ids_ = ids;
+        batch.first_ = first;
+        batch.count_ = static_cast<uint32_t>(count);
+        batch.rotation_ = rotation;
+        batch.translation_ = translation;
+    };
+
+    if (!mesh.clusters_.empty()) {
+        order_clusters(prepared);
+
+        for (const auto& item : cluster_order_) {
+            const TriangleCluster& cluster = mesh.clusters_[item.value_];
+            add(&mesh.cluster_triangles_[cluster.first_], 0, cluster.count_);
+        }
+    } else {
+        // same batch size as a cluster keeps the vertex scratch small
+        for (uint32_t first = 0; first < triangle_count; first += 64) {
+            add(nullptr, first, std::min<size_t>(64, triangle_count - first));
+        }
     }
+
+    return {begin, batch_count_};
 }
 
-void ThreeDL::Renderer::rasterise_triangle(const SSPTriangle& triangle_g, SDL_Surface* texture) {
-    SSPTriangle triangle = triangle_g;
-    
-    std::sort(std::begin(triangle.vertices_), std::end(triangle.vertices_), [](const Vec2& a, const Vec2& b) {
-        return a.y > b.y;
-    });
+void ThreeDL::Renderer::render_object(size_t order_index) {
+    auto [begin, end] = object_batches_[order_index];
+    if (begin == end) return;
 
-    std::sort(std::begin(triangle.uvs_), std::end(triangle.uvs_), [](const Vec2& a, const Vec2& b) {
-        return a.y > b.y;
-    });
+    const Mesh& mesh = batches_[begin].prepared_->object_->mesh_;
 
-    int y_max = triangle.vertices_[0].y;
-    int y_min = triangle.vertices_[2].y;
-    int y_mid = triangle.vertices_[1].y;
+    // held back with its batches until everything opaque is in the depth buffer
+    if (mesh.opacity_ < 1 && !transparent_pass_) {
+        transparent_objects_.push_back(order_index);
+        return;
+    }
 
-    Vec2 horiz_line_dir = {1, 0};
-    Vec2 line_one = triangle.vertices_[2] - triangle.vertices_[0];
-    Vec2 line_two = triangle.vertices_[1] - triangle.vertices_[0];
-    Vec2 on_line = triangle.vertices_[0];
+    size_t first_visible = visible_triangles_.size();
 
-    Line line = {triangle.vertices_[0], triangle.vertices_[2]};
-    Line line2 = {triangle.vertices_[1], triangle.vertices_[0]};
+    for (size_t b = begin; b < end; ++b) {
+        std::move(batches_[b].visible_.begin(), batches_[b].visible_.end(), std::back_inserter(visible_triangles_));
+    }
 
-    for (int i = y_max; i > y_min; --i) {
-        if (static_cast<int>(y_mid) == i) {
-            line_two = triangle.vertices_[2] - triangle.vertices_[1];
-            on_line = triangle.vertices_[2];
-            line2 = {triangle.vertices_[2], triangle.vertices_[1]};
-        }
+    light_triangles(mesh, first_visible);
 
-        Vec2 intersect_one = ThreeDL::vec2_intersection({0, static_cast<double>(i)}, horiz_line_dir, on_line, line_one);
-        intersect_one.depth_info_ = ThreeDL::calculate_z_index(line, intersect_one.x, intersect_one.y);
-        Vec2 intersect_two = ThreeDL::vec2_intersection({0, static_cast<double>(i)}, horiz_line_dir, on_line, line_two);
-        intersect_two.depth_info_ = ThreeDL::calculate_z_index(line2, intersect_two.x, intersect_two.y);
+    for (size_t i = first_visible; i < visible_triangles_.size(); ++i) {
+        VisibleTriangle& visible = visible_triangles_[i];
+        const Vec3* colors = visible.colors_;
+        bool uniform = colors[0] == colors[1] && colors[1] == colors[2];
 
-        int y = intersect_one.y;
-        int x_max;
-        int x_min;
+        visible.features_ = (visible.texture_ != nullptr ? RasterFeature::textured : 0) | (uniform ? 0 : RasterFeature::smooth);
 
-        if (intersect_one.x > intersect_two.x) {
-            x_max = intersect_one.x;
-            x_min = intersect_two.x;
-        } else {
-            x_max = intersect_two.x;
-            x_min = intersect_one.x;
+        if (shadows_mapped()) {
+            const Vec3* shadow_colors = visible.shadow_colors_;
+            bool shadow_uniform = shadow_colors[0] == shadow_colors[1] && shadow_colors[1] == shadow_colors[2];
+
+            // a triangle the light does not reach looks the same either way
+            if (!(uniform && shadow_uniform && colors[0] == shadow_colors[0])) {
+                visible.features_ |= RasterFeature::shadowed | (shadow_uniform ? 0 : RasterFeature::smooth);
+            }
         }
+        visible.opacity_ = static_cast<float>(mesh.opacity_);
+    }
 
-        Line ln = {intersect_one, intersect_two};
+    // each dirty rectangle is rasterised on its own, a full frame has just the one
+    for (const SDL_Rect& rect : dirty_rects_) {
+        scissor_ = rect;
+        uint32_t batch_visible = static_cast<uint32_t>(first_visible);
 
-        for (int j = x_min; j < x_max; ++j) {
-            double z = ThreeDL::calculate_z_index(ln, j, y);
-            if (j >= 0 && j < width_ && y >= 0 && y < height_ && z > (zbuffer_)[y * width_ + j]) {
-                zbuffer_.at(y * width_ + j) = z;
-                putpixel(j, y, {255, 255, 255, 255});
+        for (size_t b = begin; b < end; ++b) {
+            const GeometryBatch& batch = batches_[b];
+
+            for (const auto& [local_id, projected] : batch.projected_) {
+                rasterise_triangle(projected, batch_visible + local_id);
             }
+
+            batch_visible += static_cast<uint32_t>(batch.visible_.size());
         }
     }
+
+    for (size_t b = begin; b < end; ++b) {
+        batches_[b].visible_.clear();
+        batches_[b].projected_.clear();
+    }
 }
 
-std::vector<ThreeDL::GSPTriangle> ThreeDL::Renderer::clip_to_plane(const GSPTriangle& triangle, const Plane& plane, bool side) {
-    std::vector<GSPTriangle> clipped;
+bool ThreeDL::Renderer::sphere_visible(const Vec3& centre, double radius) const {
+    Vec3 view = camera_.to_view(centre, view_rotation_);
 
-    ThreeDL::Vec3 ba = triangle.vertices_[1] - triangle.vertices_[0];
-    ThreeDL::Vec3 cb = triangle.vertices_[2] - triangle.vertices_[1];
-    ThreeDL::Vec3 ac = triangle.vertices_[0] - triangle.vertices_[2];
+    // wholly behind the near plane
+    if (view.z - radius > -0.01) return false;
 
-    ThreeDL::Intersect intersect_ba = ba.intersects(plane, triangle.vertices_[0]);
-    ThreeDL::Intersect intersect_cb = cb.intersects(plane, triangle.vertices_[1]);
-    ThreeDL::Intersect intersect_ac = ac.intersects(plane, triangle.vertices_[2]);
+    // side planes pass through the eye, visible while |x| <= -z * tan for the half angle on that axis
+    double tan_x = tan_theta_2_;
+    double tan_y = tan_theta_2_ * render_height_ / render_width_;
+    double norm_x = std::sqrt(1 + tan_x * tan_x);
+    double norm_y = std::sqrt(1 + tan_y * tan_y);
 
-    if (!intersect_ba.intersects_ && !intersect_cb.intersects_ && !intersect_ac.intersects_) {
-        bool onside = plane.normal_.dot(triangle.vertices_[0] - plane.position_) > 0;
-        bool inside = (side) ? onside : !onside;
+    if ((view.x + tan_x * view.z) / norm_x > radius) return false;
+    if ((-view.x + tan_x * view.z) / norm_x > radius) return false;
+    if ((view.y + tan_y * view.z) / norm_y > radius) return false;
+    if ((-view.y + tan_y * view.z) / norm_y > radius) return false;
 
-        if (inside) {
-            clipped.push_back(triangle);
-        }
+    return true;
+}
 
-        return clipped;
-    }
+std::pair<double, double> ThreeDL::Renderer::depth_range(const PreparedScene& scene) const {
+    double clip_near = -clip_planes_[0].position_.z;
+    // finite stand in for infinity, -ffast-math may fold comparisons against it
+    double near = std::numeric_limits<double>::max();
+    double far = 0;
 
-    if (intersect_ba.intersects_ && intersect_cb.intersects_ && intersect_ac.intersects_) {
-        bool onside = plane.normal_.dot(triangle.vertices_[0] - plane.position_) > 0;
-        bool inside = (side) ? onside : !onside;
+    auto add = [&](const Vec3& centre, double radius) {
+        if (!sphere_visible(centre, radius)) return;
 
-        if (inside) {
-            clipped.push_back(triangle);
-        }
+        double distance = -camera_.to_view(centre, view_rotation_).z;
+        near = std::min(near, distance - radius);
+        far = std::max(far, distance + radius);
+    };
 
-        return clipped;
+    for (const PreparedObject& prepared : scene.objects_) {
+        add(prepared.centre_, prepared.radius_);
     }
 
-    if (intersect_ba.intersects_ && intersect_cb.intersects_) {
-        bool onside = plane.normal_.dot(triangle.vertices_[1] - plane.position_) > 0;
-        bool inside = (side) ? onside : !onside;
+    for (const PointCloud* cloud : point_clouds_) {
+        if (cloud->size() > 0) add(cloud->centre_, cloud->radius_);
+    }
 
-        if (inside) {
-            clipped.push_back({
-                std::vector<Vec3> {triangle.vertices_[1], intersect_cb.point_, intersect_ba.point_},
-                triangle.uvs_
-            });
-        } else {
-            clipped.push_back({
-                std::vector<Vec3> {triangle.vertices_[0], triangle.vertices_[2], intersect_cb.point_},
-                triangle.uvs_
-            });
+    if (far == 0) return {zbuffer_.near(), zbuffer_.far()};
 
-            clipped.push_back({
-                std::vector<Vec3> {triangle.vertices_[0], intersect_ba.point_, intersect_cb.point_},
-                triangle.uvs_
-            });
-        }
+    near = std::max(near, clip_near);
+    return {near, std::max(far, near * 2)};
+}
 
-        return clipped;
-    }
+void ThreeDL::Renderer::order_objects(const PreparedScene& scene) {
+    object_order_.clear();
+    sort_depths_.clear();
 
-    if (intersect_cb.intersects_ && intersect_ac.intersects_) {
-        bool onside = plane.normal_.dot(triangle.vertices_[2] - plane.position_) > 0;
-        bool inside = (side) ? onside : !onside;
+    double min_depth = INFINITY;
+    double max_depth = -INFINITY;
 
-        if (inside) {
-            clipped.push_back({
-                std::vector<Vec3> {triangle.vertices_[2], intersect_cb.point_, intersect_ac.point_},
-                triangle.uvs_
-            });
-        } else {
-            clipped.push_back({
-                std::vector<Vec3> {triangle.vertices_[0], triangle.vertices_[1], intersect_cb.point_},
-                triangle.uvs_
-            });
+    for (uint32_t i = 0; i < scene.objects_.size(); ++i) {
+        const PreparedObject& prepared = scene.objects_[i];
+        if (!sphere_visible(prepared.centre_, prepared.radius_)) continue;
 
-            clipped.push_back({
-                std::vector<Vec3> {triangle.vertices_[0], intersect_ac.point_, intersect_cb.point_},
-                triangle.uvs_
-            });
-        }
+        object_order_.push_back({0, i});
 
-        return clipped;
+        if (draw_order_ != DrawOrder::front_to_back) continue;
+
+        double depth = -camera_.to_view(prepared.centre_, view_rotation_).z;
+        sort_depths_.push_back(depth);
+        min_depth = std::min(min_depth, depth);
+        max_depth = std::max(max_depth, depth);
     }
 
-    if (intersect_ac.intersects_ && intersect_ba.intersects_) {
-        bool onside = plane.normal_.dot(triangle.vertices_[0] - plane.position_) > 0;
-        bool inside = (side) ? onside : !onside;
+    if (draw_order_ != DrawOrder::front_to_back) return;
 
-        if (inside) {
-            clipped.push_back({
-                std::vector<Vec3> {triangle.vertices_[0], intersect_ba.point_, intersect_ac.point_},
-                triangle.uvs_
-            });
-        } else {
-            clipped.push_back({
-                std::vector<Vec3> {triangle.vertices_[1], triangle.vertices_[2], intersect_ac.point_},
-                triangle.uvs_
-            });
+    for (size_t i = 0; i < object_order_.size(); ++i) {
+        object_order_[i].key_ = quantise_depth(sort_depths_[i], min_depth, max_depth);
+    }
 
-            clipped.push_back({
-                std::vector<Vec3> {triangle.vertices_[1], intersect_ba.point_, intersect_ac.point_},
-                triangle.uvs_
-            });
-        }
+    radix_sort(object_order_, sort_scratch_);
+}
 
-        return clipped;
+void ThreeDL::Renderer::object_view_transform(const PreparedObject& prepared, std::array<Vec3, 3>& rotation, Vec3& translation) const {
+    const std::array<Vec3, 3>& object = prepared.rotation_;
+
+    for (int i = 0; i < 3; ++i) {
+        const Vec3& row = view_rotation_[i];
+        rotation[i] = object[0] * row.x + object[1] * row.y + object[2] * row.z;
     }
 
-    return clipped;
+    translation = apply_transpose(object, camera_.position_ - prepared.object_->position_);
 }
 
-std::vector<ThreeDL::GSPTriangle> ThreeDL::Renderer::clip_to_plane(const std::vector<GSPTriangle>& triangles, const Plane& plane, bool side) {
-    std::vector<GSPTriangle> clipped;
+void ThreeDL::Renderer::cull_occluded(const PreparedScene& scene) {
+    occlusion_.clear();
 
-    for (const auto& triangle : triangles) {
-        std::vector<GSPTriangle> clipped_triangles = clip_to_plane(triangle, plane, side);
-        clipped.insert(clipped.end(), clipped_triangles.begin(), clipped_triangles.end());
+    // object_order_ only holds what is in the view, see-through meshes hide nothing
+    for (const auto& item : object_order_) {
+        const PreparedObject& prepared = scene.objects_[item.value_];
+        const Object& object = *prepared.object_;
+
+        if (object.occluder_ && object.mesh_.opacity_ >= 1) draw_occluder(prepared);
     }
 
-    return clipped;
+    size_t in_view = object_order_.size();
+
+    // occluders are kept whatever is in front of them, the order of the rest is kept too
+    object_order_.erase(std::remove_if(object_order_.begin(), object_order_.end(), [&](const SortItem& item) {
+        const PreparedObject& prepared = scene.objects_[item.value_];
+        return !prepared.object_->occluder_ && object_occluded(prepared);
+    }), object_order_.end());
+
+    stats_.objects_occluded_ = static_cast<uint32_t>(in_view - object_order_.size());
 }
 
-std::vector<ThreeDL::GSPTriangle> ThreeDL::Renderer::clip_triangle(const GSPTriangle& triangle) {
-    Plane near_plane = {
-        {0, 0, -0.01},
-        {0, 0, -1},
-        {1, 0, 0}
-    };
+void ThreeDL::Renderer::draw_occluder(const PreparedObject& prepared) {
+    const Object& object = *prepared.object_;
+    const Mesh& mesh = object.occluder_mesh_ != nullptr ? *object.occluder_mesh_ : object.mesh_;
+    size_t triangle_count = mesh.triangle_count();
 
-    Vec3 side = {0, 0, 1};
-    side.rotate(0, -hf_fov_, 0);
-    Vec3 norm = side;
-    norm.rotate(0, -90, 0);
+    occluder_view_.resize(triangle_count * 3);
+    GSPTriangle decoded;
 
-    Plane left_plane = {
-        {0, 0, 0},
-        norm,
-        side
-    };
+    for (size_t t = 0; t < triangle_count; ++t) {
+        const GSPTriangle& triangle = mesh.compressed_ != nullptr ? (decoded = mesh.triangle(t)) : mesh.triangles_[t];
+        std::copy_n(triangle.vertices_.begin(), 3, &occluder_view_[3 * t]);
+    }
 
-    side = {0, 0, 1};
-    side.rotate(0, hf_fov_, 0);
-    norm = side;
-    norm.rotate(0, 90, 0);
+    std::array<Vec3, 3> rotation;
+    Vec3 translation;
+    object_view_transform(prepared, rotation, translation);
+    kernels_->transform_points(occluder_view_.data(), occluder_view_.data(), occluder_view_.size(), rotation, translation);
 
-    Plane right_plane = {
-        {0, 0, 0},
-        norm,
-        side
+    double near_z = clip_planes_[0].position_.z;
+    double scale_x = static_cast<double>(occlusion_.width()) / render_width_;
+    double scale_y = static_cast<double>(occlusion_.height()) / render_height_;
+
+    auto to_buffer = [&](const Vec3& view) {
+        Vec2 point = project_point(view);
+        return Vec2{point.x * scale_x, point.y * scale_y, point.depth_info_};
     };
 
-    std::vector<ThreeDL::GSPTriangle> near_clipped = clip_to_plane(triangle, near_plane, true);
-    std::vector<ThreeDL::GSPTriangle> left_clipped = clip_to_plane(near_clipped, left_plane, true);
-    std::vector<ThreeDL::GSPTriangle> right_clipped = clip_to_plane(left_clipped, right_plane, true);
+    for (size_t t = 0; t < triangle_count; ++t) {
+        const Vec3* corners = &occluder_view_[3 * t];
 
-    return right_clipped;
+        // clipped against the near plane only, the buffer clamps the rest
+        Vec2 polygon[4];
+        int count = 0;
+
+        for (int i = 0; i < 3; ++i) {
+            const Vec3& p = corners[i];
+            const Vec3& q = corners[(i + 1) % 3];
+            bool p_inside = p.z <= near_z;
+
+            if (p_inside) polygon[count++] = to_buffer(p);
+            if (p_inside != (q.z <= near_z)) polygon[count++] = to_buffer(p + (q - p) * ((near_z - p.z) / (q.z - p.z)));
+        }
+
+        for (int i = 1; i + 1 < count; ++i) {
+            occlusion_.draw_triangle(polygon[0], polygon[i], polygon[i + 1], *kernels_);
+        }
+    }
 }
 
-ThreeDL::SSPTriangle ThreeDL::Renderer::project(const GSPTriangle& triangle) {
-    std::vector<Vec2> vertices;
-    
-    for (const auto& vertex : triangle.vertices_) {
-        Vec3 o = {0, 0, 0};
-        Vec3 d = vertex;
+bool ThreeDL::Renderer::object_occluded(const PreparedObject& prepared) const {
+    Vec3 view = camera_.to_view(prepared.centre_, view_rotation_);
+    double radius = prepared.radius_;
+    double nearest = view.z + radius;
 
-        double dtp = (static_cast<double>(width_) / 2) / 0.73205080757;
+    // reaches past the near plane, the eye may be inside it
+    if (nearest > clip_planes_[0].position_.z) return false;
 
-        double t = (dtp - o.z) / d.z;
+    // the corners of the view space box around the sphere bound where it lands on screen
+    double dtp = (static_cast<double>(render_width_) / 2) / tan_theta_2_;
+    double scale_x = static_cast<double>(occlusion_.width()) / render_width_;
+    double scale_y = static_cast<double>(occlusion_.height()) / render_height_;
 
-        double x = (o.x + t * d.x) + (static_cast<double>(width_) / 2);
-        double y = (o.y + t * d.y )+ (static_cast<double>(height_) / 2);
+    double x_low = std::numeric_limits<double>::max();
+    double x_high = std::numeric_limits<double>::lowest();
+    double y_low = x_low;
+    double y_high = x_high;
 
-        vertices.push_back(ThreeDL::Vec2{x, y});
+    for (double z : {view.z - radius, nearest}) {
+        double t = dtp / z;
+
+        for (double offset : {-radius, radius}) {
+            x_low = std::min(x_low, t * (view.x + offset));
+            x_high = std::max(x_high, t * (view.x + offset));
+            y_low = std::min(y_low, t * (view.y + offset));
+            y_high = std::max(y_high, t * (view.y + offset));
+        }
     }
 
-    return {vertices, triangle.uvs_};
+    // a pixel of margin all round, occluder coverage is sampled at pixel centres so a covered pixel can reach
+    // past the occluder's edge, gaps between occluders narrower than that can still hide what is behind them
+    int x_min = static_cast<int>(std::floor((x_low + render_width_ / 2.0) * scale_x)) - 1;
+    int x_max = static_cast<int>(std::floor((x_high + render_width_ / 2.0) * scale_x)) + 1;
+    int y_min = static_cast<int>(std::floor((y_low + render_height_ / 2.0) * scale_y)) - 1;
+    int y_max = static_cast<int>(std::floor((y_high + render_height_ / 2.0) * scale_y)) + 1;
+
+    return !occlusion_.rect_visible(x_min, y_min, x_max, y_max, -1 / nearest, *kernels_);
 }
 
-void ThreeDL::Renderer::render() {
-    clear({0, 0, 0, 255});
+void ThreeDL::Renderer::order_clusters(const PreparedObject& prepared) {
+    const Mesh& mesh = prepared.object_->mesh_;
+    const std::vector<Vec3>& centres = *prepared.cluster_centres_;
+    bool sort = draw_order_ == DrawOrder::front_to_back && sort_clusters_;
 
-    for (const auto& object : render_queue_) {
-        render_object(*object);
+    cluster_order_.clear();
+    sort_depths_.clear();
+
+    double min_depth = INFINITY;
+    double max_depth = -INFINITY;
+
+    for (uint32_t i = 0; i < mesh.clusters_.size(); ++i) {
+        if (!sphere_visible(centres[i], mesh.clusters_[i].radius_)) continue;
+
+        cluster_order_.push_back({0, i});
+
+        if (!sort) continue;
+
+        double depth = -camera_.to_view(centres[i], view_rotation_).z;
+        sort_depths_.push_back(depth);
+        min_depth = std::min(min_depth, depth);
+        max_depth = std::max(max_depth, depth);
     }
 
-    SDL_RenderPresent(renderer_);
+    if (!sort) return;
 
-    for (int i = 0; i < width_ * height_; i++) {
-        zbuffer_[i] = -INFINITY;
+    for (size_t i = 0; i < cluster_order_.size(); ++i) {
+        cluster_order_[i].key_ = quantise_depth(sort_depths_[i], min_depth, max_depth);
     }
+
+    radix_sort(cluster_order_, sort_scratch_);
 }
 
-ThreeDL::Renderer::~Renderer() {
+void ThreeDL::Renderer::light_triangles(const Mesh& mesh, size_t first_visible) {
+    Vec3 base = {
+        static_cast<double>(mesh.color_.r),
+        static_cast<double>(mesh.color_.g),
+        static_cast<double>(mesh.color_.b)
+    };
+
+    size_t count = visible_triangles_.size() - first_visible;
+
+    if (lighting_mode_ == LightingMode::unlit) {
+        for (size_t i = first_visible; i < visible_triangles_.size(); ++i) {
+            for (auto& color : visible_triangles_[i].colors_) {
+                color = base;
+            }
+        }
+
+        return;
+    }
+
+    // flat lights each triangle once at its centroid, gouraud lights all three vertices
+    size_t per_triangle = (lighting_mode_ == LightingMode::flat) ? 1 : 3;
+    lighting_batch_.resize(count * per_triangle);
+
+    for (size_t i = 0; i < count; ++i) {
+        const GSPTriangle& triangle = visible_triangles_[first_visible + i].triangle_;
+
+        if (per_triangle == 1) {
+            Vec3 centroid = (triangle.vertices_[0] + triangle.vertices_[1] + triangle.vertices_[2]) / 3;
+            Vec3 normal = triangle.normals_[0] + triangle.normals_[1] + triangle.normals_[2];
+            normal.normalise();
+
+            lighting_batch_.x[i] = centroid.x;
+            lighting_batch_.y[i] = centroid.y;
+            lighting_batch_.z[i] = centroid.z;
+            lighting_batch_.nx[i] = normal.x;
+            lighting_batch_.ny[i] = normal.y;
+            lighting_batch_.nz[i] = normal.z;
+            continue;
+        }
+
+        for (int v = 0; v < 3; ++v) {
+            size_t k = i * 3 + v;
+
+            lighting_batch_.x[k] = triangle.vertices_[v].x;
+            lighting_batch_.y[k] = triangle.vertices_[v].y;
+            lighting_batch_.z[k] = triangle.vertices_[v].z;
+            lighting_batch_.nx[k] = triangle.normals_[v].x;
+            lighting_batch_.ny[k] = triangle.normals_[v].y;
+            lighting_batch_.nz[k] = triangle.normals_[v].z;
+        }
+    }
+
+    lighting_.light(lighting_batch_);
+
+    for (size_t i = 0; i < count; ++i) {
+        VisibleTriangle& visible = visible_triangles_[first_visible + i];
+
+        for (int v = 0; v < 3; ++v) {
+            size_t k = i * per_triangle + ((per_triangle == 1) ? 0 : v);
+
+            visible.colors_[v] = {
+                base.x * lighting_batch_.r[k],
+                base.y * lighting_batch_.g[k],
+                base.z * lighting_batch_.b[k]
+            };
+        }
+    }
+
+    if (!shadows_mapped()) return;
+
+    // lit again with the shadow light blocked, pixels blend between the two by the shadow map
+    lighting_batch_.occluded.assign(lighting_batch_.size(), 1u << shadow_light_);
+    lighting_.light(lighting_batch_);
+    lighting_batch_.occluded.clear();
+
+    for (size_t i = 0; i < count; ++i) {
+        VisibleTriangle& visible = visible_triangles_[first_visible + i];
+
+        for (int v = 0; v < 3; ++v) {
+            size_t k = i * per_triangle + ((per_triangle == 1) ? 0 : v);
+
+            visible.shadow_colors_[v] = {
+                base.x * lighting_batch_.r[k],
+                base.y * lighting_batch_.g[k],
+                base.z * lighting_batch_.b[k]
+            };
+        }
+    }
+}
+
+void ThreeDL::Renderer::setup_batch(GeometryBatch& batch) const {
+    const PreparedObject& prepared = *batch.prepared_;
+    const uint32_t* ids = batch.ids_;
+    size_t count = batch.count_;
+
+    // gathered so the kernels see one stream
+    batch.view_vertices_.resize(count * 3);
+    batch.codes_.resize(count * 3);
+
+    if (prepared.triangles_ != nullptr) {
+        for (size_t i = 0; i < count; ++i) {
+            const GSPTriangle& triangle = (*prepared.triangles_)[ids != nullptr ? ids[i] : batch.first_ + i];
+
+            for (int v = 0; v < 3; ++v) {
+                batch.view_vertices_[i * 3 + v] = triangle.vertices_[v];
+            }
+        }
+    } else {
+        prepared.object_->mesh_.compressed_->decode_positions(ids, batch.first_, count, batch.view_vertices_.data());
+    }
+
+    // same as translate then rotate(camera_.rotation_) with the trig hoisted out to once per frame
+    kernels_->transform_points(batch.view_vertices_.data(), batch.view_vertices_.data(), batch.view_vertices_.size(), batch.rotation_, batch.translation_);
+    kernels_->clip_outcodes(batch.view_vertices_.data(), batch.view_vertices_.size(), clip_planes_.data(), clip_planes_.size(), batch.codes_.data());
+
+    const uint8_t all_planes = static_cast<uint8_t>((1 << clip_planes_.size()) - 1);
+    GSPTriangle decoded;
+
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* codes = &batch.codes_[i * 3];
+
+        // trivially rejected triangles never pay for the copy or the decode
+        if ((codes[0] | codes[1] | codes[2]) != all_planes) continue;
+
+        uint32_t triangle_id = ids != nullptr ? ids[i] : batch.first_ + i;
+        setup_triangle(batch, world_triangle(prepared, triangle_id, decoded), &batch.view_vertices_[i * 3], codes, triangle_id);
+    }
+}
+
+const ThreeDL::GSPTriangle& ThreeDL::Renderer::world_triangle(const PreparedObject& prepared, uint32_t triangle_id, GSPTriangle& decoded) const {
+    if (prepared.triangles_ != nullptr) {
+        return (*prepared.triangles_)[triangle_id];
+    }
+
+    decoded = prepared.object_->mesh_.compressed_->triangle(triangle_id);
+
+    if (prepared.object_->has_transform()) {
+        for (int v = 0; v < 3; ++v) {
+            decoded.vertices_[v] = apply_rotation(prepared.rotation_, decoded.vertices_[v]) + prepared.object_->position_;
+            decoded.normals_[v] = apply_rotation(prepared.rotation_, decoded.normals_[v]);
+        }
+    }
+
+    return decoded;
+}
+
+void ThreeDL::Renderer::setup_triangle(GeometryBatch& batch, const GSPTriangle& triangle, const Vec3* view_vertices, const uint8_t* codes, uint32_t triangle_id) const {
+    GSPTriangle copy = triangle;
+
+    for (int v = 0; v < 3; ++v) {
+        copy.vertices_[v] = view_vertices[v];
+    }
+
+    std::vector<ThreeDL::GSPTriangle> clipped_triangles = clip_triangle(copy, codes);
+
+    if (clipped_triangles.empty()) return;
+
+    // shading interpolates across the unclipped triangle, clipping only trims coverage
+    batch.visible_.emplace_back(copy, batch.prepared_->object_->mesh_.texture_, batch.object_id_, triangle_id);
+    uint32_t visibility_id = static_cast<uint32_t>(batch.visible_.size());
+
+    for (const auto& clipped : clipped_triangles) {
+        batch.projected_.emplace_back(visibility_id, project(clipped));
+    }
+}
+
+ThreeDL::Renderer::TriangleRows::TriangleRows(const SSPTriangle& triangle, double sample_x, double sample_y)
+    : vertices_(sorted_corners(triangle, sample_x, sample_y)),
+      middle_(vertices_[1].y),
+      long_edge_(vertices_[2] - vertices_[0]),
+      upper_edge_(vertices_[1] - vertices_[0]),
+      lower_edge_(vertices_[2] - vertices_[1]),
+      long_line_(vertices_[0], vertices_[2]),
+      upper_line_(vertices_[1], vertices_[0]),
+      lower_line_(vertices_[2], vertices_[1])
+{
+    top_ = vertices_[0].y;
+    bottom_ = vertices_[2].y;
+}
+
+bool ThreeDL::Renderer::TriangleRows::span(int row, const SDL_Rect& scissor, int& y, int& x_min, int& count, Vec2& a, Vec2& b) const {
+    // the lower edge takes over on the rows at or below the middle corner
+    bool lower_half = row <= middle_;
+    const Vec2& on_line = lower_half ? vertices_[2] : vertices_[0];
+    const Vec2& short_edge = lower_half ? lower_edge_ : upper_edge_;
+    const Line& short_line = lower_half ? lower_line_ : upper_line_;
+
+    Vec2 horiz_line_dir = {1, 0};
+
+    a = ThreeDL::vec2_intersection({0, static_cast<double>(row)}, horiz_line_dir, on_line, long_edge_);
+    a.depth_info_ = ThreeDL::calculate_z_index(long_line_, a.x, a.y);
+    b = ThreeDL::vec2_intersection({0, static_cast<double>(row)}, horiz_line_dir, on_line, short_edge);
+    b.depth_info_ = ThreeDL::calculate_z_index(short_line, b.x, b.y);
+
+    y = a.y;
+    int x_max;
+
+    if (a.x > b.x) {
+        x_max = a.x;
+        x_min = b.x;
+    } else {
+        x_max = b.x;
+        x_min = a.x;
+    }
+
+    if (y < scissor.y || y >= scissor.y + scissor.h) return false;
+
+    x_min = std::max(x_min, scissor.x);
+    x_max = std::min(x_max, scissor.x + scissor.w);
+    count = x_max - x_min;
+
+    return count > 0;
+}
+
+template <typename SpanVisitor>
+void ThreeDL::Renderer::scan_triangle(const SSPTriangle& triangle, const SDL_Rect& scissor, SpanVisitor&& visit) {
+    TriangleRows rows(triangle, 0, 0);
+
+    int y;
+    int x_min;
+    int count;
+    Vec2 a;
+    Vec2 b;
+
+    // only the rows inside the scissor
+    int row_top = std::min(rows.top_, scissor.y + scissor.h - 1);
+    int row_bottom = std::max(rows.bottom_, scissor.y - 1);
+
+    for (int i = row_top; i > row_bottom; --i) {
+        // depth along the span matches calculate_z_index between the two intersections
+        if (rows.span(i, scissor, y, x_min, count, a, b)) {
+            visit(y, x_min, count, a, b);
+        }
+    }
+}
+
+void ThreeDL::Renderer::rasterise_triangle(const SSPTriangle& triangle, uint32_t visibility_id) {
+    const Vec2* corners = triangle.vertices_.data();
+    double left = std::min({corners[0].x, corners[1].x, corners[2].x});
+    double right = std::max({corners[0].x, corners[1].x, corners[2].x});
+
+    if (sampling_ && !transparent_pass_) {
+        rasterise_samples(triangle, visibility_id);
+        return;
+    }
+
+    if (right < scissor_.x || left >= scissor_.x + scissor_.w) return;
+
+    // picked once here so the pixel loop never branches on what the triangle needs
+    uint32_t features = visible_triangles_[visibility_id - 1].features_;
+
+    if (transparent_pass_) {
+        features |= RasterFeature::transparent;
+    } else if (shading_mode_ == ShadingMode::deferred) {
+        features |= RasterFeature::deferred;
+    }
+    SpanWriter writer = span_writers_[features];
+
+    uint64_t tested = 0;
+    uint64_t written = 0;
+
+    scan_triangle(triangle, scissor_, [&](int y, int x_min, int count, const Vec2& a, const Vec2& b) {
+        size_t row = y * render_width_;
+        uint8_t* pass = span_pass_.data();
+
+        tested += count;
+        int passed = zbuffer_.test_span(row + x_min, pass, count, x_min, a, b, *kernels_, !transparent_pass_);
+        written += passed;
+
+        if (passed == 0) return;
+
+        (this->*writer)(visibility_id, y, x_min, count, pass, a, b);
+    });
+
+    stats_.fragments_tested_ += tested;
+    stats_.fragments_written_ += written;
+}
+
+void ThreeDL::Renderer::rasterise_samples(const SSPTriangle& triangle, uint32_t visibility_id) {
+    const Vec2* corners = triangle.vertices_.data();
+    double left = std::min({corners[0].x, corners[1].x, corners[2].x});
+    double right = std::max({corners[0].x, corners[1].x, corners[2].x});
+
+    // a pixel of slack, samples sit up to a pixel from where the row walk samples
+    if (right + 1 < scissor_.x || left - 1 >= scissor_.x + scissor_.w) return;
+
+    std::array<TriangleRows, sample_count_> rows = {
+        TriangleRows(triangle, sample_offsets_[0][0] - 0.5, sample_offsets_[0][1] + 0.5),
+        TriangleRows(triangle, sample_offsets_[1][0] - 0.5, sample_offsets_[1][1] + 0.5),
+        TriangleRows(triangle, sample_offsets_[2][0] - 0.5, sample_offsets_[2][1] + 0.5),
+        TriangleRows(triangle, sample_offsets_[3][0] - 0.5, sample_offsets_[3][1] + 0.5)
+    };
+
+    int row_top = -1;
+    int row_bottom = render_height_;
+
+    for (const TriangleRows& sample_rows : rows) {
+        row_top = std::max(row_top, sample_rows.top_);
+        row_bottom = std::min(row_bottom, sample_rows.bottom_);
+    }
+
+    row_top = std::min(row_top, scissor_.y + scissor_.h - 1);
+    row_bottom = std::max(row_bottom, scissor_.y - 1);
+
+    const VisibleTriangle& visible = visible_triangles_[visibility_id - 1];
+    SpanWriter writer = span_writers_[visible.features_];
+    bool deferred = shading_mode_ == ShadingMode::deferred;
+    bool uniform = (visible.features_ & (RasterFeature::textured | RasterFeature::smooth | RasterFeature::shadowed)) == 0;
+    Uint32 uniform_color = (uniform && !deferred) ? pack_color(shade_pixel(visible, 0, 0)) : 0;
+
+    // the visibility id and a uniform colour go straight into the samples that passed
+    bool per_sample = deferred || uniform;
+    uint32_t* sample_values = deferred ? sample_ids_.data() : sample_colors_.data();
+    uint32_t sample_value = deferred ? visibility_id : uniform_color;
+
+    uint8_t* masks = sample_masks_.data();
+    uint64_t tested = 0;
+    uint64_t shaded = 0;
+    Vec2 a;
+    Vec2 b;
+
+    // every sample of a row is depth tested before the row is shaded, so the row stays in cache throughout
+    for (int i = row_top; i > row_bottom; --i) {
+        int span_start = render_width_;
+        int span_end = 0;
+
+        for (int s = 0; s < sample_count_; ++s) {
+            int y;
+            int x_min;
+            int count;
+
+            if (i > rows[s].top_ || i <= rows[s].bottom_) continue;
+            if (!rows[s].span(i, scissor_, y, x_min, count, a, b)) continue;
+
+            uint8_t* pass = span_pass_.data();
+
+            tested += count;
+            if (sample_depth_.test_span(sample_index(s, y, x_min), pass, count, x_min, a, b, *kernels_) == 0) continue;
+
+            if (per_sample) {
+                uint32_t* values = sample_values + sample_index(s, y, x_min);
+
+                for (int k = 0; k < count; ++k) {
+                    if (pass[k]) values[k] = sample_value;
+                }
+            }
+
+            for (int k = 0; k < count; ++k) {
+                masks[x_min + k] |= pass[k] << s;
+            }
+
+            span_start = std::min(span_start, x_min);
+            span_end = std::max(span_end, x_min + count);
+        }
+
+        if (span_start >= span_end) continue;
+
+        if (per_sample) {
+            for (int x = span_start; x < span_end; ++x) {
+                shaded += masks[x] != 0;
+                masks[x] = 0;
+            }
+        } else {
+            // shaded once per pixel for all the samples of it the triangle won, by the span writer into the
+            // frame, which the resolve overwrites, and from there copied into the samples
+            uint8_t* covered = span_pass_.data();
+            int count = span_end - span_start;
+
+            for (int k = 0; k < count; ++k) {
+                covered[k] = masks[span_start + k] != 0;
+            }
+
+            (this->*writer)(visibility_id, i, span_start, count, covered, a, b);
+
+            size_t row = sample_index(0, i, 0);
+            size_t stride = render_width_;
+            const Uint32* colors = &framebuffer_[static_cast<size_t>(i) * render_width_];
+
+            for (int x = span_start; x < span_end; ++x) {
+                uint8_t mask = masks[x];
+                if (mask == 0) continue;
+
+                masks[x] = 0;
+                ++shaded;
+
+                for (int s = 0; s < sample_count_; ++s) {
+                    if (mask & (1 << s)) sample_colors_[row + x + s * stride] = colors[x];
+                }
+            }
+        }
+
+        auto& [extent_start, extent_end] = sample_extents_[i];
+        extent_start = std::min(extent_start, span_start);
+        extent_end = std::max(extent_end, span_end);
+    }
+
+    stats_.fragments_tested_ += tested;
+    stats_.fragments_written_ += shaded;
+}
+
+void ThreeDL::Renderer::prepare_samples() {
+    size_t plane = static_cast<size_t>(render_width_) * render_height_;
+
+    // samples are only ever drawn inside the dirty rectangles, which the resolve clears behind it,
+    // so they start every frame clear and only need clearing here when they are reallocated
+    if (sample_depth_.format() != zbuffer_.format() || sample_colors_.size() != plane * sample_count_) {
+        sample_depth_.set_format(zbuffer_.format());
+        sample_depth_.resize(render_width_, render_height_ * sample_count_);
+        sample_depth_.clear(*kernels_);
+        sample_colors_.assign(plane * sample_count_, pack_color({0, 0, 0, 255}));
+        sample_ids_.clear();
+        sample_masks_.assign(render_width_, 0);
+        sample_extents_.assign(render_height_, {render_width_, 0});
+    }
+
+    if (shading_mode_ == ShadingMode::deferred) {
+        sample_ids_.resize(plane * sample_count_, 0);
+    }
+
+    // empty reads the same in any range, and the resolve copies stored values across unchanged
+    sample_depth_.set_range(zbuffer_.near(), zbuffer_.far());
+}
+
+void ThreeDL::Renderer::resolve_samples() {
+    Uint32 background = pack_color({0, 0, 0, 255});
+
+    // only where triangles were sampled, everywhere else the frame and depth buffer were cleared already
+    jobs().parallel_for(0, render_height_, 16, [this, background](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            auto& [extent_start, extent_end] = sample_extents_[y];
+            if (extent_start >= extent_end) continue;
+
+            size_t index = y * render_width_ + extent_start;
+            size_t samples = sample_index(0, y, extent_start);
+            size_t count = extent_end - extent_start;
+
+            kernels_->resolve_samples(&sample_colors_[samples], &framebuffer_[index], count, render_width_, background);
+            zbuffer_.resolve_samples(sample_depth_, samples, render_width_, sample_count_, index, count);
+
+            extent_start = render_width_;
+            extent_end = 0;
+        }
+    });
+}
+
+std::vector<ThreeDL::GSPTriangle> ThreeDL::Renderer::clip_to_plane(const GSPTriangle& triangle, const Plane& plane, bool side) const {
+    std::vector<GSPTriangle> clipped;
+
+    ThreeDL::Vec3 ba = triangle.vertices_[1] - triangle.vertices_[0];
+    ThreeDL::Vec3 cb = triangle.vertices_[2] - triangle.vertices_[1];
+    ThreeDL::Vec3 ac = triangle.vertices_[0] - triangle.vertices_[2];
+
+    ThreeDL::Intersect intersect_ba = ba.intersects(plane, triangle.vertices_[0]);
+    ThreeDL::Intersect intersect_cb = cb.intersects(plane, triangle.vertices_[1]);
+    ThreeDL::Intersect intersect_ac = ac.intersects(plane, triangle.vertices_[2]);
+
+    if (!intersect_ba.intersects_ && !intersect_cb.intersects_ && !intersect_ac.intersects_) {
+        bool onside = plane.normal_.dot(triangle.vertices_[0] - plane.position_) > 0;
+        bool inside = (side) ? onside : !onside;
+
+        if (inside) {
+            clipped.push_back(triangle);
+        }
+
+        return clipped;
+    }
+
+    if (intersect_ba.intersects_ && intersect_cb.intersects_ && intersect_ac.intersects_) {
+        bool onside = plane.normal_.dot(triangle.vertices_[0] - plane.position_) > 0;
+        bool inside = (side) ? onside : !onside;
+
+        if (inside) {
+            clipped.push_back(triangle);
+        }
+
+        return clipped;
+    }
+
+    if (intersect_ba.intersects_ && intersect_cb.intersects_) {
+        bool onside = plane.normal_.dot(triangle.vertices_[1] - plane.position_) > 0;
+        bool inside = (side) ? onside : !onside;
+
+        if (inside) {
+            clipped.push_back({
+                std::vector<Vec3> {triangle.vertices_[1], intersect_cb.point_, intersect_ba.point_},
+                triangle.uvs_
+            });
+        } else {
+            clipped.push_back({
+                std::vector<Vec3> {triangle.vertices_[0], triangle.vertices_[2], intersect_cb.point_},
+                triangle.uvs_
+            });
+
+            clipped.push_back({
+                std::vector<Vec3> {triangle.vertices_[0], intersect_ba.point_, intersect_cb.point_},
+                triangle.uvs_
+            });
+        }
+
+        return clipped;
+    }
+
+    if (intersect_cb.intersects_ && intersect_ac.intersects_) {
+        bool onside = plane.normal_.dot(triangle.vertices_[2] - plane.position_) > 0;
+        bool inside = (side) ? onside : !onside;
+
+        if (inside) {
+            clipped.push_back({
+                std::vector<Vec3> {triangle.vertices_[2], intersect_cb.point_, intersect_ac.point_},
+                triangle.uvs_
+            });
+        } else {
+            clipped.push_back({
+                std::vector<Vec3> {triangle.vertices_[0], triangle.vertices_[1], intersect_cb.point_},
+                triangle.uvs_
+            });
+
+            clipped.push_back({
+                std::vector<Vec3> {triangle.vertices_[0], intersect_ac.point_, intersect_cb.point_},
+                triangle.uvs_
+            });
+        }
+
+        return clipped;
+    }
+
+    if (intersect_ac.intersects_ && intersect_ba.intersects_) {
+        bool onside = plane.normal_.dot(triangle.vertices_[0] - plane.position_) > 0;
+        bool inside = (side) ? onside : !onside;
+
+        if (inside) {
+            clipped.push_back({
+                std::vector<Vec3> {triangle.vertices_[0], intersect_ba.point_, intersect_ac.point_},
+                triangle.uvs_
+            });
+        } else {
+            clipped.push_back({
+                std::vector<Vec3> {triangle.vertices_[1], triangle.vertices_[2], intersect_ac.point_},
+                triangle.uvs_
+            });
+
+            clipped.push_back({
+                std::vector<Vec3> {triangle.vertices_[1], intersect_ba.point_, intersect_ac.point_},
+                triangle.uvs_
+            });
+        }
+
+        return clipped;
+    }
+
+    return clipped;
+}
+
+std::vector<ThreeDL::GSPTriangle> ThreeDL::Renderer::clip_to_plane(const std::vector<GSPTriangle>& triangles, const Plane& plane, bool side) const {
+    std::vector<GSPTriangle> clipped;
+
+    for (const auto& triangle : triangles) {
+        std::vector<GSPTriangle> clipped_triangles = clip_to_plane(triangle, plane, side);
+        clipped.insert(clipped.end(), clipped_triangles.begin(), clipped_triangles.end());
+    }
+
+    return clipped;
+}
+
+std::vector<ThreeDL::Plane> ThreeDL::Renderer::build_clip_planes(double hf_fov) {
+    Plane near_plane = {
+        {0, 0, -0.01},
+        {0, 0, -1},
+        {1, 0, 0}
+    };
+
+    Vec3 side = {0, 0, 1};
+    side.rotate(0, -hf_fov, 0);
+    Vec3 norm = side;
+    norm.rotate(0, -90, 0);
+
+    Plane left_plane = {
+        {0, 0, 0},
+        norm,
+        side
+    };
+
+    side = {0, 0, 1};
+    side.rotate(0, hf_fov, 0);
+    norm = side;
+    norm.rotate(0, 90, 0);
+
+    Plane right_plane = {
+        {0, 0, 0},
+        norm,
+        side
+    };
+
+    return {near_plane, left_plane, right_plane};
+}
+
+std::vector<ThreeDL::GSPTriangle> ThreeDL::Renderer::clip_triangle(const GSPTriangle& triangle, const uint8_t* codes) const {
+    // outcodes, most triangles are wholly inside or wholly outside one plane and skip clipping
+    int inside_all = 0b111;
+    int outside_any = 0;
+
+    for (size_t p = 0; p < clip_planes_.size(); ++p) {
+        int inside = ((codes[0] >> p) & 1) + ((codes[1] >> p) & 1) + ((codes[2] >> p) & 1);
+
+        if (inside != 3) inside_all &= ~(1 << p);
+        if (inside == 0) outside_any |= 1 << p;
+    }
+
+    if (outside_any != 0) return {};
+    if (inside_all == 0b111) return {triangle};
+
+    std::vector<ThreeDL::GSPTriangle> near_clipped = clip_to_plane(triangle, clip_planes_[0], true);
+    std::vector<ThreeDL::GSPTriangle> left_clipped = clip_to_plane(near_clipped, clip_planes_[1], true);
+    std::vector<ThreeDL::GSPTriangle> right_clipped = clip_to_plane(left_clipped, clip_planes_[2], true);
+
+    return right_clipped;
+}
+
+ThreeDL::SSPTriangle ThreeDL::Renderer::project(const GSPTriangle& triangle) const {
+    std::vector<Vec2> vertices;
+    
+    for (const auto& vertex : triangle.vertices_) {
+        Vec3 o = {0, 0, 0};
+        Vec3 d = vertex;
+
+        double dtp = (static_cast<double>(render_width_) / 2) / 0.73205080757;
+
+        double t = (dtp - o.z) / d.z;
+
+        double x = (o.x + t * d.x) + (static_cast<double>(render_width_) / 2);
+        double y = (o.y + t * d.y )+ (static_cast<double>(render_height_) / 2);
+
+        // -1/z grows towards the camera and stays linear across the screen
+        vertices.push_back(ThreeDL::Vec2{x, y, -1 / d.z});
+    }
+
+    return {vertices, triangle.uvs_};
+}
+
+void ThreeDL::Renderer::draw_transparent() {
+    size_t pixel_count = static_cast<size_t>(render_width_) * render_height_;
+
+    // the resolve leaves the buffers cleared, so this only happens on the first use and after resizing
+    if (revealage_.size() != pixel_count) {
+        accumulation_.assign(4 * pixel_count, 0);
+        revealage_.assign(pixel_count, 1);
+    }
+
+    transparent_pass_ = true;
+
+    for (size_t order_index : transparent_objects_) {
+        render_object(order_index);
+    }
+
+    transparent_pass_ = false;
+
+    for (const SDL_Rect& rect : dirty_rects_) {
+        jobs().parallel_for(rect.y, rect.y + rect.h, 16, [this, &rect](size_t begin, size_t end) {
+            resolve_transparency(rect, static_cast<int>(begin), static_cast<int>(end));
+        });
+    }
+}
+
+void ThreeDL::Renderer::resolve_transparency(const SDL_Rect& rect, int y_start, int y_end) {
+    size_t plane = revealage_.size();
+
+    for (int y = y_start; y < y_end; ++y) {
+        size_t index = static_cast<size_t>(y) * render_width_ + rect.x;
+
+        kernels_->resolve_transparency(&accumulation_[index], &revealage_[index], &framebuffer_[index], rect.w, plane);
+
+        for (int channel = 0; channel < 4; ++channel) {
+            std::fill_n(&accumulation_[channel * plane + index], rect.w, 0.0f);
+        }
+
+        std::fill_n(&revealage_[index], rect.w, 1.0f);
+    }
+}
+
+void ThreeDL::Renderer::splat_points() {
+    // sized for the full window on first use like the other buffers, rows are render_width_ apart, every
+    // entry is back to 0 after a frame so a new render size finds it empty
+    if (splats_ == nullptr) {
+        splats_ = std::make_unique<std::atomic<uint64_t>[]>(static_cast<size_t>(width_) * height_);
+    }
+
+    // points only land inside the box around the dirty rects, each rect is resolved on its own
+    SDL_Rect bounds = dirty_rects_[0];
+
+    for (const SDL_Rect& rect : dirty_rects_) {
+        SDL_UnionRect(&bounds, &rect, &bounds);
+    }
+
+    std::atomic<uint64_t> drawn = 0;
+
+    for (const PointCloud* cloud : point_clouds_) {
+        if (cloud->size() == 0 || !sphere_visible(cloud->centre_, cloud->radius_)) continue;
+
+        jobs().parallel_for(0, cloud->size(), point_grain_, [this, cloud, &bounds, &drawn](size_t begin, size_t end) {
+            drawn.fetch_add(splat_range(*cloud, begin, end, bounds), std::memory_order_relaxed);
+        });
+    }
+
+    stats_.points_drawn_ = drawn.load();
+
+    for (const SDL_Rect& rect : dirty_rects_) {
+        jobs().parallel_for(rect.y, rect.y + rect.h, 16, [this, &rect](size_t begin, size_t end) {
+            resolve_splats(rect, static_cast<int>(begin), static_cast<int>(end));
+        });
+    }
+
+    // the union box covers pixels no rect does, anything left there is dropped for the next frame
+    if (dirty_rects_.size() > 1) {
+        for (int y = bounds.y; y < bounds.y + bounds.h; ++y) {
+            for (int x = bounds.x; x < bounds.x + bounds.w; ++x) {
+                splats_[static_cast<size_t>(y) * render_width_ + x].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+uint64_t ThreeDL::Renderer::splat_range(const PointCloud& cloud, size_t begin, size_t end, const SDL_Rect& bounds) {
+    double dtp = (static_cast<double>(render_width_) / 2) / tan_theta_2_;
+    int low = (point_size_ - 1) / 2;
+    int high = point_size_ / 2;
+
+    Vec3 view[point_batch_];
+    int32_t xs[point_batch_];
+    int32_t ys[point_batch_];
+    float depths[point_batch_];
+
+    uint64_t drawn = 0;
+
+    for (size_t first = begin; first < end; first += point_batch_) {
+        size_t count = std::min(point_batch_, end - first);
+
+        kernels_->transform_points(&cloud.positions_[first], view, count, view_rotation_, camera_.position_);
+        kernels_->project_points(view, count, dtp, render_width_, render_height_, xs, ys, depths);
+
+        for (size_t i = 0; i < count; ++i) {
+            if (xs[i] < 0) continue;
+
+            uint32_t depth_bits;
+            std::memcpy(&depth_bits, &depths[i], sizeof(depth_bits));
+
+            // positive floats order the same as their bits, so the larger key is the nearer point
+            uint64_t key = (static_cast<uint64_t>(depth_bits) << 32) | cloud.colors_[first + i];
+
+            int x_start = std::max(xs[i] - low, bounds.x);
+            int x_end = std::min(xs[i] + high + 1, bounds.x + bounds.w);
+            int y_start = std::max(ys[i] - low, bounds.y);
+            int y_end = std::min(ys[i] + high + 1, bounds.y + bounds.h);
+
+            if (x_start >= x_end || y_start >= y_end) continue;
+            ++drawn;
+
+            for (int y = y_start; y < y_end; ++y) {
+                for (int x = x_start; x < x_end; ++x) {
+                    std::atomic<uint64_t>& splat = splats_[static_cast<size_t>(y) * render_width_ + x];
+                    uint64_t current = splat.load(std::memory_order_relaxed);
+
+                    while (current < key && !splat.compare_exchange_weak(current, key, std::memory_order_relaxed)) {}
+                }
+            }
+        }
+    }
+
+    return drawn;
+}
+
+void ThreeDL::Renderer::resolve_splats(const SDL_Rect& rect, int y_start, int y_end) {
+    for (int y = y_start; y < y_end; ++y) {
+        for (int x = rect.x; x < rect.x + rect.w; ++x) {
+            size_t index = static_cast<size_t>(y) * render_width_ + x;
+            uint64_t key = splats_[index].exchange(0, std::memory_order_relaxed);
+            if (key == 0) continue;
+
+            float depth;
+            uint32_t depth_bits = static_cast<uint32_t>(key >> 32);
+            std::memcpy(&depth, &depth_bits, sizeof(depth));
+
+            // triangles in front win, ties go to the points
+            if (zbuffer_.covered(index) && depth < zbuffer_.read(index)) continue;
+
+            framebuffer_[index] = static_cast<Uint32>(key);
+            zbuffer_.write(index, depth);
+        }
+    }
+}
+
+bool ThreeDL::Renderer::line_visible(int x, int y, double depth) const {
+    size_t index = static_cast<size_t>(y) * render_width_ + x;
+    size_t across = x + 1 < render_width_ ? index + 1 : index - 1;
+    size_t down = y + 1 < render_height_ ? index + render_width_ : index - render_width_;
+
+    // nothing to hide behind, or a silhouette next to it
+    if (!zbuffer_.covered(index) || !zbuffer_.covered(across) || !zbuffer_.covered(down)) return true;
+
+    // the steepest step to a neighbour scales the slack like a polygon offset, so edges are not lost to the
+    // sloped faces they belong to
+    double stored = zbuffer_.read(index);
+    double slope = std::max(std::abs(zbuffer_.read(across) - stored), std::abs(zbuffer_.read(down) - stored));
+
+    return depth + line_depth_bias_ * stored + line_slope_bias_ * slope >= stored;
+}
+
+bool ThreeDL::Renderer::lines_active() const {
+    return wireframe_mode_ != WireframeMode::off || !debug_lines_.empty();
+}
+
+void ThreeDL::Renderer::draw_lines(const PreparedScene& scene) {
+    ++line_frame_;
+
+    if (wireframe_mode_ != WireframeMode::off) {
+        for (const PreparedObject& prepared : scene.objects_) {
+            if (sphere_visible(prepared.centre_, prepared.radius_)) draw_edges(prepared);
+        }
+
+        // streamed chunks and terrain patches come and go, so only this frame's meshes keep their edges
+        for (auto it = edge_lists_.begin(); it != edge_lists_.end();) {
+            it = it->second.second == line_frame_ ? std::next(it) : edge_lists_.erase(it);
+        }
+    }
+
+    if (debug_lines_.empty()) return;
+
+    const std::vector<Vec3>& points = debug_lines_.points_;
+    edge_view_.resize(points.size());
+    kernels_->transform_points(points.data(), edge_view_.data(), points.size(), view_rotation_, camera_.position_);
+
+    for (size_t i = 0; i < debug_lines_.size(); ++i) {
+        draw_view_line(edge_view_[2 * i], edge_view_[2 * i + 1], debug_lines_.colors_[i]);
+    }
+}
+
+void ThreeDL::Renderer::draw_edges(const PreparedObject& prepared) {
+    const Mesh& mesh = prepared.object_->mesh_;
+    auto [found, added] = edge_lists_.try_emplace(mesh.generation());
+    auto& [edges, last_used] = found->second;
+
+    if (added) {
+        edges = extract_edges(mesh);
+    }
+
+    last_used = line_frame_;
+
+    // edge positions are in mesh space
+    std::array<Vec3, 3> rotation;
+    Vec3 translation;
+    object_view_transform(prepared, rotation, translation);
+
+    double near_z = clip_planes_[0].position_.z;
+    size_t count = edges.positions_.size();
+
+    edge_view_.resize(count);
+    edge_screen_.resize(count);
+
+    // each welded vertex is transformed and projected once however many edges meet at it
+    jobs().parallel_for(0, count, edge_grain_, [&](size_t begin, size_t end) {
+        kernels_->transform_points(&edges.positions_[begin], &edge_view_[begin], end - begin, rotation, translation);
+
+        for (size_t i = begin; i < end; ++i) {
+            edge_screen_[i] = edge_view_[i].z <= near_z ? project_point(edge_view_[i]) : Vec2{0, 0, 0};
+        }
+    });
+
+    for (const auto& [first, second] : edges.edges_) {
+        const Vec2& a = edge_screen_[first];
+        const Vec2& b = edge_screen_[second];
+
+        if (a.depth_info_ > 0 && b.depth_info_ > 0) {
+            draw_line(a, b, wireframe_color_);
+        } else {
+            draw_view_line(edge_view_[first], edge_view_[second], wireframe_color_);
+        }
+    }
+}
+
+void ThreeDL::Renderer::draw_view_line(Vec3 a, Vec3 b, Uint32 color) {
+    double near_z = clip_planes_[0].position_.z;
+
+    if (a.z > near_z && b.z > near_z) return;
+
+    if (a.z > near_z) {
+        a = b + (a - b) * ((near_z - b.z) / (a.z - b.z));
+    } else if (b.z > near_z) {
+        b = a + (b - a) * ((near_z - a.z) / (b.z - a.z));
+    }
+
+    draw_line(project_point(a), project_point(b), color);
+}
+
+ThreeDL::Vec2 ThreeDL::Renderer::project_point(const Vec3& view) const {
+    // as project() places triangle corners
+    double dtp = (static_cast<double>(render_width_) / 2) / tan_theta_2_;
+    double t = dtp / view.z;
+
+    return {t * view.x + static_cast<double>(render_width_) / 2, t * view.y + static_cast<double>(render_height_) / 2, -1 / view.z};
+}
+
+bool ThreeDL::Renderer::shadows_mapped() const {
+    return shadow_light_ >= 0 && static_cast<size_t>(shadow_light_) < lighting_.directional_lights_.size() &&
+           lighting_mode_ != LightingMode::unlit && render_mode_ == RenderMode::rasterise;
+}
+
+void ThreeDL::Renderer::update_shadow_map(const PreparedScene& scene) {
+    if (!shadows_mapped()) return;
+
+    Vec3 direction = lighting_.directional_lights_[shadow_light_].direction_;
+    direction.normalise();
+
+    std::vector<std::tuple<uint64_t, Vec3, Vec3>> casters;
+    casters.reserve(scene.objects_.size());
+
+    for (const PreparedObject& prepared : scene.objects_) {
+        const Object& object = *prepared.object_;
+        casters.emplace_back(object.mesh_.generation(), object.position_, object.rotation_);
+    }
+
+    // static lights over a still scene keep the map from the last frame, only the camera's view of it changes
+    if (shadow_dirty_ || !(direction == shadow_direction_) || casters != shadow_casters_ || shadow_map_resolution_ != shadow_resolution_) {
+        shadow_direction_ = direction;
+        shadow_casters_ = std::move(casters);
+        shadow_dirty_ = false;
+
+        draw_shadow_map(scene);
+        ++stats_.shadow_maps_drawn_;
+    }
+
+    // world to map folded with view to world, the transpose of the view rotation, and the camera position
+    for (int row = 0; row < 3; ++row) {
+        view_to_shadow_[row] = apply_rotation(view_rotation_, world_to_shadow_[row]);
+    }
+
+    view_to_shadow_offset_ = apply_rotation(world_to_shadow_, camera_.position_) + world_to_shadow_offset_;
+}
+
+void ThreeDL::Renderer::draw_shadow_map(const PreparedScene& scene) {
+    const Vec3& direction = shadow_direction_;
+    Vec3 up = std::abs(direction.y) > 0.99 ? Vec3{1, 0, 0} : Vec3{0, 1, 0};
+
+    Vec3 right = up.cross(direction);
+    right.normalise();
+    up = direction.cross(right);
+
+    std::array<Vec3, 3> light_rotation = {right, up, direction};
+
+    // orthographic, fitted around the bounding spheres of everything that can cast
+    Vec3 low = {INFINITY, INFINITY, INFINITY};
+    Vec3 high = {-INFINITY, -INFINITY, -INFINITY};
+
+    for (const PreparedObject& prepared : scene.objects_) {
+        Vec3 centre = apply_rotation(light_rotation, prepared.centre_);
+        Vec3 extent = {prepared.radius_, prepared.radius_, prepared.radius_};
+
+        low = {std::min(low.x, centre.x - extent.x), std::min(low.y, centre.y - extent.y), std::min(low.z, centre.z - extent.z)};
+        high = {std::max(high.x, centre.x + extent.x), std::max(high.y, centre.y + extent.y), std::max(high.z, centre.z + extent.z)};
+    }
+
+    int resolution = shadow_resolution_;
+    shadow_map_resolution_ = resolution;
+    shadow_map_.set_format(DepthFormat::float32);
+    shadow_map_.resize(resolution, resolution);
+    shadow_map_.clear(*kernels_);
+    shadow_pass_.resize(resolution);
+
+    if (scene.objects_.empty()) {
+        world_to_shadow_ = {Vec3{0, 0, 0}, Vec3{0, 0, 0}, Vec3{0, 0, 0}};
+        world_to_shadow_offset_ = {-1, -1, 0};
+        return;
+    }
+
+    // padded so the farthest point still stores above 0, which reads back as empty
+    double span = std::max({high.x - low.x, high.y - low.y, 1e-9});
+    double scale = resolution / span;
+    double depth_pad = (high.z - low.z) * 0.01 + 1e-9;
+    double near = low.z - depth_pad;
+    double range = high.z - low.z + depth_pad * 2;
+
+    // stored depth is 1 - (light depth - near) / range
+    world_to_shadow_ = {light_rotation[0] * scale, light_rotation[1] * scale, light_rotation[2] * (-1 / range)};
+    world_to_shadow_offset_ = {-low.x * scale, -low.y * scale, 1 + near / range};
+    shadow_bias_depth_ = shadow_bias_texels_ / scale / range;
+
+    SDL_Rect scissor = {0, 0, resolution, resolution};
+    GSPTriangle decoded;
+
+    for (const PreparedObject& prepared : scene.objects_) {
+        size_t triangle_count = prepared.object_->mesh_.triangle_count();
+        shadow_vertices_.resize(triangle_count * 3);
+
+        for (size_t t = 0; t < triangle_count; ++t) {
+            const GSPTriangle& triangle = world_triangle(prepared, static_cast<uint32_t>(t), decoded);
+
+            for (int v = 0; v < 3; ++v) {
+                shadow_vertices_[t * 3 + v] = triangle.vertices_[v];
+            }
+        }
+
+        // the same transform and span kernels as the camera pass, with nothing but depth written
+        kernels_->transform_points(shadow_vertices_.data(), shadow_vertices_.data(), shadow_vertices_.size(), world_to_shadow_, {0, 0, 0});
+
+        for (size_t t = 0; t < triangle_count; ++t) {
+            Vec3 corners[3];
+
+            for (int v = 0; v < 3; ++v) {
+                corners[v] = shadow_vertices_[t * 3 + v] + world_to_shadow_offset_;
+            }
+
+            SSPTriangle triangle(
+                Vec2(corners[0].x, corners[0].y, corners[0].z),
+                Vec2(corners[1].x, corners[1].y, corners[1].z),
+                Vec2(corners[2].x, corners[2].y, corners[2].z)
+            );
+
+            // trimmed to the texels inside the triangle, a span starting left of its edge would carry the plane past
+            // a ridge and over the neighbouring face
+            scan_triangle(triangle, scissor, [&](int y, int x_min, int count, const Vec2& a, const Vec2& b) {
+                int first = std::max(x_min, static_cast<int>(std::ceil(std::min(a.x, b.x))));
+                int last = std::min(x_min + count - 1, static_cast<int>(std::floor(std::max(a.x, b.x))));
+                if (first > last) return;
+
+                shadow_map_.test_span(static_cast<size_t>(y) * resolution + first, shadow_pass_.data(), last - first + 1, first, a, b, *kernels_);
+            });
+        }
+    }
+}
+
+double ThreeDL::Renderer::shadow_visibility(const Vec3& point, const std::vector<Vec3>& vertices) const {
+    Vec3 mapped = apply_rotation(view_to_shadow_, point) + view_to_shadow_offset_;
+    int resolution = shadow_map_resolution_;
+
+    // the texels tested sit up to a texel from the point, half of one without the filter, and a surface
+    // slanted to the light changes depth over that much, so the bias follows the slope of its plane in the map
+    Vec3 edge_1 = apply_rotation(view_to_shadow_, vertices[1] - vertices[0]);
+    Vec3 edge_2 = apply_rotation(view_to_shadow_, vertices[2] - vertices[0]);
+    double det = edge_1.x * edge_2.y - edge_2.x * edge_1.y;
+    double slope_limit = shadow_bias_depth_ / shadow_bias_texels_ * shadow_slope_texels_;
+    double slope = slope_limit;
+
+    if (det != 0) {
+        double dzdx = (edge_1.z * edge_2.y - edge_2.z * edge_1.y) / det;
+        double dzdy = (edge_1.x * edge_2.z - edge_2.x * edge_1.z) / det;
+        slope = std::min((std::abs(dzdx) + std::abs(dzdy)) * (shadow_pcf_ ? 1 : 0.5), slope_limit);
+    }
+
+    double depth = mapped.z + shadow_bias_depth_ + slope;
+
+    auto lit = [&](int x, int y) -> double {
+        if (x < 0 || y < 0 || x >= resolution || y >= resolution) return 1;
+
+        return depth >= shadow_map_.read(static_cast<size_t>(y) * resolution + x) ? 1 : 0;
+    };
+
+    // the span kernels sample a texel at its integer corner, not its centre
+    if (!shadow_pcf_) {
+        return lit(static_cast<int>(std::round(mapped.x)), static_cast<int>(std::round(mapped.y)));
+    }
+
+    // 2x2 percentage closer filter, the four nearest texel tests weighted bilinearly
+    double fx = mapped.x;
+    double fy = mapped.y;
+    int x = static_cast<int>(std::floor(fx));
+    int y = static_cast<int>(std::floor(fy));
+    double tx = fx - x;
+    double ty = fy - y;
+
+    return (lit(x, y) * (1 - tx) + lit(x + 1, y) * tx) * (1 - ty) +
+           (lit(x, y + 1) * (1 - tx) + lit(x + 1, y + 1) * tx) * ty;
+}
+
+void ThreeDL::Renderer::shade_visibility_buffer() {
+    for (const SDL_Rect& rect : dirty_rects_) {
+        jobs().parallel_for(rect.y, rect.y + rect.h, 16, [this, &rect](size_t begin, size_t end) {
+            if (sampling_) {
+                shade_sample_rows(rect, static_cast<int>(begin), static_cast<int>(end));
+            } else {
+                shade_rows(rect, static_cast<int>(begin), static_cast<int>(end));
+            }
+        });
+    }
+}
+
+void ThreeDL::Renderer::shade_rows(const SDL_Rect& rect, int y_start, int y_end) {
+    for (int y = y_start; y < y_end; ++y) {
+        for (int x = rect.x; x < rect.x + rect.w; ++x) {
+            uint32_t visibility_id = vbuffer_[y * render_width_ + x];
+            if (visibility_id == 0) continue;
+
+            const VisibleTriangle& visible = visible_triangles_[visibility_id - 1];
+            putpixel(x, y, (this->*pixel_shaders_[visible.features_])(visible, x, y));
+        }
+    }
+}
+
+void ThreeDL::Renderer::shade_sample_rows(const SDL_Rect& rect, int y_start, int y_end) {
+    size_t stride = render_width_;
+
+    for (int y = y_start; y < y_end; ++y) {
+        int x_start = std::max(rect.x, sample_extents_[y].first);
+        int x_end = std::min(rect.x + rect.w, sample_extents_[y].second);
+
+        for (int x = x_start; x < x_end; ++x) {
+            size_t index = sample_index(0, y, x);
+            uint32_t ids[sample_count_];
+            Uint32 colors[sample_count_];
+
+            for (int s = 0; s < sample_count_; ++s) {
+                ids[s] = sample_ids_[index + s * stride];
+                if (ids[s] == 0) continue;
+
+                sample_ids_[index + s * stride] = 0;
+
+                // a triangle is shaded once however many of the pixel's samples it won
+                int first = 0;
+                while (ids[first] != ids[s]) ++first;
+
+                if (first == s) {
+                    const VisibleTriangle& visible = visible_triangles_[ids[s] - 1];
+                    colors[s] = pack_color((this->*pixel_shaders_[visible.features_])(visible, x, y));
+                } else {
+                    colors[s] = colors[first];
+                }
+
+                sample_colors_[index + s * stride] = colors[s];
+            }
+        }
+    }
+}
+
+SDL_Color ThreeDL::Renderer::shade_pixel(const VisibleTriangle& visible, int x, int y) const {
+    return (this->*pixel_shaders_[visible.features_])(visible, x, y);
+}
+
+template <uint32_t Features>
+SDL_Color ThreeDL::Renderer::shade_pixel(const VisibleTriangle& visible, int x, int y) const {
+    constexpr bool textured = Features & RasterFeature::textured;
+    constexpr bool smooth = Features & RasterFeature::smooth;
+    constexpr bool shadowed = Features & RasterFeature::shadowed;
+
+    const Vec3* colors = visible.colors_;
+
+    if constexpr (!textured && !smooth && !shadowed) {
+        return {
+            static_cast<Uint8>(std::min(colors[0].x, 255.0)),
+            static_cast<Uint8>(std::min(colors[0].y, 255.0)),
+            static_cast<Uint8>(std::min(colors[0].z, 255.0)),
+            255
+        };
+    } else {
+        // ray through the pixel centre, intersected with the view space triangle for barycentrics
+        double dtp = (static_cast<double>(render_width_) / 2) / tan_theta_2_;
+        Vec3 ray = {x + 0.5 - static_cast<double>(render_width_) / 2, y + 0.5 - static_cast<double>(render_height_) / 2, dtp};
+
+        double det = ray.dot(visible.det_);
+
+        if (det == 0) {
+            det = 1e-12;
+        }
+
+        double b1 = ray.dot(visible.b1_) / det;
+        double b2 = ray.dot(visible.b2_) / det;
+
+        Vec3 color = colors[0];
+
+        if constexpr (smooth) {
+            double b0 = 1 - b1 - b2;
+            color = colors[0] * b0 + colors[1] * b1 + colors[2] * b2;
+        }
+
+        if constexpr (shadowed) {
+            const Vec3* shadow_colors = visible.shadow_colors_;
+            const std::vector<Vec3>& vertices = visible.triangle_.vertices_;
+            double b0 = 1 - b1 - b2;
+
+            Vec3 shadow_color = shadow_colors[0];
+
+            if constexpr (smooth) {
+                shadow_color = shadow_colors[0] * b0 + shadow_colors[1] * b1 + shadow_colors[2] * b2;
+            }
+
+            double visibility = shadow_visibility(vertices[0] * b0 + vertices[1] * b1 + vertices[2] * b2, vertices);
+            color = shadow_color + (color - shadow_color) * visibility;
+        }
+
+        if constexpr (!textured) {
+            return {
+                static_cast<Uint8>(std::clamp(color.x, 0.0, 255.0)),
+                static_cast<Uint8>(std::clamp(color.y, 0.0, 255.0)),
+                static_cast<Uint8>(std::clamp(color.z, 0.0, 255.0)),
+                255
+            };
+        }
+
+        return surface_color(color, visible.texture_, visible.triangle_.uvs_, b1, b2);
+    }
+}
+
+template <uint32_t Features>
+void ThreeDL::Renderer::write_span(uint32_t visibility_id, int y, int x_start, int count, const uint8_t* pass, const Vec2& a, const Vec2& b) {
+    size_t row = y * render_width_;
+
+    if constexpr ((Features & RasterFeature::transparent) != 0) {
+        const VisibleTriangle& visible = visible_triangles_[visibility_id - 1];
+        size_t plane = revealage_.size();
+        double denom = b.x - a.x;
+
+        for (int k = 0; k < count; ++k) {
+            if (!pass[k]) continue;
+
+            SDL_Color color = shade_pixel<Features>(visible, x_start + k, y);
+            float alpha = visible.opacity_ * color.a / 255.0f;
+
+            // McGuire and Bavoil's depth weight, nearer fragments count for more, distance is 1 / (-1/z)
+            double t = (static_cast<double>(x_start + k) - a.x) / denom;
+            double distance = 1 / (a.depth_info_ + t * (b.depth_info_ - a.depth_info_));
+            double falloff = 10 / (1e-5 + std::pow(distance / 5, 2) + std::pow(distance / 200, 6));
+            float weight = alpha * static_cast<float>(std::clamp(falloff, 1e-2, 3e3));
+
+            size_t index = row + x_start + k;
+            accumulation_[index] += color.r * weight;
+            accumulation_[plane + index] += color.g * weight;
+            accumulation_[2 * plane + index] += color.b * weight;
+            accumulation_[3 * plane + index] += weight;
+            revealage_[index] *= 1 - alpha;
+        }
+    } else if constexpr ((Features & RasterFeature::deferred) != 0) {
+        for (int k = 0; k < count; ++k) {
+            if (pass[k]) vbuffer_[row + x_start + k] = visibility_id;
+        }
+    } else if constexpr ((Features & (RasterFeature::textured | RasterFeature::smooth | RasterFeature::shadowed)) == 0) {
+        // one colour for the whole triangle
+        Uint32 packed = pack_color(shade_pixel<Features>(visible_triangles_[visibility_id - 1], x_start, y));
+
+        for (int k = 0; k < count; ++k) {
+            if (pass[k]) framebuffer_[row + x_start + k] = packed;
+        }
+    } else {
+        const VisibleTriangle& visible = visible_triangles_[visibility_id - 1];
+
+        for (int k = 0; k < count; ++k) {
+            if (pass[k]) framebuffer_[row + x_start + k] = pack_color(shade_pixel<Features>(visible, x_start + k, y));
+        }
+    }
+}
+
+const std::array<ThreeDL::Renderer::PixelShader, ThreeDL::RasterFeature::variant_count> ThreeDL::Renderer::pixel_shaders_ = {
+    &Renderer::shade_pixel<0>, &Renderer::shade_pixel<1>, &Renderer::shade_pixel<2>, &Renderer::shade_pixel<3>,
+    &Renderer::shade_pixel<4>, &Renderer::shade_pixel<5>, &Renderer::shade_pixel<6>, &Renderer::shade_pixel<7>,
+    &Renderer::shade_pixel<8>, &Renderer::shade_pixel<9>, &Renderer::shade_pixel<10>, &Renderer::shade_pixel<11>,
+    &Renderer::shade_pixel<12>, &Renderer::shade_pixel<13>, &Renderer::shade_pixel<14>, &Renderer::shade_pixel<15>,
+    &Renderer::shade_pixel<16>, &Renderer::shade_pixel<17>, &Renderer::shade_pixel<18>, &Renderer::shade_pixel<19>,
+    &Renderer::shade_pixel<20>, &Renderer::shade_pixel<21>, &Renderer::shade_pixel<22>, &Renderer::shade_pixel<23>,
+    &Renderer::shade_pixel<24>, &Renderer::shade_pixel<25>, &Renderer::shade_pixel<26>, &Renderer::shade_pixel<27>,
+    &Renderer::shade_pixel<28>, &Renderer::shade_pixel<29>, &Renderer::shade_pixel<30>, &Renderer::shade_pixel<31>
+};
+
+const std::array<ThreeDL::Renderer::SpanWriter, ThreeDL::RasterFeature::variant_count> ThreeDL::Renderer::span_writers_ = {
+    &Renderer::write_span<0>, &Renderer::write_span<1>, &Renderer::write_span<2>, &Renderer::write_span<3>,
+    &Renderer::write_span<4>, &Renderer::write_span<5>, &Renderer::write_span<6>, &Renderer::write_span<7>,
+    &Renderer::write_span<8>, &Renderer::write_span<9>, &Renderer::write_span<10>, &Renderer::write_span<11>,
+    &Renderer::write_span<12>, &Renderer::write_span<13>, &Renderer::write_span<14>, &Renderer::write_span<15>,
+    &Renderer::write_span<16>, &Renderer::write_span<17>, &Renderer::write_span<18>, &Renderer::write_span<19>,
+    &Renderer::write_span<20>, &Renderer::write_span<21>, &Renderer::write_span<22>, &Renderer::write_span<23>,
+    &Renderer::write_span<24>, &Renderer::write_span<25>, &Renderer::write_span<26>, &Renderer::write_span<27>,
+    &Renderer::write_span<28>, &Renderer::write_span<29>, &Renderer::write_span<30>, &Renderer::write_span<31>
+};
+
+SDL_Color ThreeDL::Renderer::surface_color(const Vec3& color, SDL_Surface* texture, const std::vector<Vec2>& uvs, double b1, double b2) {
+    if (texture == nullptr) {
+        return {
+            static_cast<Uint8>(std::clamp(color.x, 0.0, 255.0)),
+            static_cast<Uint8>(std::clamp(color.y, 0.0, 255.0)),
+            static_cast<Uint8>(std::clamp(color.z, 0.0, 255.0)),
+            255
+        };
+    }
+
+    double b0 = 1 - b1 - b2;
+    double u = b0 * uvs[0].x + b1 * uvs[1].x + b2 * uvs[2].x;
+    double t = b0 * uvs[0].y + b1 * uvs[1].y + b2 * uvs[2].y;
+
+    int tx = std::clamp(static_cast<int>(u * (texture->w - 1)), 0, texture->w - 1);
+    int ty = std::clamp(static_cast<int>((1 - t) * (texture->h - 1)), 0, texture->h - 1);
+
+    Uint32 texel = static_cast<const Uint32*>(texture->pixels)[ty * (texture->pitch / 4) + tx];
+
+    return {
+        static_cast<Uint8>(std::min(((texel >> 16) & 0xff) * color.x / 255, 255.0)),
+        static_cast<Uint8>(std::min(((texel >> 8) & 0xff) * color.y / 255, 255.0)),
+        static_cast<Uint8>(std::min((texel & 0xff) * color.z / 255, 255.0)),
+        static_cast<Uint8>(texel >> 24)
+    };
+}
+
+void ThreeDL::Renderer::trace(const PreparedScene& scene) {
+    bvh_.build(scene);
+
+    TileScheduler scheduler(render_width_, render_height_, trace_tile_size_);
+
+    scheduler.run(jobs().thread_count(), [&](const SDL_Rect& tile, int) {
+        trace_tile(scene, tile);
+    });
+}
+
+void ThreeDL::Renderer::trace_tile(const PreparedScene& scene, const SDL_Rect& tile) {
+    double dtp = (static_cast<double>(render_width_) / 2) / tan_theta_2_;
+
+    // hits are gathered first so the whole tile is lit as one batch
+    std::vector<std::pair<int, RayHit>> hits;
+    std::vector<Vec3> views;
+
+    for (int y = tile.y; y < tile.y + tile.h; ++y) {
+        for (int x = tile.x; x < tile.x + tile.w; ++x) {
+            // through the pixel centre on the projection plane, mirrored as project() divides by a negative z
+            Vec3 view = {
+                static_cast<double>(render_width_) / 2 - x - 0.5,
+                static_cast<double>(render_height_) / 2 - y - 0.5,
+                -dtp
+            };
+
+            RayHit hit = bvh_.closest_hit({camera_.position_, apply_transpose(view_rotation_, view)});
+            if (!hit.hit_) continue;
+
+            hits.emplace_back(y * render_width_ + x, hit);
+            views.push_back(view);
+
+            // the view space point is view * t, stored as -1/z like the rasteriser does
+            zbuffer_.write(y * render_width_ + x, 1 / (dtp * hit.t_));
+        }
+    }
+
+    if (hits.empty()) return;
+
+    // lit per pixel, flat still uses the centroid and averaged normal so it matches the rasteriser
+    bool lit = lighting_mode_ != LightingMode::unlit;
+    LightingBatch batch;
+    GSPTriangle decoded;
+
+    if (lit) {
+        batch.resize(hits.size());
+
+        if (shadows_) {
+            batch.occluded.resize(hits.size());
+        }
+    }
+
+    for (size_t i = 0; lit && i < hits.size(); ++i) {
+        const RayHit& hit = hits[i].second;
+        const GSPTriangle& triangle = world_triangle(scene.objects_[hit.object_id_], hit.triangle_id_, decoded);
+        double b0 = 1 - hit.u_ - hit.v_;
+
+        Vec3 position;
+        Vec3 normal;
+
+        if (lighting_mode_ == LightingMode::flat) {
+            position = camera_.to_view((triangle.vertices_[0] + triangle.vertices_[1] + triangle.vertices_[2]) / 3, view_rotation_);
+            normal = triangle.normals_[0] + triangle.normals_[1] + triangle.normals_[2];
+        } else {
+            position = views[i] * hit.t_;
+            normal = triangle.normals_[0] * b0 + triangle.normals_[1] * hit.u_ + triangle.normals_[2] * hit.v_;
+        }
+
+        normal.normalise();
+
+        batch.x[i] = position.x;
+        batch.y[i] = position.y;
+        batch.z[i] = position.z;
+        batch.nx[i] = normal.x;
+        batch.ny[i] = normal.y;
+        batch.nz[i] = normal.z;
+
+        if (!shadows_) continue;
+
+        Vec3 point = triangle.vertices_[0] * b0 + triangle.vertices_[1] * hit.u_ + triangle.vertices_[2] * hit.v_;
+        Vec3 face = triangle.face_normal();
+
+        if (face.dot(apply_transpose(view_rotation_, views[i])) > 0) {
+            face = face * -1;
+        }
+
+        batch.occluded[i] = trace_shadows(point + face * shadow_bias_);
+    }
+
+    if (lit) {
+        lighting_.light(batch);
+    }
+
+    for (size_t i = 0; i < hits.size(); ++i) {
+        const RayHit& hit = hits[i].second;
+        const Mesh& mesh = scene.objects_[hit.object_id_].object_->mesh_;
+        const GSPTriangle& triangle = world_triangle(scene.objects_[hit.object_id_], hit.triangle_id_, decoded);
+
+        Vec3 color = {
+            static_cast<double>(mesh.color_.r),
+            static_cast<double>(mesh.color_.g),
+            static_cast<double>(mesh.color_.b)
+        };
+
+        if (lit) {
+            color = {color.x * batch.r[i], color.y * batch.g[i], color.z * batch.b[i]};
+        }
+
+        framebuffer_[hits[i].first] = pack_color(surface_color(color, mesh.texture_, triangle.uvs_, hit.u_, hit.v_));
+    }
+}
+
+uint32_t ThreeDL::Renderer::trace_shadows(const Vec3& point) const {
+    // same bit order as LightingBatch::occluded
+    uint32_t occluded = 0;
+    uint32_t index = 0;
+
+    for (const auto& light : lighting_.directional_lights_) {
+        if (index == 32) return occluded;
+        if (bvh_.any_hit({point, light.direction_ * -1})) occluded |= 1u << index;
+        ++index;
+    }
+
+    for (const auto& light : lighting_.point_lights_) {
+        if (index == 32) return occluded;
+        if (bvh_.any_hit({point, light.position_ - point, 1})) occluded |= 1u << index;
+        ++index;
+    }
+
+    return occluded;
+}
+
+void ThreeDL::Renderer::render() {
+    Uint64 frame_start = SDL_GetPerformanceCounter();
+
+    gather_objects();
+    last_update_ = detect_changes();
+
+    if (last_update_ == FrameUpdate::none) {
+        present_cached();
+        return;
+    }
+
+    if (last_update_ == FrameUpdate::partial) {
+        scene_.rebuild(frame_objects_, changed_objects_);
+    } else {
+        scene_.build(frame_objects_);
+    }
+
+    draw(scene_, last_update_);
+    present();
+
+    // a partial frame says nothing about what a full one costs
+    if (dynamic_resolution_ && last_update_ == FrameUpdate::full) {
+        double frame_ms = (SDL_GetPerformanceCounter() - frame_start) * 1000.0 / SDL_GetPerformanceFrequency();
+
+        if (resolution_.add_frame(frame_ms)) {
+            set_render_scale(resolution_.scale());
+        }
+    }
+}
+
+void ThreeDL::Renderer::render_prepared(const PreparedScene& scene) {
+    draw(scene);
+    present();
+
+    // the retained buffers now hold a scene the change tracking never saw
+    redraw_all_ = true;
+}
+
+void ThreeDL::Renderer::draw(const PreparedScene& scene, FrameUpdate update) {
+    kernels_ = &kernels();
+
+    visible_triangles_.clear();
+    transparent_objects_.clear();
+
+    if (lighting_mode_ != LightingMode::unlit) {
+        lighting_.prepare(camera_);
+    }
+
+    stats_ = {};
+    view_rotation_ = camera_.view_rotation();
+    sampling_ = msaa_ && render_mode_ == RenderMode::rasterise;
+
+    // the unorm formats spread their steps over what is in view, a patched frame has to keep the range its
+    // retained depth was written in, so one that no longer fits it is drawn in full
+    auto [near, far] = depth_range(scene);
+
+    if (update == FrameUpdate::partial && !zbuffer_.holds(near, far)) {
+        update = FrameUpdate::full;
+        last_update_ = update;
+    }
+
+    if (update != FrameUpdate::partial) {
+        zbuffer_.set_range(near, far);
+    }
+
+    if (sampling_) {
+        prepare_samples();
+    }
+
+    update_shadow_map(scene);
+
+    if (update == FrameUpdate::partial) {
+        draw_changes(scene);
+    } else {
+        clear({0, 0, 0, 255});
+        zbuffer_.clear(*kernels_);
+        dirty_rects_.assign(1, {0, 0, render_width_, render_height_});
+        scissor_ = dirty_rects_[0];
+
+        if (wireframe_mode_ == WireframeMode::only) {
+            // edges only, nothing below them
+        } else if (render_mode_ == RenderMode::ray_trace) {
+            trace(scene);
+        } else {
+            draw_all(scene);
+        }
+    }
+
+    if (render_mode_ == RenderMode::rasterise && shading_mode_ == ShadingMode::deferred && wireframe_mode_ != WireframeMode::only) {
+        shade_visibility_buffer();
+    }
+
+    if (sampling_) {
+        resolve_samples();
+    }
+
+    if (!point_clouds_.empty()) {
+        splat_points();
+    }
+
+    if (!transparent_objects_.empty()) {
+        draw_transparent();
+    }
+
+    if (lines_active()) {
+        draw_lines(scene);
+    }
+
+    if (collect_stats_) {
+        stats_.pixels_covered_ = zbuffer_.covered_count();
+    }
+
+    if (capture_depth_) {
+        zbuffer_.copy_to(depth_);
+    }
+}
+
+void ThreeDL::Renderer::draw_all(const PreparedScene& scene) {
+    if (shading_mode_ == ShadingMode::deferred) {
+        kernels_->fill_pixels(vbuffer_.data(), vbuffer_.size(), 0);
+    }
+
+    order_objects(scene);
+
+    if (occlusion_culling_) {
+        cull_occluded(scene);
+    }
+
+    batch_count_ = 0;
+    object_batches_.clear();
+
+    for (const auto& item : object_order_) {
+        object_batches_.push_back(queue_batches(scene.objects_[item.value_], item.value_));
+    }
+
+    set_up_batches(0);
+
+    if (incremental_) {
+        object_bounds_.assign(scene.objects_.size(), {0, 0, 0, 0});
+
+        for (size_t i = 0; i < object_order_.size(); ++i) {
+            object_bounds_[object_order_[i].value_] = batch_bounds(object_batches_[i].first, object_batches_[i].second);
+        }
+    }
+
+    for (size_t i = 0; i < object_order_.size(); ++i) {
+        render_object(i);
+    }
+
+    stats_.objects_drawn_ = object_order_.size();
+}
+
+void ThreeDL::Renderer::draw_changes(const PreparedScene& scene) {
+    order_objects(scene);
+
+    batch_count_ = 0;
+    object_batches_.assign(object_order_.size(), {0, 0});
+    dirty_rects_.clear();
+
+    // moved objects first, where they land is only known once their triangles are projected
+    for (size_t i = 0; i < object_order_.size(); ++i) {
+        uint32_t id = object_order_[i].value_;
+        if (object_changed_[id]) object_batches_[i] = queue_batches(scene.objects_[id], id);
+    }
+
+    set_up_batches(0);
+
+    // old rectangles of every moved object, culled ones included, then the new ones of those still in view
+    for (uint32_t id : changed_objects_) {
+        add_dirty_rect(object_bounds_[id]);
+        object_bounds_[id] = {0, 0, 0, 0};
+    }
+
+    for (size_t i = 0; i < object_order_.size(); ++i) {
+        uint32_t id = object_order_[i].value_;
+        if (!object_changed_[id]) continue;
+
+        object_bounds_[id] = batch_bounds(object_batches_[i].first, object_batches_[i].second);
+        add_dirty_rect(object_bounds_[id]);
+    }
+
+    size_t dirty_area = 0;
+
+    for (const SDL_Rect& rect : dirty_rects_) {
+        dirty_area += static_cast<size_t>(rect.w) * rect.h;
+    }
+
+    if (dirty_area > max_dirty_fraction_ * render_width_ * render_height_) {
+        dirty_rects_.assign(1, {0, 0, render_width_, render_height_});
+    }
+
+    // still objects are only drawn again where they overlap what is being redrawn
+    size_t first_still = batch_count_;
+
+    for (size_t i = 0; i < object_order_.size(); ++i) {
+        uint32_t id = object_order_[i].value_;
+        if (object_changed_[id]) continue;
+
+        for (const SDL_Rect& rect : dirty_rects_) {
+            if (!SDL_HasIntersection(&object_bounds_[id], &rect)) continue;
+
+            object_batches_[i] = queue_batches(scene.objects_[id], id);
+            break;
+        }
+    }
+
+    set_up_batches(first_still);
+    clear_dirty_rects();
+
+    for (size_t i = 0; i < object_order_.size(); ++i) {
+        if (object_batches_[i].first == object_batches_[i].second) continue;
+
+        render_object(i);
+        ++stats_.objects_drawn_;
+    }
+}
+
+void ThreeDL::Renderer::gather_objects() {
+    frame_objects_.assign(render_queue_.begin(), render_queue_.end());
+
+    if (streamed_scenes_.empty() && terrains_.empty()) return;
+
+    view_rotation_ = camera_.view_rotation();
+
+    auto visible = [this](const Vec3& centre, double radius) {
+        return sphere_visible(centre, radius);
+    };
+
+    for (Terrain* terrain : terrains_) {
+        // a new set of patches replaces the objects the change tracking knew
+        if (terrain->update(camera_.position_, visible, frame_objects_)) {
+            redraw_all_ = true;
+            shadow_dirty_ = true;
+        }
+    }
+    double dtp = (static_cast<double>(render_width_) / 2) / tan_theta_2_;
+
+    for (StreamedScene* streamed : streamed_scenes_) {
+        const std::vector<ChunkInfo>& chunks = streamed->chunks();
+        stream_candidates_.clear();
+
+        for (uint32_t c = 0; c < chunks.size(); ++c) {
+            const ChunkInfo& chunk = chunks[c];
+            if (!sphere_visible(chunk.centre_, chunk.radius_)) continue;
+
+            // the only level of detail there is, chunks too small to matter are left on disk
+            double distance = -camera_.to_view(chunk.centre_, view_rotation_).z;
+            // finite stand in for infinity, -ffast-math may fold comparisons against it
+            double size = distance > chunk.radius_ ? 2 * chunk.radius_ * dtp / distance : std::numeric_limits<double>::max();
+            if (size < stream_min_size_) continue;
+
+            stream_candidates_.emplace_back(size, c);
+        }
+
+        // largest on screen first, so a tight budget keeps what covers the most pixels
+        std::sort(stream_candidates_.begin(), stream_candidates_.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first;
+        });
+
+        stream_wanted_.clear();
+
+        for (const auto& [size, c] : stream_candidates_) {
+            stream_wanted_.push_back(c);
+        }
+
+        // new arrivals and evictions change what is drawn without any object moving
+        if (streamed->update(stream_wanted_, frame_objects_)) {
+            redraw_all_ = true;
+            shadow_dirty_ = true;
+        }
+    }
+}
+
+ThreeDL::FrameUpdate ThreeDL::Renderer::detect_changes() {
+    if (!incremental_) return FrameUpdate::full;
+
+    std::array<Vec3, 3> view_rotation = camera_.view_rotation();
+
+    bool full = redraw_all_ ||
+                object_states_.size() != frame_objects_.size() ||
+                camera_.position_ != last_camera_position_ ||
+                view_rotation != last_view_rotation_ ||
+                debug_lines_.revision() != debug_revision_;
+
+    redraw_all_ = false;
+    debug_revision_ = debug_lines_.revision();
+    last_camera_position_ = camera_.position_;
+    last_view_rotation_ = view_rotation;
+
+    object_states_.resize(frame_objects_.size());
+    object_changed_.assign(frame_objects_.size(), false);
+    changed_objects_.clear();
+
+    // a replaced or edited mesh, or one turned see through, is redrawn like a moved object
+    for (uint32_t i = 0; i < frame_objects_.size(); ++i) {
+        const Object& object = *frame_objects_[i];
+        std::tuple<Vec3, Vec3, uint64_t, double> state = {object.position_, object.rotation_, object.mesh_.generation(), object.mesh_.opacity_};
+        if (state == object_states_[i]) continue;
+
+        object_states_[i] = state;
+        object_changed_[i] = true;
+        changed_objects_.push_back(i);
+    }
+
+    if (full) return FrameUpdate::full;
+    if (changed_objects_.empty()) return FrameUpdate::none;
+
+    // what a moved occluder uncovers was culled, so it has no rectangle to redraw
+    if (occlusion_culling_) {
+        for (uint32_t id : changed_objects_) {
+            if (frame_objects_[id]->occluder_) return FrameUpdate::full;
+        }
+    }
+
+    // rays can be shadowed by anything, so a traced frame is never patched, nor is one whose shadow map moved,
+    // lines cross the rectangles that would be redrawn, and samples are cleared as they are resolved so a
+    // multisampled frame has nothing under its rectangles to redraw against
+    bool patchable = render_mode_ == RenderMode::rasterise && !msaa_ && !shadows_mapped() && !lines_active();
+    return patchable ? FrameUpdate::partial : FrameUpdate::full;
+}
+
+void ThreeDL::Renderer::set_up_batches(size_t begin) {
+    jobs().parallel_for(begin, batch_count_, batch_grain_, [this](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            setup_batch(batches_[b]);
+        }
+    });
+}
+
+SDL_Rect ThreeDL::Renderer::batch_bounds(size_t begin, size_t end) const {
+    double x_min = INFINITY;
+    double y_min = INFINITY;
+    double x_max = -INFINITY;
+    double y_max = -INFINITY;
+
+    for (size_t b = begin; b < end; ++b) {
+        for (const auto& [local_id, projected] : batches_[b].projected_) {
+            for (const Vec2& vertex : projected.vertices_) {
+                x_min = std::min(x_min, vertex.x);
+                y_min = std::min(y_min, vertex.y);
+                x_max = std::max(x_max, vertex.x);
+                y_max = std::max(y_max, vertex.y);
+            }
+        }
+    }
+
+    if (x_min > x_max) return {0, 0, 0, 0};
+
+    // a pixel of margin on each side covers how the span ends are rounded
+    int left = static_cast<int>(std::floor(std::clamp(x_min, -1.0, static_cast<double>(render_width_)))) - 1;
+    int top = static_cast<int>(std::floor(std::clamp(y_min, -1.0, static_cast<double>(render_height_)))) - 1;
+    int right = static_cast<int>(std::ceil(std::clamp(x_max, -1.0, static_cast<double>(render_width_)))) + 2;
+    int bottom = static_cast<int>(std::ceil(std::clamp(y_max, -1.0, static_cast<double>(render_height_)))) + 2;
+
+    left = std::max(left, 0);
+    top = std::max(top, 0);
+    right = std::min(right, render_width_);
+    bottom = std::min(bottom, render_height_);
+
+    if (left >= right || top >= bottom) return {0, 0, 0, 0};
+
+    return {left, top, right - left, bottom - top};
+}
+
+void ThreeDL::Renderer::add_dirty_rect(const SDL_Rect& rect) {
+    if (rect.w <= 0 || rect.h <= 0) return;
+
+    SDL_Rect merged = rect;
+
+    // overlapping rectangles are merged so no pixel is cleared or rasterised twice,
+    // starting over each time since the grown one may now overlap rectangles already passed
+    for (size_t i = 0; i < dirty_rects_.size();) {
+        if (!SDL_HasIntersection(&merged, &dirty_rects_[i])) {
+            ++i;
+            continue;
+        }
+
+        SDL_UnionRect(&merged, &dirty_rects_[i], &merged);
+        dirty_rects_[i] = dirty_rects_.back();
+        dirty_rects_.pop_back();
+        i = 0;
+    }
+
+    dirty_rects_.push_back(merged);
+}
+
+void ThreeDL::Renderer::clear_dirty_rects() {
+    Uint32 background = pack_color({0, 0, 0, 255});
+
+    for (const SDL_Rect& rect : dirty_rects_) {
+        for (int y = rect.y; y < rect.y + rect.h; ++y) {
+            size_t index = static_cast<size_t>(y) * render_width_ + rect.x;
+
+            kernels_->fill_pixels(&framebuffer_[index], rect.w, background);
+            zbuffer_.clear_span(index, rect.w, *kernels_);
+
+            if (shading_mode_ == ShadingMode::deferred) {
+                kernels_->fill_pixels(&vbuffer_[index], rect.w, 0);
+            }
+        }
+    }
+}
+
+ThreeDL::Renderer::~Renderer() {
+    if (frame_texture_ != nullptr) {
+        SDL_DestroyTexture(frame_texture_);
+    }
+
+    if (!owns_textures_) return;
+
     for (const auto& object : render_queue_) {
         if (object == nullptr) continue;
         if (object->mesh_.texture_ == nullptr) continue;
         SDL_FreeSurface(object->mesh_.texture_);
     }   
-}
\ No newline at end of file
+}
\ No newline at end of file
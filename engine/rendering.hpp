@@ -4,16 +4,158 @@
 
 #include <algorithm>
 //#include <SDL2/SDL_image.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <tuple>
 #include <unordered_map>
 
+#include "bvh.hpp"
 #include "camera.hpp"
+#include "depth.hpp"
+#include "jobs.hpp"
+#include "kernels.hpp"
+#include "lighting.hpp"
 #include "objects.hpp"
+#include "occlusion.hpp"
+#include "points.hpp"
+#include "scaling.hpp"
+#include "scene.hpp"
+#include "sorting.hpp"
+#include "streaming.hpp"
+#include "terrain.hpp"
+#include "tiles.hpp"
 #include "utils.hpp"
+#include "wireframe.hpp"
 
 namespace ThreeDL {
+    enum class RenderMode {
+        rasterise,
+        ray_trace  // one primary ray per pixel against a BVH over the scene, parallel over screen tiles
+    };
+
+    enum class WireframeMode {
+        off,
+        overlay,  // mesh edges over the shaded frame
+        only      // mesh edges alone, no triangles are filled
+    };
+
+    enum class ShadingMode {
+        forward,  // shade while rasterising
+        deferred  // rasterise ids into the visibility buffer, then shade each pixel once
+    };
+
+    // bits of a raster variant, every combination is instantiated so a triangle's pixels only run what it needs
+    namespace RasterFeature {
+        constexpr uint32_t deferred = 1;  // write the visibility buffer, shading happens after
+        constexpr uint32_t textured = 2;
+        constexpr uint32_t smooth = 4;    // vertex colours differ, so colour is interpolated
+        constexpr uint32_t transparent = 8;  // accumulate into the transparency buffers, never deferred
+        constexpr uint32_t shadowed = 16;    // blend towards the shadowed colours by the shadow map
+        constexpr uint32_t variant_count = 32;
+    };
+
+    // view space triangle referenced by an entry of the visibility buffer
+    class VisibleTriangle {
+        public:
+            VisibleTriangle(const GSPTriangle& triangle, SDL_Surface* texture, uint32_t object_id, uint32_t triangle_id);
+            VisibleTriangle() = delete;
+
+            GSPTriangle triangle_;
+            SDL_Surface* texture_;
+
+            // lit vertex colours, 0-255 per channel, and the same without the shadow map's light
+            Vec3 colors_[3];
+            Vec3 shadow_colors_[3];
+
+            // for a view ray r through a pixel, barycentrics are (r.b1, r.b2) / r.det
+            Vec3 det_;
+            Vec3 b1_;
+            Vec3 b2_;
+
+            uint32_t object_id_;
+            uint32_t triangle_id_;
+
+            // RasterFeature bits other than deferred, known once the triangle is lit
+            uint32_t features_ = 0;
+            // the mesh's, only read by the transparent variants
+            float opacity_ = 1;
+
+            ~VisibleTriangle() = default;
+    };
+
+    // transform, cull and clip work for up to one cluster of an object's triangles, set up on
+    // whichever thread picks it up and merged back in draw order so the frame matches a serial one
+    class GeometryBatch {
+        public:
+            const PreparedObject* prepared_;
+            uint32_t object_id_;
+
+            // ids picks the triangles, or without it they run from first
+            const uint32_t* ids_;
+            uint32_t first_;
+            uint32_t count_;
+
+            // takes the object's triangles to view space, mesh space for compressed meshes
+            std::array<Vec3, 3> rotation_;
+            Vec3 translation_;
+
+            // output, the visibility id of a projected triangle is its index into visible_ + 1
+            std::vector<VisibleTriangle> visible_;
+            std::vector<std::pair<uint32_t, SSPTriangle>> projected_;
+
+            // view space vertices and clip outcodes, three per triangle
+            std::vector<Vec3> view_vertices_;
+            std::vector<uint8_t> codes_;
+    };
+
+    enum class DrawOrder {
+        submission,  // render_queue_ order
+        front_to_back
+    };
+
+    // what the last frame had to redraw
+    enum class FrameUpdate {
+        none,     // nothing changed, the previous frame was presented again
+        partial,  // only the screen rectangles of objects that moved
+        full
+    };
+
+    // per frame counters, overdraw is depth passing fragments per covered pixel, multisampled fragments
+    // are tested per sample and written per pixel shaded
+    class RenderStats {
+        public:
+            uint64_t fragments_tested_ = 0;
+            uint64_t fragments_written_ = 0;
+            uint64_t pixels_covered_ = 0;
+            uint32_t objects_drawn_ = 0;
+            // splatted inside the screen, before the depth test
+            uint64_t points_drawn_ = 0;
+            // 0 when the cached shadow map was still good
+            uint32_t shadow_maps_drawn_ = 0;
+            // wireframe edges and debug lines with something left on screen after clipping
+            uint64_t lines_drawn_ = 0;
+            // in the view but wholly behind the occluders, none of their triangles were touched
+            uint32_t objects_occluded_ = 0;
+
+            double overdraw() const {
+                return pixels_covered_ ? static_cast<double>(fragments_written_) / pixels_covered_ : 0;
+            }
+    };
+
+    Uint32 pack_color(const SDL_Color& color);
+
     class Renderer {
         public:
             Renderer(SDL_Renderer* renderer, SDL_Window* window, Camera& camera, int width, int height);
+
+            // tests/bench.cpp times the private stages directly
+            friend class RendererBench;
+            // headless, frames are only kept in memory and the objects' textures are not owned
+            Renderer(Camera& camera, int width, int height);
             Renderer() = delete;
 
             // debug
@@ -23,10 +165,216 @@ namespace ThreeDL {
             // end debug
 
             void add(Object* object);
+            // drawn alongside the render queue, chunks are requested as they come into view and drawn once resident
+            void add(StreamedScene* scene);
+            // patches are picked for the camera each frame and drawn alongside the render queue, not owned
+            void add(Terrain* terrain);
+            // splatted after the triangles are shaded, not owned, call invalidate after changing its points
+            void add(PointCloud* cloud);
             void main_loop();
 
+            // renders without touching input, frame() holds the result at window size
+            void render_frame();
+            // renders a scene prepared elsewhere, so several views can share one world space snapshot
+            void render_prepared(const PreparedScene& scene);
+            const std::vector<Uint32>& frame() const;
+
+            void set_render_mode(RenderMode mode) {
+                render_mode_ = mode;
+                redraw_all_ = true;
+            }
+
+            // ray trace only, casts a ray towards every light from each lit pixel
+            void set_shadows(bool enabled) {
+                shadows_ = enabled;
+                redraw_all_ = true;
+            }
+
+            void set_shading_mode(ShadingMode mode) {
+                shading_mode_ = mode;
+                redraw_all_ = true;
+            }
+
+            void set_lighting_mode(LightingMode mode) {
+                lighting_mode_ = mode;
+                redraw_all_ = true;
+            }
+
+            void set_ambient(const SDL_Color& ambient) {
+                lighting_.ambient_ = ambient;
+                redraw_all_ = true;
+            }
+
+            void add_light(const DirectionalLight& light);
+            void add_light(const PointLight& light);
+
+            // dynamic resolution, the scale applies to both axes of the internal render target
+            void set_dynamic_resolution(bool enabled) {
+                dynamic_resolution_ = enabled;
+            }
+
+            void set_frame_budget(double budget_ms) {
+                resolution_.set_budget(budget_ms);
+            }
+
+            void set_upscale_filter(UpscaleFilter filter) {
+                upscaler_.filter_ = filter;
+                redraw_all_ = true;
+            }
+
+            void set_render_scale(double scale);
+
+            void set_draw_order(DrawOrder order) {
+                draw_order_ = order;
+                redraw_all_ = true;
+            }
+
+            // front to back only, also orders the triangle clusters inside each mesh
+            void set_sort_clusters(bool enabled) {
+                sort_clusters_ = enabled;
+                redraw_all_ = true;
+            }
+
+            // pixels_covered_ needs an extra pass over the depth buffer so it is opt in
+            void set_collect_stats(bool enabled) {
+                collect_stats_ = enabled;
+            }
+
+            const RenderStats& stats() const {
+                return stats_;
+            }
+
+            // keeps a copy of the depth buffer after each frame, for comparing against reference depth
+            void set_capture_depth(bool enabled) {
+                capture_depth_ = enabled;
+            }
+
+            // float64 keeps -1/z exactly, the compact formats take 2-4x less depth bandwidth, the unorm ones spread
+            // their steps over the depth of what is in view each frame
+            void set_depth_format(DepthFormat format) {
+                zbuffer_.set_format(format);
+                redraw_all_ = true;
+            }
+
+            DepthFormat depth_format() const {
+                return zbuffer_.format();
+            }
+
+            // last captured frame at render size, -1/z so larger is closer, -INFINITY where nothing was drawn
+            const std::vector<double>& depth() const {
+                return depth_;
+            }
+
+            // keeps the frame, depth and visibility buffers between frames and compares the camera and each
+            // object's transform against the last frame, redrawing nothing or only the rectangles that moved,
+            // a multisampled frame that changed at all is always drawn in full
+            void set_incremental(bool enabled) {
+                incremental_ = enabled;
+                redraw_all_ = true;
+            }
+
+            // the next frame is drawn in full, for changes to meshes, textures or lights the renderer cannot see
+            void invalidate() {
+                redraw_all_ = true;
+                shadow_dirty_ = true;
+                edge_lists_.clear();
+            }
+
+            // rasterised pixels lit by this directional light look it up in a depth map drawn from the light,
+            // fitted around the whole scene and only redrawn when the light or an object moves, -1 turns it off,
+            // terrain patches and streamed chunks only cast while they are in view as only those are gathered
+            void set_shadow_light(int light, int resolution = 1024) {
+                shadow_light_ = light;
+                shadow_resolution_ = std::max(1, resolution);
+                shadow_dirty_ = true;
+                redraw_all_ = true;
+            }
+
+            // 2x2 percentage closer filtering, bilinearly weighted, otherwise the nearest texel
+            void set_shadow_pcf(bool enabled) {
+                shadow_pcf_ = enabled;
+                redraw_all_ = true;
+            }
+
+            // objects marked as occluders are drawn first into a width by height depth buffer, then every other
+            // object whose bounding sphere is wholly behind them is dropped before it is clipped or rasterised,
+            // full frames only, a moving occluder makes the frame a full one, an object seen only through a gap
+            // between occluders narrower than about one buffer pixel may be dropped, see OcclusionBuffer
+            void set_occlusion_culling(bool enabled, int width = 256, int height = 128) {
+                occlusion_culling_ = enabled;
+                occlusion_.resize(width, height);
+                redraw_all_ = true;
+            }
+
+            // 4x multisampled rasterisation, coverage and depth are tested per sample and each pixel is shaded
+            // once for all the samples a triangle wins, points and transparent meshes are still drawn per pixel
+            void set_msaa(bool enabled) {
+                msaa_ = enabled;
+                redraw_all_ = true;
+            }
+
+            // each edge shared by several triangles is drawn once, lines go straight into the frame after
+            // everything else is drawn and the frame is always drawn in full while they are on
+            void set_wireframe(WireframeMode mode, const SDL_Color& color = {255, 255, 255, 255}) {
+                wireframe_mode_ = mode;
+                wireframe_color_ = pack_color(color);
+                redraw_all_ = true;
+
+                if (mode == WireframeMode::off) edge_lists_.clear();
+            }
+
+            // wireframe and debug lines behind what is in the depth buffer are hidden, on by default
+            void set_line_depth_test(bool enabled) {
+                line_depth_test_ = enabled;
+                redraw_all_ = true;
+            }
+
+            // drawn over every frame while enabled and not empty
+            DebugLines& debug_lines() {
+                return debug_lines_;
+            }
+
+            FrameUpdate last_update() const {
+                return last_update_;
+            }
+
+            // width of the square each point covers
+            void set_point_size(int pixels) {
+                point_size_ = std::max(1, pixels);
+                redraw_all_ = true;
+            }
+
+            // streamed chunks whose bounding sphere spans fewer pixels than this are neither drawn nor read
+            void set_stream_min_size(double pixels) {
+                stream_min_size_ = pixels;
+            }
+
             ~Renderer();
         private:
+            // the rows of a screen space triangle as the scanline loop walks them, top down, with each pixel
+            // sampled sample_x, sample_y away from where it is otherwise
+            class TriangleRows {
+                public:
+                    TriangleRows(const SSPTriangle& triangle, double sample_x, double sample_y);
+                    TriangleRows() = delete;
+
+                    // rows bottom_ < row <= top_
+                    int top_;
+                    int bottom_;
+
+                    // false when the row has no pixels inside scissor, otherwise its pixels and edge intersections
+                    bool span(int row, const SDL_Rect& scissor, int& y, int& x_min, int& count, Vec2& a, Vec2& b) const;
+                private:
+                    std::array<Vec2, 3> vertices_;  // top to bottom
+                    int middle_;
+                    Vec2 long_edge_;
+                    Vec2 upper_edge_;
+                    Vec2 lower_edge_;
+                    Line long_line_;
+                    Line upper_line_;
+                    Line lower_line_;
+            };
+
             SDL_Renderer* renderer_;
             SDL_Window* window_;
 
@@ -35,26 +383,298 @@ namespace ThreeDL {
             const double tan_theta_2_ = 0.73205080757;
             const double hf_fov_ = 36.2060231;
 
+            // near, left & right, view space
+            const std::vector<Plane> clip_planes_ = build_clip_planes(hf_fov_);
+
+            // window size
             int width_;
             int height_;
 
-            std::vector<double> zbuffer_;
+            // internal render target size, every buffer below is indexed with these
+            int render_width_;
+            int render_height_;
+
+            bool dynamic_resolution_ = false;
+            ResolutionController resolution_ = {16.6, 0.5, 1.0};
+            Upscaler upscaler_;
+            std::vector<Uint32> output_buffer_;
+
+            DepthBuffer zbuffer_;
+            std::vector<Uint32> framebuffer_;
             std::vector<Object*> render_queue_;
 
+            // render_queue_ followed by the resident visible chunks of every streamed scene, rebuilt each frame
+            std::vector<StreamedScene*> streamed_scenes_;
+            std::vector<Terrain*> terrains_;
+            std::vector<Object*> frame_objects_;
+            std::vector<std::pair<double, uint32_t>> stream_candidates_;
+            std::vector<uint32_t> stream_wanted_;
+            double stream_min_size_ = 2;
+
+            // point clouds, the nearest splat per pixel is kept as its -1/z float bits above its colour so an
+            // atomic max picks it without locks whatever order threads get there, 0 is empty
+            std::vector<PointCloud*> point_clouds_;
+            int point_size_ = 1;
+            std::unique_ptr<std::atomic<uint64_t>[]> splats_;
+            static constexpr size_t point_grain_ = 16384;
+            static constexpr size_t point_batch_ = 1024;
+
+            SDL_Texture* frame_texture_ = nullptr;
+            bool owns_textures_ = true;
+
+            // deferred shading, 0 marks an empty pixel, otherwise index + 1 into visible_triangles_
+            ShadingMode shading_mode_ = ShadingMode::forward;
+            std::vector<uint32_t> vbuffer_;
+            std::vector<VisibleTriangle> visible_triangles_;
+
+            // lighting runs per object between clipping and rasterisation
+            LightingMode lighting_mode_ = LightingMode::unlit;
+            Lighting lighting_;
+            LightingBatch lighting_batch_;
+
+            // picked once per frame so force_simd_level takes effect on the next one
+            const Kernels* kernels_ = &kernels();
+            // batches for the whole frame, kept between frames so their buffers are reused,
+            // object_batches_[i] is the [begin, end) run of object_order_[i]
+            std::vector<GeometryBatch> batches_;
+            size_t batch_count_ = 0;
+            std::vector<std::pair<size_t, size_t>> object_batches_;
+            static constexpr size_t batch_grain_ = 4;
+            // depth test results of the span being rasterised
+            std::vector<uint8_t> span_pass_;
+
+            // draw ordering
+            DrawOrder draw_order_ = DrawOrder::submission;
+            bool sort_clusters_ = false;
+            std::array<Vec3, 3> view_rotation_;
+            PreparedScene scene_;
+            std::vector<SortItem> object_order_;
+            std::vector<SortItem> cluster_order_;
+            std::vector<SortItem> sort_scratch_;
+            std::vector<double> sort_depths_;
+
+            bool collect_stats_ = false;
+            RenderStats stats_;
+
+            bool capture_depth_ = false;
+            std::vector<double> depth_;
+
+            // incremental redraw, state from the last frame drawn and the rectangles being redrawn,
+            // on a full frame dirty_rects_ is the whole render target
+            bool incremental_ = false;
+            bool redraw_all_ = true;
+            FrameUpdate last_update_ = FrameUpdate::full;
+            Vec3 last_camera_position_;
+            std::array<Vec3, 3> last_view_rotation_;
+            // position, rotation, mesh generation and opacity of every frame_objects_ entry
+            std::vector<std::tuple<Vec3, Vec3, uint64_t, double>> object_states_;
+            std::vector<uint32_t> changed_objects_;
+            std::vector<bool> object_changed_;
+            // screen rectangle each object covered last frame, empty when it was culled
+            std::vector<SDL_Rect> object_bounds_;
+            std::vector<SDL_Rect> dirty_rects_;
+            // rasterisation is clipped to this, one of dirty_rects_
+            SDL_Rect scissor_ = {0, 0, 0, 0};
+            // beyond this fraction of the target a single full redraw is cheaper than many rectangles
+            static constexpr double max_dirty_fraction_ = 0.5;
+
+            // weighted blended order independent transparency, meshes with opacity below 1 are held back until
+            // everything opaque is drawn, then accumulate into four planes of premultiplied colour and weight
+            // and one of revealage, tested against the depth buffer without writing it, and resolved in one sweep
+            std::vector<size_t> transparent_objects_;
+            bool transparent_pass_ = false;
+            std::vector<float> accumulation_;
+            std::vector<float> revealage_;
+
+            // shadow map, light space is x and y across the map and depth along the light, stored as 1 at the
+            // nearest point of the scene to the light falling to 0 at the farthest
+            int shadow_light_ = -1;
+            int shadow_resolution_ = 1024;
+            bool shadow_pcf_ = true;
+            DepthBuffer shadow_map_ = {1, 1, DepthFormat::float32};
+            int shadow_map_resolution_ = 0;
+            std::vector<uint8_t> shadow_pass_;
+            std::vector<Vec3> shadow_vertices_;
+            // world or view space point to map pixel x, y and stored depth, rows then offset
+            std::array<Vec3, 3> world_to_shadow_;
+            Vec3 world_to_shadow_offset_;
+            std::array<Vec3, 3> view_to_shadow_;
+            Vec3 view_to_shadow_offset_;
+            double shadow_bias_depth_ = 0;
+            // what the cached map was drawn from
+            bool shadow_dirty_ = true;
+            Vec3 shadow_direction_;
+            // mesh generation and transform of each caster, pointers alone miss a mesh rebuilt at a freed address
+            std::vector<std::tuple<uint64_t, Vec3, Vec3>> shadow_casters_;
+            // in map texels, against acne on surfaces facing the light
+            static constexpr double shadow_bias_texels_ = 1.5;
+            // the slope bias of a surface turned nearly edge on to the light stops at this many texels of depth
+            static constexpr double shadow_slope_texels_ = 16;
+
+            // multisampling, the samples of a row are sample_count_ rows of their own side by side, so a row walk
+            // stays in cache, depth kept in the depth buffer's format, and the colours are averaged into the frame
+            // before anything per pixel is drawn over it
+            bool msaa_ = false;
+            bool sampling_ = false;  // msaa_ on a rasterised frame
+            DepthBuffer sample_depth_ = {1, 1};
+            std::vector<Uint32> sample_colors_;
+            std::vector<uint32_t> sample_ids_;  // deferred, as vbuffer_
+            // bit s set for each sample of a pixel the triangle being drawn won, along the row being drawn
+            std::vector<uint8_t> sample_masks_;
+            // per row, what this frame's triangles sampled, which is what gets resolved
+            std::vector<std::pair<int, int>> sample_extents_;
+            static constexpr int sample_count_ = 4;
+            // rotated grid about the pixel centre, in pixels, the row walk itself samples pixel x, y at x + 1, y
+            static constexpr double sample_offsets_[sample_count_][2] = {
+                {-0.125, -0.375}, {0.375, -0.125}, {-0.375, 0.125}, {0.125, 0.375}
+            };
+
+            // lines, mesh edges are extracted the first time a mesh is drawn as a wireframe and looked up by
+            // Mesh::generation, dropped once a frame passes without the mesh
+            WireframeMode wireframe_mode_ = WireframeMode::off;
+            Uint32 wireframe_color_ = 0xffffffff;
+            bool line_depth_test_ = true;
+            DebugLines debug_lines_;
+            uint64_t debug_revision_ = 0;  // of the lines in the last frame
+            std::unordered_map<uint64_t, std::pair<EdgeList, uint64_t>> edge_lists_;
+            uint64_t line_frame_ = 0;
+            // edge list positions in view space, then on screen with -1/z, depth_info_ is 0 behind the near plane
+            std::vector<Vec3> edge_view_;
+            std::vector<Vec2> edge_screen_;
+            // depth test slack, a fraction of -1/z plus steps of the depth buffer's own slope, so an edge is not
+            // hidden by the triangles it belongs to
+            static constexpr double line_depth_bias_ = 1e-3;
+            static constexpr double line_slope_bias_ = 2;
+            static constexpr size_t edge_grain_ = 4096;
+
+            // occlusion culling, the view space corners of one occluder at a time
+            bool occlusion_culling_ = false;
+            OcclusionBuffer occlusion_{256, 128};
+            std::vector<Vec3> occluder_view_;
+
+            // ray tracing, mesh hierarchies are kept between frames and only the top level is rebuilt
+            RenderMode render_mode_ = RenderMode::rasterise;
+            bool shadows_ = false;
+            SceneBVH bvh_;
+            static constexpr int trace_tile_size_ = 16;
+            // shadow rays start this far off the surface, towards the side the primary ray came from
+            static constexpr double shadow_bias_ = 1e-4;
+
             // utils
             void putpixel(int x, int y, const SDL_Color& color);
-            void draw_line(const Line& line, const SDL_Color& color);
+            // clipped to the render target once, then stepped straight through the frame, a and b carry -1/z
+            void draw_line(Vec2 a, Vec2 b, Uint32 color);
+            bool line_visible(int x, int y, double depth) const;
             void clear(const SDL_Color& color);
+            void present();
+            void present_cached();
+            void resize_render_target(int width, int height);
+
+            // rendering functions, batches are queued serially, set up in parallel, then lit and rasterised in order
+            std::pair<size_t, size_t> queue_batches(const PreparedObject& prepared, uint32_t object_id);
+            void setup_batch(GeometryBatch& batch) const;
+            void render_object(size_t order_index);
+            // the prepared triangle, or for compressed meshes one decoded into decoded and moved to world space
+            const GSPTriangle& world_triangle(const PreparedObject& prepared, uint32_t triangle_id, GSPTriangle& decoded) const;
+            void setup_triangle(GeometryBatch& batch, const GSPTriangle& triangle, const Vec3* view_vertices, const uint8_t* codes, uint32_t triangle_id) const;
+            void rasterise_triangle(const SSPTriangle& triangle, uint32_t visibility_id);
+            // walks the rows of a screen space triangle inside scissor, calling visit(y, x_min, count, a, b) per span
+            // with a and b the row's edge intersections, shared by the main and the depth only passes
+            template <typename SpanVisitor>
+            static void scan_triangle(const SSPTriangle& triangle, const SDL_Rect& scissor, SpanVisitor&& visit);
+            std::vector<GSPTriangle> clip_to_plane(const GSPTriangle& triangle, const Plane& plane, bool side) const;
+            std::vector<GSPTriangle> clip_to_plane(const std::vector<GSPTriangle>& triangle, const Plane& plane, bool side) const;
+            std::vector<GSPTriangle> clip_triangle(const GSPTriangle& triangle, const uint8_t* codes) const;
+            static std::vector<Plane> build_clip_planes(double hf_fov);
+            SSPTriangle project(const GSPTriangle& triangle) const;
+            void light_triangles(const Mesh& mesh, size_t first_visible);
+            // frustum cull against the camera, then sort when drawing front to back
+            bool sphere_visible(const Vec3& centre, double radius) const;
+            // nearest and farthest distance in front of the eye anything in view can be drawn at, the last
+            // range when nothing is
+            std::pair<double, double> depth_range(const PreparedScene& scene) const;
+            void order_objects(const PreparedScene& scene);
+            void order_clusters(const PreparedObject& prepared);
+            // mesh space straight to view space, the object transform folded into the view transform
+            void object_view_transform(const PreparedObject& prepared, std::array<Vec3, 3>& rotation, Vec3& translation) const;
+
+            // occlusion culling, drops what the occluders hide from object_order_
+            void cull_occluded(const PreparedScene& scene);
+            void draw_occluder(const PreparedObject& prepared);
+            bool object_occluded(const PreparedObject& prepared) const;
+
+            void gather_objects();
+
+            // incremental redraw
+            FrameUpdate detect_changes();
+            void draw_all(const PreparedScene& scene);
+            void draw_changes(const PreparedScene& scene);
+            void set_up_batches(size_t begin);
+            // screen rectangle covered by the projected triangles of batches [begin, end), empty if none
+            SDL_Rect batch_bounds(size_t begin, size_t end) const;
+            void add_dirty_rect(const SDL_Rect& rect);
+            void clear_dirty_rects();
+
+            // deferred shading
+            void shade_visibility_buffer();
+            void shade_rows(const SDL_Rect& rect, int y_start, int y_end);
+            SDL_Color shade_pixel(const VisibleTriangle& visible, int x, int y) const;
+
+            // raster variants, chosen once per triangle through these tables
+            template <uint32_t Features>
+            SDL_Color shade_pixel(const VisibleTriangle& visible, int x, int y) const;
+            // a and b are the span's ends as passed to the depth test
+            template <uint32_t Features>
+            void write_span(uint32_t visibility_id, int y, int x_start, int count, const uint8_t* pass, const Vec2& a, const Vec2& b);
+
+            using PixelShader = SDL_Color (Renderer::*)(const VisibleTriangle& visible, int x, int y) const;
+            using SpanWriter = void (Renderer::*)(uint32_t visibility_id, int y, int x_start, int count, const uint8_t* pass, const Vec2& a, const Vec2& b);
+            static const std::array<PixelShader, RasterFeature::variant_count> pixel_shaders_;
+            static const std::array<SpanWriter, RasterFeature::variant_count> span_writers_;
+            // lit colour, 0-255 per channel, modulated by the texture at barycentrics (b1, b2) when there is one
+            static SDL_Color surface_color(const Vec3& color, SDL_Surface* texture, const std::vector<Vec2>& uvs, double b1, double b2);
+
+            // shadow map, depth only from the light, redrawn when what it was drawn from changed
+            bool shadows_mapped() const;
+            void update_shadow_map(const PreparedScene& scene);
+            void draw_shadow_map(const PreparedScene& scene);
+            // fraction of the shadow light reaching a view space point on the triangle with these view space
+            // vertices, 1 outside the map
+            double shadow_visibility(const Vec3& point, const std::vector<Vec3>& vertices) const;
+
+            // multisampling
+            void prepare_samples();
+            void rasterise_samples(const SSPTriangle& triangle, uint32_t visibility_id);
+            void shade_sample_rows(const SDL_Rect& rect, int y_start, int y_end);
+            void resolve_samples();
+
+            size_t sample_index(int sample, int y, int x) const {
+                return (static_cast<size_t>(y) * sample_count_ + sample) * render_width_ + x;
+            }
+
+            // transparency, drawn after the opaque shading and the point splats
+            void draw_transparent();
+            void resolve_transparency(const SDL_Rect& rect, int y_start, int y_end);
+
+            // point clouds, splatted into splats_ in parallel then resolved against the depth buffer
+            void splat_points();
+            uint64_t splat_range(const PointCloud& cloud, size_t begin, size_t end, const SDL_Rect& bounds);
+            void resolve_splats(const SDL_Rect& rect, int y_start, int y_end);
+
+            // wireframe and debug lines, over the finished frame
+            bool lines_active() const;
+            void draw_lines(const PreparedScene& scene);
+            void draw_edges(const PreparedObject& prepared);
+            // view space, clipped against the near plane
+            void draw_view_line(Vec3 a, Vec3 b, Uint32 color);
+            Vec2 project_point(const Vec3& view) const;
 
-            // rendering functions
-            void render_object(const Object& object);
-            void render_triangle(const GSPTriangle& triangle, SDL_Surface* texture);
-            void rasterise_triangle(const SSPTriangle& triangle, SDL_Surface* texture);
-            std::vector<GSPTriangle> clip_to_plane(const GSPTriangle& triangle, const Plane& plane, bool side);
-            std::vector<GSPTriangle> clip_to_plane(const std::vector<GSPTriangle>& triangle, const Plane& plane, bool side);
-            std::vector<GSPTriangle> clip_triangle(const GSPTriangle& triangle);
-            SSPTriangle project(const GSPTriangle& triangle);
+            // ray tracing
+            void trace(const PreparedScene& scene);
+            void trace_tile(const PreparedScene& scene, const SDL_Rect& tile);
+            uint32_t trace_shadows(const Vec3& point) const;
 
             void render();
+            void draw(const PreparedScene& scene, FrameUpdate update = FrameUpdate::full);
     };
-};
\ No newline at end of file
+};
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "scaling.hpp"
+
+ThreeDL::ResolutionController::ResolutionController(double budget_ms, double min_scale, double max_scale)
+    : budget_ms_(budget_ms),
+      min_scale_(min_scale),
+      max_scale_(max_scale)
+{}
+
+bool ThreeDL::ResolutionController::add_frame(double frame_ms) {
+    history_[frame_count_++] = frame_ms;
+
+    if (frame_count_ < history_size_) return false;
+    frame_count_ = 0;
+
+    double average = 0;
+    for (double time : history_) average += time;
+    average /= history_size_;
+
+    // frame cost follows pixel count, which goes with the square of the scale
+    double target = scale_ * std::sqrt(budget_ms_ / average);
+
+    // drop quickly when over budget, climb back slowly and only with clear headroom
+    if (average > budget_ms_) {
+        target = std::max(target, scale_ * 0.8);
+    } else if (average < budget_ms_ * 0.8) {
+        target = std::min(target, scale_ * 1.05);
+    } else {
+        return false;
+    }
+
+    double previous = scale_;
+    set_scale(target);
+
+    return std::abs(scale_ - previous) > 0.01;
+}
+
+// blends two packed pixels, weight 0-256 towards b, two channels per multiply
+static inline Uint32 lerp_pixel(Uint32 a, Uint32 b, Uint32 weight) {
+    Uint32 inverse = 256 - weight;
+    Uint32 rb = (((a & 0x00ff00ff) * inverse + (b & 0x00ff00ff) * weight) >> 8) & 0x00ff00ff;
+    Uint32 ag = (((a >> 8) & 0x00ff00ff) * inverse + ((b >> 8) & 0x00ff00ff) * weight) & 0xff00ff00;
+    return rb | ag;
+}
+
+void ThreeDL::Upscaler::upscale(const std::vector<Uint32>& src, int src_width, int src_height, std::vector<Uint32>& dst, int dst_width, int dst_height) {
+    if (src_width != src_width_ || src_height != src_height_ || dst_width != dst_width_ || dst_height != dst_height_) {
+        build_tables(src_width, src_height, dst_width, dst_height);
+    }
+
+    if (filter_ == UpscaleFilter::nearest) {
+        upscale_nearest(src.data(), dst.data());
+    } else {
+        upscale_bilinear(src.data(), dst.data());
+    }
+}
+
+void ThreeDL::Upscaler::build_tables(int src_width, int src_height, int dst_width, int dst_height) {
+    src_width_ = src_width;
+    src_height_ = src_height;
+    dst_width_ = dst_width;
+    dst_height_ = dst_height;
+
+    auto build = [](std::vector<int>& index, std::vector<Uint32>& weight, int src_size, int dst_size) {
+        index.resize(dst_size);
+        weight.resize(dst_size);
+
+        double step = static_cast<double>(src_size) / dst_size;
+
+        for (int i = 0; i < dst_size; ++i) {
+            double position = std::max(0.0, (i + 0.5) * step - 0.5);
+            int base = std::min(static_cast<int>(position), src_size - 1);
+
+            index[i] = base;
+            weight[i] = (base + 1 < src_size) ? static_cast<Uint32>((position - base) * 256) : 0;
+        }
+    };
+
+    build(x_index_, x_weight_, src_width, dst_width);
+    build(y_index_, y_weight_, src_height, dst_height);
+
+    row_.resize(src_width);
+}
+
+void ThreeDL::Upscaler::upscale_nearest(const Uint32* src, Uint32* dst) {
+    for (int y = 0; y < dst_height_; ++y) {
+        const Uint32* src_row = src + static_cast<int>((y + 0.5) * src_height_ / dst_height_) * src_width_;
+        Uint32* dst_row = dst + y * dst_width_;
+
+        for (int x = 0; x < dst_width_; ++x) {
+            // rounded rather than the bilinear floor so it samples the nearest texel
+            dst_row[x] = src_row[std::min(x_index_[x] + (x_weight_[x] >= 128), src_width_ - 1)];
+        }
+    }
+}
+
+void ThreeDL::Upscaler::upscale_bilinear(const Uint32* src, Uint32* dst) {
+    Uint32* __restrict row = row_.data();
+
+    for (int y = 0; y < dst_height_; ++y) {
+        const Uint32* top = src + y_index_[y] * src_width_;
+        const Uint32* bottom = (y_weight_[y] != 0) ? top + src_width_ : top;
+        Uint32 y_weight = y_weight_[y];
+
+        // blend the two source rows once, then each output pixel is a single horizontal blend
+        for (int x = 0; x < src_width_; ++x) {
+            row[x] = lerp_pixel(top[x], bottom[x], y_weight);
+        }
+
+        Uint32* dst_row = dst + y * dst_width_;
+
+        for (int x = 0; x < dst_width_; ++x) {
+            int index = x_index_[x];
+            Uint32 weight = x_weight_[x];
+            dst_row[x] = lerp_pixel(row[index], row[index + (weight != 0)], weight);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace ThreeDL {
+    enum class UpscaleFilter {
+        nearest,
+        bilinear
+    };
+
+    // picks a render scale from recent frame times so frames land inside a budget
+    class ResolutionController {
+        public:
+            ResolutionController(double budget_ms, double min_scale, double max_scale);
+            ResolutionController() = delete;
+
+            // records how long the last frame took, returns true when the scale changed
+            bool add_frame(double frame_ms);
+
+            void set_budget(double budget_ms) {
+                budget_ms_ = budget_ms;
+            }
+
+            void set_scale(double scale) {
+                scale_ = std::clamp(scale, min_scale_, max_scale_);
+            }
+
+            double scale() const {
+                return scale_;
+            }
+
+            ~ResolutionController() = default;
+        private:
+            // frames averaged between adjustments
+            static constexpr int history_size_ = 8;
+
+            double history_[history_size_] = {};
+            int frame_count_ = 0;
+
+            double budget_ms_;
+            double min_scale_;
+            double max_scale_;
+            double scale_ = 1;
+    };
+
+    // stretches the internal render target over the window
+    class Upscaler {
+        public:
+            Upscaler() = default;
+
+            UpscaleFilter filter_ = UpscaleFilter::bilinear;
+
+            void upscale(const std::vector<Uint32>& src, int src_width, int src_height, std::vector<Uint32>& dst, int dst_width, int dst_height);
+
+            ~Upscaler() = default;
+        private:
+            // per destination column / row source index and 8 bit blend weight, rebuilt on size change
+            std::vector<int> x_index_, y_index_;
+            std::vector<Uint32> x_weight_, y_weight_;
+            std::vector<Uint32> row_;
+
+            int src_width_ = 0, src_height_ = 0;
+            int dst_width_ = 0, dst_height_ = 0;
+
+            void build_tables(int src_width, int src_height, int dst_width, int dst_height);
+            void upscale_nearest(const Uint32* src, Uint32* dst);
+            void upscale_bilinear(const Uint32* src, Uint32* dst);
+    };
+};
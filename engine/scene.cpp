@@ -0,0 +1,79 @@
+#include "scene.hpp"
+
+void ThreeDL::PreparedScene::build(const std::vector<Object*>& objects) {
+    objects_.resize(objects.size());
+    triangles_.resize(objects.size());
+    cluster_centres_.resize(objects.size());
+
+    jobs().parallel_for(0, objects.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            build_object(*objects[i], i);
+        }
+    });
+}
+
+void ThreeDL::PreparedScene::rebuild(const std::vector<Object*>& objects, const std::vector<uint32_t>& changed) {
+    if (objects.size() != objects_.size()) {
+        build(objects);
+        return;
+    }
+
+    jobs().parallel_for(0, changed.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            build_object(*objects[changed[i]], changed[i]);
+        }
+    });
+}
+
+void ThreeDL::PreparedScene::build_object(const Object& object, size_t index) {
+    const Mesh& mesh = object.mesh_;
+    PreparedObject& prepared = objects_[index];
+
+    prepared.object_ = &object;
+    prepared.radius_ = mesh.radius_;
+    prepared.rotation_ = {Vec3{1, 0, 0}, Vec3{0, 1, 0}, Vec3{0, 0, 1}};
+
+    std::vector<Vec3>& centres = cluster_centres_[index];
+    centres.resize(mesh.clusters_.size());
+
+    if (!object.has_transform()) {
+        prepared.triangles_ = mesh.compressed_ != nullptr ? nullptr : &mesh.triangles_;
+        prepared.centre_ = mesh.centre_;
+
+        for (size_t c = 0; c < centres.size(); ++c) {
+            centres[c] = mesh.clusters_[c].centre_;
+        }
+
+        prepared.cluster_centres_ = &centres;
+        return;
+    }
+
+    std::array<Vec3, 3> rotation = rotation_matrix(object.rotation_);
+    prepared.rotation_ = rotation;
+
+    std::vector<GSPTriangle>& triangles = triangles_[index];
+    triangles.resize(mesh.triangles_.size());
+
+    // large meshes are split further so one big object does not leave the other workers idle
+    jobs().parallel_for(0, triangles.size(), transform_grain_, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            const GSPTriangle& source = mesh.triangles_[t];
+            GSPTriangle& target = triangles[t];
+
+            target.uvs_ = source.uvs_;
+
+            for (int v = 0; v < 3; ++v) {
+                target.vertices_[v] = apply_rotation(rotation, source.vertices_[v]) + object.position_;
+                target.normals_[v] = apply_rotation(rotation, source.normals_[v]);
+            }
+        }
+    });
+
+    for (size_t c = 0; c < centres.size(); ++c) {
+        centres[c] = apply_rotation(rotation, mesh.clusters_[c].centre_) + object.position_;
+    }
+
+    prepared.triangles_ = mesh.compressed_ != nullptr ? nullptr : &triangles;
+    prepared.centre_ = apply_rotation(rotation, mesh.centre_) + object.position_;
+    prepared.cluster_centres_ = &centres;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "jobs.hpp"
+#include "objects.hpp"
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // world space view of one Object, camera independent so any number of views can share it
+    class PreparedObject {
+        public:
+            const Object* object_;
+
+            // world space triangles, the mesh's own when the object has no transform,
+            // nullptr for compressed meshes which are decoded and transformed where they are used
+            const std::vector<GSPTriangle>* triangles_;
+
+            // mesh to world rotation, identity when the object has no transform
+            std::array<Vec3, 3> rotation_;
+
+            // world space bounding spheres of the mesh and each of its clusters
+            Vec3 centre_;
+            double radius_;
+            const std::vector<Vec3>* cluster_centres_;
+    };
+
+    // per frame world space snapshot of a render queue
+    class PreparedScene {
+        public:
+            PreparedScene() = default;
+
+            std::vector<PreparedObject> objects_;
+
+            void build(const std::vector<Object*>& objects);
+            // rebuilds only the listed indices of a scene last built from the same objects
+            void rebuild(const std::vector<Object*>& objects, const std::vector<uint32_t>& changed);
+
+            ~PreparedScene() = default;
+        private:
+            // transformed copies, kept between builds so steady state rebuilds do not allocate
+            std::vector<std::vector<GSPTriangle>> triangles_;
+            std::vector<std::vector<Vec3>> cluster_centres_;
+
+            static constexpr size_t transform_grain_ = 1024;
+
+            void build_object(const Object& object, size_t index);
+    };
+};
@@ -0,0 +1,35 @@
+#include "sorting.hpp"
+
+void ThreeDL::radix_sort(std::vector<SortItem>& items, std::vector<SortItem>& scratch, int key_bits) {
+    scratch.resize(items.size());
+
+    for (int shift = 0; shift < key_bits; shift += 8) {
+        uint32_t offsets[256] = {};
+
+        for (const auto& item : items) {
+            ++offsets[(item.key_ >> shift) & 0xff];
+        }
+
+        uint32_t total = 0;
+        for (auto& offset : offsets) {
+            uint32_t count = offset;
+            offset = total;
+            total += count;
+        }
+
+        for (const auto& item : items) {
+            scratch[offsets[(item.key_ >> shift) & 0xff]++] = item;
+        }
+
+        items.swap(scratch);
+    }
+}
+
+uint32_t ThreeDL::quantise_depth(double depth, double min_depth, double max_depth, int key_bits) {
+    uint32_t max_key = (key_bits >= 32) ? 0xffffffffu : (1u << key_bits) - 1;
+
+    if (max_depth <= min_depth || depth <= min_depth) return 0;
+    if (depth >= max_depth) return max_key;
+
+    return static_cast<uint32_t>((depth - min_depth) / (max_depth - min_depth) * max_key);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace ThreeDL {
+    // key / payload pair ordered by radix_sort
+    class SortItem {
+        public:
+            uint32_t key_;
+            uint32_t value_;
+    };
+
+    // stable LSD radix sort over the low key_bits of each key, 8 bits per pass
+    void radix_sort(std::vector<SortItem>& items, std::vector<SortItem>& scratch, int key_bits = 16);
+
+    // maps depth in [min_depth, max_depth] onto an unsigned key_bits key, nearer is smaller
+    uint32_t quantise_depth(double depth, double min_depth, double max_depth, int key_bits = 16);
+};
@@ -0,0 +1,348 @@
+#include "streaming.hpp"
+
+namespace {
+    const char chunk_magic[4] = {'3', 'D', 'L', 'C'};
+    constexpr uint32_t chunk_version = 1;
+
+    // header is the magic, version and chunk count, then one record per chunk, then every chunk's vertices
+    class ChunkRecord {
+        public:
+            double centre_[3];
+            double radius_;
+            uint64_t offset_;
+            uint32_t triangle_count_;
+            uint32_t reserved_;
+    };
+
+    // position, normal, uv
+    constexpr size_t vertex_floats = 8;
+    constexpr size_t triangle_bytes = 3 * vertex_floats * sizeof(float);
+    constexpr size_t header_bytes = sizeof(chunk_magic) + 2 * sizeof(uint32_t);
+
+    static_assert(sizeof(ChunkRecord) == 48, "chunk records are written as is");
+
+    // pread until count bytes are in or the file ends
+    bool read_at(int file, void* out, size_t count, uint64_t offset) {
+        char* bytes = static_cast<char*>(out);
+
+        while (count > 0) {
+            ssize_t got = pread(file, bytes, count, static_cast<off_t>(offset));
+            if (got <= 0) return false;
+
+            bytes += got;
+            count -= got;
+            offset += got;
+        }
+
+        return true;
+    }
+}
+
+void ThreeDL::write_chunked_scene(const std::string& filename, const std::vector<GSPTriangle>& triangles, uint32_t chunk_triangles) {
+    std::ofstream file(filename, std::ios::binary);
+
+    if (!file) {
+        throw std::runtime_error("Could not write chunked scene: " + filename);
+    }
+
+    // only the Morton order is wanted, it is computed the same way for drawing
+    Mesh ordered(triangles, nullptr);
+    const std::vector<uint32_t>& order = ordered.cluster_triangles_;
+
+    chunk_triangles = std::max<uint32_t>(chunk_triangles, 1);
+    uint32_t chunk_count = (order.size() + chunk_triangles - 1) / chunk_triangles;
+
+    std::vector<ChunkRecord> records(chunk_count);
+    uint64_t offset = header_bytes + chunk_count * sizeof(ChunkRecord);
+
+    for (uint32_t c = 0; c < chunk_count; ++c) {
+        uint32_t first = c * chunk_triangles;
+        uint32_t count = std::min<uint32_t>(chunk_triangles, order.size() - first);
+
+        Vec3 min = triangles[order[first]].vertices_[0];
+        Vec3 max = min;
+
+        for (uint32_t i = first; i < first + count; ++i) {
+            for (const auto& vertex : triangles[order[i]].vertices_) {
+                min = {std::min(min.x, vertex.x), std::min(min.y, vertex.y), std::min(min.z, vertex.z)};
+                max = {std::max(max.x, vertex.x), std::max(max.y, vertex.y), std::max(max.z, vertex.z)};
+            }
+        }
+
+        Vec3 centre = (min + max) / 2;
+        records[c] = {{centre.x, centre.y, centre.z}, (max - min).mag() / 2, offset, count, 0};
+        offset += count * triangle_bytes;
+    }
+
+    file.write(chunk_magic, sizeof(chunk_magic));
+    file.write(reinterpret_cast<const char*>(&chunk_version), sizeof(chunk_version));
+    file.write(reinterpret_cast<const char*>(&chunk_count), sizeof(chunk_count));
+    file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(ChunkRecord));
+
+    std::vector<float> values;
+
+    for (uint32_t c = 0; c < chunk_count; ++c) {
+        values.clear();
+
+        for (uint32_t i = c * chunk_triangles; i < c * chunk_triangles + records[c].triangle_count_; ++i) {
+            const GSPTriangle& triangle = triangles[order[i]];
+
+            for (int v = 0; v < 3; ++v) {
+                const Vec3& position = triangle.vertices_[v];
+                const Vec3& normal = triangle.normals_[v];
+                const Vec2& uv = triangle.uvs_[v];
+
+                values.insert(values.end(), {
+                    static_cast<float>(position.x), static_cast<float>(position.y), static_cast<float>(position.z),
+                    static_cast<float>(normal.x), static_cast<float>(normal.y), static_cast<float>(normal.z),
+                    static_cast<float>(uv.x), static_cast<float>(uv.y)
+                });
+            }
+        }
+
+        file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+    }
+
+    if (!file) {
+        throw std::runtime_error("Could not write chunked scene: " + filename);
+    }
+}
+
+ThreeDL::StreamedScene::StreamedScene(const std::string& filename, const SDL_Color& color, size_t memory_budget)
+    : color_(color),
+      memory_budget_(memory_budget)
+{
+    file_ = open(filename.c_str(), O_RDONLY);
+
+    if (file_ < 0) {
+        throw std::runtime_error("Could not open chunked scene: " + filename);
+    }
+
+    char magic[4];
+    uint32_t header[2];
+
+    if (!read_at(file_, magic, sizeof(magic), 0) ||
+        !read_at(file_, header, sizeof(header), sizeof(magic)) ||
+        !std::equal(magic, magic + 4, chunk_magic) ||
+        header[0] != chunk_version) {
+        close(file_);
+        throw std::runtime_error("Not a chunked scene: " + filename);
+    }
+
+    std::vector<ChunkRecord> records(header[1]);
+
+    if (!read_at(file_, records.data(), records.size() * sizeof(ChunkRecord), header_bytes)) {
+        close(file_);
+        throw std::runtime_error("Chunked scene is truncated: " + filename);
+    }
+
+    for (const auto& record : records) {
+        chunks_.push_back({{record.centre_[0], record.centre_[1], record.centre_[2]}, record.radius_, record.offset_, record.triangle_count_});
+    }
+
+    resident_.resize(chunks_.size());
+    resident_bytes_of_.resize(chunks_.size(), 0);
+    last_used_.resize(chunks_.size(), 0);
+
+    loader_ = std::thread(&StreamedScene::load_loop, this);
+}
+
+bool ThreeDL::StreamedScene::update(const std::vector<uint32_t>& wanted, std::vector<Object*>& objects) {
+    ++frame_;
+    bool changed = false;
+
+    std::vector<std::pair<uint32_t, std::unique_ptr<Object>>> arrived;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        arrived.swap(finished_);
+
+        if (error_ != nullptr) {
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+    }
+
+    for (auto& [index, object] : arrived) {
+        // read twice when it was queued again just as the first read finished
+        if (resident_[index] != nullptr) continue;
+
+        resident_bytes_of_[index] = object_bytes(*object);
+        resident_bytes_ += resident_bytes_of_[index];
+        resident_[index] = std::move(object);
+        resident_list_.push_back(index);
+        // most recent of the unused ones, it only stays if it is wanted below
+        last_used_[index] = frame_ - 1;
+        changed = true;
+    }
+
+    // walk the wanted chunks in priority order, only those that fit the budget together are drawn or read,
+    // the rest are left to eviction so residency stays bounded however much is in view
+    size_t planned = 0;
+    size_t queued_bytes = 0;
+    missing_.clear();
+
+    for (uint32_t index : wanted) {
+        bool resident = resident_[index] != nullptr;
+        size_t bytes = resident ? resident_bytes_of_[index] : estimated_bytes(index);
+
+        if (planned + bytes > memory_budget_) continue;
+        planned += bytes;
+
+        if (resident) {
+            last_used_[index] = frame_;
+            objects.push_back(resident_[index].get());
+        } else {
+            missing_.push_back(index);
+            queued_bytes += bytes;
+        }
+    }
+
+    // make room for what is about to be read, never evicting anything drawn this frame
+    size_t before = resident_list_.size();
+    evict(memory_budget_ > queued_bytes ? memory_budget_ - queued_bytes : 0);
+    changed |= resident_list_.size() != before;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // the previous frame's requests are stale, the one being read is left to finish
+        queue_.clear();
+
+        for (uint32_t index : missing_) {
+            if (index != loading_) queue_.push_back(index);
+        }
+    }
+    wake_.notify_one();
+
+    return changed;
+}
+
+void ThreeDL::StreamedScene::evict(size_t keep_under) {
+    while (resident_bytes_ > keep_under) {
+        size_t oldest = resident_list_.size();
+
+        for (size_t i = 0; i < resident_list_.size(); ++i) {
+            uint32_t index = resident_list_[i];
+            if (last_used_[index] == frame_) continue;
+
+            if (oldest == resident_list_.size() || last_used_[index] < last_used_[resident_list_[oldest]]) {
+                oldest = i;
+            }
+        }
+
+        if (oldest == resident_list_.size()) return;
+
+        uint32_t index = resident_list_[oldest];
+        resident_bytes_ -= resident_bytes_of_[index];
+        resident_bytes_of_[index] = 0;
+        resident_[index].reset();
+
+        resident_list_[oldest] = resident_list_.back();
+        resident_list_.pop_back();
+    }
+}
+
+void ThreeDL::StreamedScene::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] {
+        return queue_.empty() && loading_ == none_;
+    });
+}
+
+void ThreeDL::StreamedScene::load_loop() {
+    while (true) {
+        uint32_t index;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] {
+                return stopping_ || !queue_.empty();
+            });
+
+            if (stopping_) return;
+
+            index = queue_.front();
+            queue_.pop_front();
+            loading_ = index;
+        }
+
+        std::unique_ptr<Object> object;
+        std::exception_ptr error;
+
+        try {
+            object = load_chunk(index);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            loading_ = none_;
+
+            if (object != nullptr) {
+                finished_.emplace_back(index, std::move(object));
+            } else if (error_ == nullptr) {
+                error_ = error;
+            }
+        }
+        idle_.notify_all();
+    }
+}
+
+std::unique_ptr<ThreeDL::Object> ThreeDL::StreamedScene::load_chunk(uint32_t index) const {
+    const ChunkInfo& chunk = chunks_[index];
+    std::vector<float> values(chunk.triangle_count_ * 3 * vertex_floats);
+
+    if (!read_at(file_, values.data(), values.size() * sizeof(float), chunk.offset_)) {
+        throw std::runtime_error("Chunked scene is truncated at chunk " + std::to_string(index));
+    }
+
+    std::vector<GSPTriangle> triangles(chunk.triangle_count_);
+    const float* value = values.data();
+
+    for (GSPTriangle& triangle : triangles) {
+        for (int v = 0; v < 3; ++v, value += vertex_floats) {
+            triangle.vertices_[v] = {value[0], value[1], value[2]};
+            triangle.normals_[v] = {value[3], value[4], value[5]};
+            triangle.uvs_[v] = {value[6], value[7]};
+        }
+    }
+
+    auto object = std::make_unique<Object>(Mesh(std::move(triangles), nullptr, color_));
+
+    if (compress_chunks_.load(std::memory_order_relaxed)) {
+        object->mesh_.compress();
+    }
+
+    return object;
+}
+
+size_t ThreeDL::StreamedScene::estimated_bytes(uint32_t index) const {
+    // what object_bytes comes to for an uncompressed chunk, the budget errs towards reading less
+    size_t triangles = chunks_[index].triangle_count_;
+    size_t heap_per_triangle = 3 * (2 * sizeof(Vec3) + sizeof(Vec2));
+    size_t clusters = (triangles + 63) / 64;
+
+    if (compress_chunks_.load(std::memory_order_relaxed)) {
+        return sizeof(Object) + triangles * (3 * sizeof(PackedVertex) + sizeof(uint32_t)) + clusters * sizeof(TriangleCluster);
+    }
+
+    return sizeof(Object) + triangles * (sizeof(GSPTriangle) + heap_per_triangle + sizeof(uint32_t)) + clusters * sizeof(TriangleCluster);
+}
+
+size_t ThreeDL::StreamedScene::object_bytes(const Object& object) {
+    const Mesh& mesh = object.mesh_;
+
+    return sizeof(Object) + mesh.memory_bytes() +
+           mesh.cluster_triangles_.capacity() * sizeof(uint32_t) +
+           mesh.clusters_.capacity() * sizeof(TriangleCluster);
+}
+
+ThreeDL::StreamedScene::~StreamedScene() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+
+    loader_.join();
+    close(file_);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "objects.hpp"
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // bounding sphere and location of one chunk of a chunked scene file
+    class ChunkInfo {
+        public:
+            Vec3 centre_;
+            double radius_;
+
+            uint64_t offset_;  // of the chunk's vertices from the start of the file
+            uint32_t triangle_count_;
+    };
+
+    // cuts the triangles into chunks of at most chunk_triangles along the Morton order Mesh clusters by, so each
+    // chunk is spatially compact, and writes them behind a table of their bounds, vertices as native endian floats
+    void write_chunked_scene(const std::string& filename, const std::vector<GSPTriangle>& triangles, uint32_t chunk_triangles = 16384);
+
+    // geometry larger than memory, chunks are read with pread on a background thread while the renderer wants
+    // them and evicted least recently used first once the resident ones go over the memory budget
+    class StreamedScene {
+        public:
+            StreamedScene(const std::string& filename, const SDL_Color& color, size_t memory_budget);
+            StreamedScene() = delete;
+            StreamedScene(const StreamedScene&) = delete;
+
+            const std::vector<ChunkInfo>& chunks() const {
+                return chunks_;
+            }
+
+            // takes effect on the next update, resident chunks over it are evicted then
+            void set_memory_budget(size_t bytes) {
+                memory_budget_ = bytes;
+            }
+
+            // quantise each chunk as it is loaded, see Mesh::compress
+            void set_compress_chunks(bool enabled) {
+                compress_chunks_ = enabled;
+            }
+
+            size_t resident_bytes() const {
+                return resident_bytes_;
+            }
+
+            size_t resident_count() const {
+                return resident_list_.size();
+            }
+
+            // wanted is this frame's visible chunks, most important first, of which only as many as fit the budget
+            // together are kept. Takes in finished reads, evicts, queues reads for the missing ones and appends the
+            // resident ones to objects. Never waits on the disk, returns true when the resident set changed and
+            // rethrows the first failed read
+            bool update(const std::vector<uint32_t>& wanted, std::vector<Object*>& objects);
+
+            // blocks until nothing is queued or being read, the next update then takes it all in
+            void wait_idle();
+
+            ~StreamedScene();
+        private:
+            static constexpr uint32_t none_ = UINT32_MAX;
+
+            std::vector<ChunkInfo> chunks_;
+            SDL_Color color_;
+            int file_ = -1;
+
+            // render thread only, indexed by chunk, nullptr while not resident
+            std::vector<std::unique_ptr<Object>> resident_;
+            std::vector<size_t> resident_bytes_of_;
+            std::vector<uint64_t> last_used_;
+            std::vector<uint32_t> resident_list_;
+            size_t resident_bytes_ = 0;
+            size_t memory_budget_;
+            uint64_t frame_ = 0;
+            std::vector<uint32_t> missing_;
+
+            // shared with the loader thread
+            std::atomic<bool> compress_chunks_ = false;
+            std::mutex mutex_;
+            std::condition_variable wake_;
+            std::condition_variable idle_;
+            std::deque<uint32_t> queue_;
+            uint32_t loading_ = none_;
+            std::vector<std::pair<uint32_t, std::unique_ptr<Object>>> finished_;
+            std::exception_ptr error_;
+            bool stopping_ = false;
+            std::thread loader_;
+
+            void load_loop();
+            std::unique_ptr<Object> load_chunk(uint32_t index) const;
+            // what a chunk will take once resident, before it is loaded
+            size_t estimated_bytes(uint32_t index) const;
+            static size_t object_bytes(const Object& object);
+            void evict(size_t keep_under);
+    };
+};
@@ -0,0 +1,409 @@
+#include "terrain.hpp"
+
+namespace {
+    // share of each level's range over which its odd vertices slide onto the next level's grid
+    constexpr double morph_start = 0.7;
+    // the slide is quantised to this many steps, both sides of a patch edge round the same way
+    constexpr int morph_steps = 16;
+}
+
+ThreeDL::Terrain::Terrain(const std::string& heightmap_path, double spacing, double height_scale, const SDL_Color& color)
+    : spacing_(spacing),
+      color_(color)
+{
+    SDL_Surface* loaded = IMG_Load(heightmap_path.c_str());
+
+    if (loaded == nullptr) {
+        throw std::runtime_error("Could not load heightmap: " + heightmap_path);
+    }
+
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loaded);
+
+    if (converted == nullptr) {
+        throw std::runtime_error("Could not convert heightmap: " + heightmap_path);
+    }
+
+    width_ = converted->w;
+    depth_ = converted->h;
+
+    if (width_ < 2 || depth_ < 2) {
+        SDL_FreeSurface(converted);
+        throw std::runtime_error("Heightmap needs at least 2x2 pixels: " + heightmap_path);
+    }
+
+    heights_.resize(static_cast<size_t>(width_) * depth_);
+
+    for (int z = 0; z < depth_; ++z) {
+        const Uint32* row = reinterpret_cast<const Uint32*>(static_cast<const Uint8*>(converted->pixels) + z * converted->pitch);
+
+        for (int x = 0; x < width_; ++x) {
+            Uint32 pixel = row[x];
+            double brightness = (((pixel >> 16) & 0xff) + ((pixel >> 8) & 0xff) + (pixel & 0xff)) / (3 * 255.0);
+            heights_[static_cast<size_t>(z) * width_ + x] = static_cast<float>(brightness * height_scale);
+        }
+    }
+
+    SDL_FreeSurface(converted);
+
+    build_quadtree();
+}
+
+ThreeDL::Terrain::Terrain(std::vector<float> heights, int width, int depth, double spacing, const SDL_Color& color)
+    : heights_(std::move(heights)),
+      width_(width),
+      depth_(depth),
+      spacing_(spacing),
+      color_(color)
+{
+    if (width_ < 2 || depth_ < 2 || heights_.size() != static_cast<size_t>(width_) * depth_) {
+        throw std::runtime_error("Terrain needs width * depth heights of at least 2x2");
+    }
+
+    build_quadtree();
+}
+
+void ThreeDL::Terrain::set_patch_size(int quads) {
+    int size = 2;
+    while (size < quads) size *= 2;
+
+    patch_size_ = size;
+    build_quadtree();
+}
+
+void ThreeDL::Terrain::set_lod_distance(double distance) {
+    lod_distance_ = distance;
+    built_ = false;
+}
+
+uint64_t ThreeDL::Terrain::Patch::key() const {
+    return (static_cast<uint64_t>(level_) << 56) |
+           (static_cast<uint64_t>(x_) << 32) |
+           (static_cast<uint64_t>(z_) << 8) |
+            quadrants_;
+}
+
+void ThreeDL::Terrain::build_quadtree() {
+    bounds_.clear();
+    node_counts_.clear();
+    patches_.clear();
+    built_ = false;
+
+    // finest level straight from the samples, a node shares its edge samples with its neighbours
+    int across = (width_ - 2) / patch_size_ + 1;
+    int down = (depth_ - 2) / patch_size_ + 1;
+
+    std::vector<std::pair<float, float>> level(static_cast<size_t>(across) * down);
+
+    for (int nz = 0; nz < down; ++nz) {
+        for (int nx = 0; nx < across; ++nx) {
+            float low = sample(nx * patch_size_, nz * patch_size_);
+            float high = low;
+
+            for (int z = nz * patch_size_; z <= std::min((nz + 1) * patch_size_, depth_ - 1); ++z) {
+                for (int x = nx * patch_size_; x <= std::min((nx + 1) * patch_size_, width_ - 1); ++x) {
+                    low = std::min(low, sample(x, z));
+                    high = std::max(high, sample(x, z));
+                }
+            }
+
+            level[static_cast<size_t>(nz) * across + nx] = {low, high};
+        }
+    }
+
+    bounds_.push_back(std::move(level));
+    node_counts_.push_back({across, down});
+
+    // each coarser level merges four nodes until one covers the whole grid
+    while (across > 1 || down > 1) {
+        int parent_across = (across + 1) / 2;
+        int parent_down = (down + 1) / 2;
+        const std::vector<std::pair<float, float>>& children = bounds_.back();
+
+        std::vector<std::pair<float, float>> parents(static_cast<size_t>(parent_across) * parent_down);
+
+        for (int nz = 0; nz < parent_down; ++nz) {
+            for (int nx = 0; nx < parent_across; ++nx) {
+                std::pair<float, float> merged = children[static_cast<size_t>(2 * nz) * across + 2 * nx];
+
+                for (int q = 1; q < 4; ++q) {
+                    int cx = 2 * nx + (q & 1);
+                    int cz = 2 * nz + (q >> 1);
+                    if (cx >= across || cz >= down) continue;
+
+                    const std::pair<float, float>& child = children[static_cast<size_t>(cz) * across + cx];
+                    merged = {std::min(merged.first, child.first), std::max(merged.second, child.second)};
+                }
+
+                parents[static_cast<size_t>(nz) * parent_across + nx] = merged;
+            }
+        }
+
+        across = parent_across;
+        down = parent_down;
+        bounds_.push_back(std::move(parents));
+        node_counts_.push_back({across, down});
+    }
+}
+
+int ThreeDL::Terrain::node_cells(int level) const {
+    return patch_size_ << level;
+}
+
+double ThreeDL::Terrain::range(int level) const {
+    // closer than four patch widths a node's far edge can reach into the next level's morph before its
+    // own has finished, which opens cracks between the levels
+    double finest = std::max(lod_distance_, 4 * patch_size_ * spacing_);
+    return finest * static_cast<double>(1 << level);
+}
+
+void ThreeDL::Terrain::node_box(int level, int x, int z, Vec3& min, Vec3& max) const {
+    int cells = node_cells(level);
+    const std::pair<float, float>& heights = bounds_[level][static_cast<size_t>(z) * node_counts_[level].first + x];
+
+    min = {x * cells * spacing_, heights.first, z * cells * spacing_};
+    max = {
+        std::min((x + 1) * cells, width_ - 1) * spacing_,
+        heights.second,
+        std::min((z + 1) * cells, depth_ - 1) * spacing_
+    };
+}
+
+double ThreeDL::Terrain::distance_to_node(const Vec3& eye, int level, int x, int z) const {
+    Vec3 min;
+    Vec3 max;
+    node_box(level, x, z, min, max);
+
+    Vec3 nearest = {std::clamp(eye.x, min.x, max.x), std::clamp(eye.y, min.y, max.y), std::clamp(eye.z, min.z, max.z)};
+
+    return (eye - nearest).mag();
+}
+
+float ThreeDL::Terrain::sample(int x, int z) const {
+    x = std::clamp(x, 0, width_ - 1);
+    z = std::clamp(z, 0, depth_ - 1);
+
+    return heights_[static_cast<size_t>(z) * width_ + x];
+}
+
+double ThreeDL::Terrain::height_at_grid(double gx, double gz) const {
+    gx = std::clamp(gx, 0.0, static_cast<double>(width_ - 1));
+    gz = std::clamp(gz, 0.0, static_cast<double>(depth_ - 1));
+
+    int x = std::min(static_cast<int>(gx), width_ - 2);
+    int z = std::min(static_cast<int>(gz), depth_ - 2);
+    double fx = gx - x;
+    double fz = gz - z;
+
+    double near_row = sample(x, z) * (1 - fx) + sample(x + 1, z) * fx;
+    double far_row = sample(x, z + 1) * (1 - fx) + sample(x + 1, z + 1) * fx;
+
+    return near_row * (1 - fz) + far_row * fz;
+}
+
+double ThreeDL::Terrain::height_at(double x, double z) const {
+    return height_at_grid((x - position_.x) / spacing_, (z - position_.z) / spacing_) + position_.y;
+}
+
+bool ThreeDL::Terrain::update(const Vec3& eye, const std::function<bool(const Vec3&, double)>& visible, std::vector<Object*>& objects) {
+    Vec3 local_eye = eye - position_;
+
+    // the morph follows the eye snapped to a grid fine enough that no vertex is off by half a step of it,
+    // so those at the end of a level's range still fully meet the next level, and patches keep still
+    // while the eye moves inside a cell
+    double snap = range(0) * (1 - morph_start) / (2 * morph_steps);
+    Vec3 morph_eye = {std::round(local_eye.x / snap) * snap, std::round(local_eye.y / snap) * snap, std::round(local_eye.z / snap) * snap};
+    bool moved = !built_ || morph_eye != last_eye_;
+
+    if (!built_) {
+        patches_.clear();
+        built_ = true;
+    }
+
+    last_eye_ = morph_eye;
+
+    selected_.clear();
+    select(local_eye, visible, levels() - 1, 0, 0);
+
+    std::vector<uint64_t> keys;
+    keys.reserve(selected_.size());
+
+    for (const Patch& patch : selected_) {
+        keys.push_back(patch.key());
+    }
+
+    bool changed = keys != selected_keys_;
+    selected_keys_.swap(keys);
+
+    // patches that left the view are dropped, those still in it are kept until their morph changes
+    std::unordered_map<uint64_t, BuiltPatch> kept;
+    triangle_count_ = 0;
+
+    for (const Patch& patch : selected_) {
+        auto found = patches_.find(patch.key());
+        BuiltPatch built;
+
+        if (found != patches_.end()) {
+            built = std::move(found->second);
+        }
+
+        if (built.object_ == nullptr || moved) {
+            morph_levels(patch, morph_eye, morph_);
+
+            if (built.object_ == nullptr || morph_ != built.morph_) {
+                built.object_ = build_patch(patch, morph_);
+                built.morph_ = morph_;
+                changed = true;
+            }
+        }
+
+        Object* object = built.object_.get();
+        object->position_ = position_;
+
+        triangle_count_ += object->mesh_.triangle_count();
+        objects.push_back(object);
+        kept.emplace(patch.key(), std::move(built));
+    }
+
+    patches_.swap(kept);
+
+    return changed;
+}
+
+bool ThreeDL::Terrain::select(const Vec3& eye, const std::function<bool(const Vec3&, double)>& visible, int level, int x, int z) {
+    double distance = distance_to_node(eye, level, x, z);
+
+    // too far for this level, the parent draws this quarter instead, nothing is beyond the top level
+    if (level < levels() - 1 && distance > range(level)) return false;
+
+    Vec3 min;
+    Vec3 max;
+    node_box(level, x, z, min, max);
+
+    if (!visible(position_ + (min + max) / 2, (max - min).mag() / 2)) return true;
+
+    if (level == 0 || distance > range(level - 1)) {
+        selected_.push_back({level, x, z, 0xf});
+        return true;
+    }
+
+    uint8_t quadrants = 0;
+
+    for (int q = 0; q < 4; ++q) {
+        int cx = 2 * x + (q & 1);
+        int cz = 2 * z + (q >> 1);
+
+        // quarters past the edge of the grid hold no samples
+        if (cx >= node_counts_[level - 1].first || cz >= node_counts_[level - 1].second) continue;
+
+        if (!select(eye, visible, level - 1, cx, cz)) {
+            quadrants |= 1 << q;
+        }
+    }
+
+    if (quadrants != 0) {
+        selected_.push_back({level, x, z, quadrants});
+    }
+
+    return true;
+}
+
+void ThreeDL::Terrain::morph_levels(const Patch& patch, const Vec3& eye, std::vector<uint8_t>& morph) const {
+    int step = 1 << patch.level_;
+    int first_x = patch.x_ * node_cells(patch.level_);
+    int first_z = patch.z_ * node_cells(patch.level_);
+    int row = patch_size_ + 1;
+
+    morph.assign(static_cast<size_t>(row) * row, 0);
+
+    // nothing is beyond the top level, it never morphs
+    if (patch.level_ == levels() - 1) return;
+
+    double morph_end = range(patch.level_);
+    double morph_begin = morph_end * morph_start;
+
+    for (int j = 0; j < row; ++j) {
+        for (int i = 0; i < row; ++i) {
+            // only odd vertices slide
+            if (!(i & 1) && !(j & 1)) continue;
+
+            int gx = std::min(first_x + i * step, width_ - 1);
+            int gz = std::min(first_z + j * step, depth_ - 1);
+
+            Vec3 unmorphed = {gx * spacing_, height_at_grid(gx, gz), gz * spacing_};
+            double k = std::clamp(((eye - unmorphed).mag() - morph_begin) / (morph_end - morph_begin), 0.0, 1.0);
+
+            morph[static_cast<size_t>(j) * row + i] = static_cast<uint8_t>(std::lround(k * morph_steps));
+        }
+    }
+}
+
+std::unique_ptr<ThreeDL::Object> ThreeDL::Terrain::build_patch(const Patch& patch, const std::vector<uint8_t>& morph) const {
+    int step = 1 << patch.level_;
+    int first_x = patch.x_ * node_cells(patch.level_);
+    int first_z = patch.z_ * node_cells(patch.level_);
+    int row = patch_size_ + 1;
+
+    std::vector<Vec3> positions(static_cast<size_t>(row) * row);
+    std::vector<Vec3> normals(positions.size());
+    std::vector<Vec2> uvs(positions.size());
+
+    for (int j = 0; j < row; ++j) {
+        for (int i = 0; i < row; ++i) {
+            int gx = std::min(first_x + i * step, width_ - 1);
+            int gz = std::min(first_z + j * step, depth_ - 1);
+
+            double mx = gx;
+            double mz = gz;
+            double k = static_cast<double>(morph[static_cast<size_t>(j) * row + i]) / morph_steps;
+
+            // odd vertices slide onto the even one below them, so at k = 1 the patch is the coarser grid
+            // and meets the next level without cracks, vertices clamped to the edge stay put
+            if ((i & 1) && first_x + i * step < width_) mx -= step * k;
+            if ((j & 1) && first_z + j * step < depth_) mz -= step * k;
+
+            double height = height_at_grid(mx, mz);
+            Vec3 normal = {
+                height_at_grid(mx - 1, mz) - height_at_grid(mx + 1, mz),
+                2 * spacing_,
+                height_at_grid(mx, mz - 1) - height_at_grid(mx, mz + 1)
+            };
+            normal.normalise();
+
+            size_t index = static_cast<size_t>(j) * row + i;
+            positions[index] = {mx * spacing_, height, mz * spacing_};
+            normals[index] = normal;
+            uvs[index] = {mx / (width_ - 1), mz / (depth_ - 1)};
+        }
+    }
+
+    std::vector<GSPTriangle> triangles;
+    int half = patch_size_ / 2;
+
+    for (int j = 0; j < patch_size_; ++j) {
+        // quads whose near corner is past the edge of the grid would be flat, they are left out
+        if (first_z + j * step >= depth_ - 1) break;
+
+        for (int i = 0; i < patch_size_; ++i) {
+            if (first_x + i * step >= width_ - 1) break;
+
+            int quadrant = (i >= half ? 1 : 0) + (j >= half ? 2 : 0);
+            if (!(patch.quadrants_ & (1 << quadrant))) continue;
+
+            size_t corners[4] = {
+                static_cast<size_t>(j) * row + i,
+                static_cast<size_t>(j) * row + i + 1,
+                static_cast<size_t>(j + 1) * row + i,
+                static_cast<size_t>(j + 1) * row + i + 1
+            };
+
+            for (const auto& [a, b, c] : {std::array<size_t, 3>{corners[0], corners[2], corners[3]}, std::array<size_t, 3>{corners[0], corners[3], corners[1]}}) {
+                GSPTriangle triangle({positions[a], positions[b], positions[c]}, {uvs[a], uvs[b], uvs[c]});
+                triangle.normals_ = {normals[a], normals[b], normals[c]};
+                triangles.push_back(std::move(triangle));
+            }
+        }
+    }
+
+    return std::make_unique<Object>(Mesh(std::move(triangles), texture_, color_));
+}
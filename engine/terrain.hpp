@@ -0,0 +1,133 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "objects.hpp"
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // heightfield on a regular grid, x and z across and y up, drawn as a quadtree of grid patches whose level
+    // follows the distance to the eye, CDLOD style, so the triangles drawn stay about the same however big it is
+    class Terrain {
+        public:
+            // brightness of each pixel is the height, 0 to height_scale, samples spacing apart in x and z
+            Terrain(const std::string& heightmap_path, double spacing, double height_scale, const SDL_Color& color);
+            // width by depth samples, row by row along x
+            Terrain(std::vector<float> heights, int width, int depth, double spacing, const SDL_Color& color);
+            Terrain() = delete;
+            Terrain(const Terrain&) = delete;
+
+            // world position of the first sample, call invalidate on the renderer after moving it
+            Vec3 position_ = {0, 0, 0};
+            // not owned, stretched once over the whole grid, set before the first frame
+            SDL_Surface* texture_ = nullptr;
+
+            // quads along a patch edge, rounded up to a power of two of at least 2, rebuilds the quadtree
+            void set_patch_size(int quads);
+            // distance out to which the finest level is drawn, each coarser level reaches twice as far,
+            // at least four finest patch widths, which is also the default
+            void set_lod_distance(double distance);
+
+            int width() const {
+                return width_;
+            }
+
+            int depth() const {
+                return depth_;
+            }
+
+            int levels() const {
+                return static_cast<int>(bounds_.size());
+            }
+
+            // world height under x, z, bilinear between samples and clamped to the edges
+            double height_at(double x, double z) const;
+
+            // picks and builds the patches for this eye, visible tests a world space bounding sphere against
+            // the view, appends the patches to objects, returns true when they differ from the last call
+            bool update(const Vec3& eye, const std::function<bool(const Vec3&, double)>& visible, std::vector<Object*>& objects);
+
+            // of the patches the last update picked
+            size_t patch_count() const {
+                return selected_.size();
+            }
+
+            size_t triangle_count() const {
+                return triangle_count_;
+            }
+
+            ~Terrain() = default;
+        private:
+            // one node drawn at its own level, quadrants is a mask of the quarters to draw
+            class Patch {
+                public:
+                    int level_;
+                    int x_;  // node index within its level
+                    int z_;
+                    uint8_t quadrants_;
+
+                    uint64_t key() const;
+            };
+
+            class BuiltPatch {
+                public:
+                    std::unique_ptr<Object> object_;
+                    // morph of each vertex it was built with, in steps of 1 / morph_steps
+                    std::vector<uint8_t> morph_;
+            };
+
+            std::vector<float> heights_;
+            int width_;
+            int depth_;
+            double spacing_;
+            SDL_Color color_;
+
+            int patch_size_ = 32;
+            double lod_distance_ = 0;
+
+            // lowest and highest sample under each node, finest level first
+            std::vector<std::vector<std::pair<float, float>>> bounds_;
+            // nodes along x and z at each level
+            std::vector<std::pair<int, int>> node_counts_;
+
+            // the morph follows the eye in steps, so a patch is only rebuilt when the eye moved one of its
+            // vertices by a step, a rebuilt patch is a new mesh to every cache keyed on Mesh::generation
+            std::unordered_map<uint64_t, BuiltPatch> patches_;
+            std::vector<uint8_t> morph_;
+            std::vector<Patch> selected_;
+            std::vector<uint64_t> selected_keys_;
+            Vec3 last_eye_ = {0, 0, 0};
+            bool built_ = false;
+            size_t triangle_count_ = 0;
+
+            void build_quadtree();
+
+            int node_cells(int level) const;
+            double range(int level) const;
+            // bounding box of a node in terrain space
+            void node_box(int level, int x, int z, Vec3& min, Vec3& max) const;
+            double distance_to_node(const Vec3& eye, int level, int x, int z) const;
+
+            // true when the node or its parent covers it, false when it is beyond this level's range
+            bool select(const Vec3& eye, const std::function<bool(const Vec3&, double)>& visible, int level, int x, int z);
+
+            float sample(int x, int z) const;
+            // terrain space height at grid coordinates
+            double height_at_grid(double gx, double gz) const;
+            void morph_levels(const Patch& patch, const Vec3& eye, std::vector<uint8_t>& morph) const;
+            std::unique_ptr<Object> build_patch(const Patch& patch, const std::vector<uint8_t>& morph) const;
+    };
+};
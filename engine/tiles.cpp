@@ -0,0 +1,85 @@
+#include "tiles.hpp"
+
+namespace {
+    uint64_t pack_range(uint32_t begin, uint32_t end) {
+        return (static_cast<uint64_t>(end) << 32) | begin;
+    }
+
+    uint32_t range_begin(uint64_t range) {
+        return static_cast<uint32_t>(range);
+    }
+
+    uint32_t range_end(uint64_t range) {
+        return static_cast<uint32_t>(range >> 32);
+    }
+}
+
+ThreeDL::TileScheduler::TileScheduler(int width, int height, int tile_size) {
+    for (int y = 0; y < height; y += tile_size) {
+        for (int x = 0; x < width; x += tile_size) {
+            tiles_.push_back({x, y, std::min(tile_size, width - x), std::min(tile_size, height - y)});
+        }
+    }
+}
+
+void ThreeDL::TileScheduler::run(int thread_count, const std::function<void(const SDL_Rect& tile, int worker)>& work) {
+    worker_count_ = std::clamp(thread_count, 1, std::max(1, static_cast<int>(tiles_.size())));
+    ranges_ = std::make_unique<std::atomic<uint64_t>[]>(worker_count_);
+
+    uint32_t tile_count = static_cast<uint32_t>(tiles_.size());
+
+    for (int i = 0; i < worker_count_; ++i) {
+        ranges_[i].store(pack_range(tile_count * i / worker_count_, tile_count * (i + 1) / worker_count_));
+    }
+
+    jobs().parallel_for(0, worker_count_, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            work_loop(static_cast<int>(i), work);
+        }
+    });
+}
+
+void ThreeDL::TileScheduler::work_loop(int worker, const std::function<void(const SDL_Rect& tile, int worker)>& work) {
+    uint32_t tile;
+
+    while (pop(worker, tile) || steal(worker, tile)) {
+        work(tiles_[tile], worker);
+    }
+}
+
+bool ThreeDL::TileScheduler::pop(int worker, uint32_t& tile) {
+    std::atomic<uint64_t>& range = ranges_[worker];
+    uint64_t current = range.load();
+
+    while (range_begin(current) < range_end(current)) {
+        if (range.compare_exchange_weak(current, pack_range(range_begin(current) + 1, range_end(current)))) {
+            tile = range_begin(current);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ThreeDL::TileScheduler::steal(int thief, uint32_t& tile) {
+    for (int offset = 1; offset < worker_count_; ++offset) {
+        std::atomic<uint64_t>& range = ranges_[(thief + offset) % worker_count_];
+        uint64_t current = range.load();
+
+        while (range_begin(current) < range_end(current)) {
+            // take the back half so a thief comes back rarely, the victim keeps the tiles next to its current one
+            uint32_t begin = range_begin(current);
+            uint32_t end = range_end(current);
+            uint32_t middle = begin + (end - begin) / 2;
+
+            if (!range.compare_exchange_weak(current, pack_range(begin, middle))) continue;
+
+            // the thief's own range is empty, so nobody else can be touching it
+            ranges_[thief].store(pack_range(middle + 1, end));
+            tile = middle;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "jobs.hpp"
+
+namespace ThreeDL {
+    // splits a render target into square tiles and spreads them over job system workers, each worker
+    // starts on its own contiguous run of tiles and steals from the back of other runs once it is done
+    class TileScheduler {
+        public:
+            TileScheduler(int width, int height, int tile_size);
+            TileScheduler() = delete;
+
+            // calls work for every tile exactly once, worker is in [0, thread_count) and each runs as one job
+            void run(int thread_count, const std::function<void(const SDL_Rect& tile, int worker)>& work);
+
+            const std::vector<SDL_Rect>& tiles() const {
+                return tiles_;
+            }
+
+            ~TileScheduler() = default;
+        private:
+            std::vector<SDL_Rect> tiles_;
+
+            // per worker [begin, end) into tiles_, packed into one word so the owner popping the
+            // front and a thief taking the back race on a single compare and swap
+            std::unique_ptr<std::atomic<uint64_t>[]> ranges_;
+            int worker_count_ = 0;
+
+            bool pop(int worker, uint32_t& tile);
+            bool steal(int thief, uint32_t& tile);
+            void work_loop(int worker, const std::function<void(const SDL_Rect& tile, int worker)>& work);
+    };
+};
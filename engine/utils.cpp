@@ -290,6 +290,17 @@ void ThreeDL::GSPTriangle::translate(const Vec3& translation) {
     }
 }
 
+ThreeDL::Vec3 ThreeDL::GSPTriangle::face_normal() const {
+    Vec3 normal = (vertices_[1] - vertices_[0]).cross(vertices_[2] - vertices_[0]);
+    double length = normal.mag();
+
+    if (length == 0) {
+        return {0, 0, 0};
+    }
+
+    return normal / length;
+}
+
 std::vector<std::string> ThreeDL::split(const std::string& str, char delim) {
     std::vector<std::string> result;
     std::stringstream ss (str);
@@ -329,4 +340,30 @@ ThreeDL::Vec2 ThreeDL::vec2_intersection(const Vec2& a_pos, const Vec2& a_dir, c
     double t = (b_dir.x * (a_pos.y - b_pos.y) - b_dir.y * (a_pos.x - b_pos.x)) / (a_dir.x * b_dir.y - a_dir.y * b_dir.x);
 
     return a_pos + a_dir * t;
+}
+
+std::array<ThreeDL::Vec3, 3> ThreeDL::rotation_matrix(const Vec3& rotation) {
+    Vec3 axes[3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+    for (auto& axis : axes) {
+        axis.rotate(rotation.x, rotation.y, rotation.z);
+    }
+
+    return {
+        Vec3{axes[0].x, axes[1].x, axes[2].x},
+        Vec3{axes[0].y, axes[1].y, axes[2].y},
+        Vec3{axes[0].z, axes[1].z, axes[2].z}
+    };
+}
+
+ThreeDL::Vec3 ThreeDL::apply_rotation(const std::array<Vec3, 3>& matrix, const Vec3& vector) {
+    return {
+        matrix[0].dot(vector),
+        matrix[1].dot(vector),
+        matrix[2].dot(vector)
+    };
+}
+
+ThreeDL::Vec3 ThreeDL::apply_transpose(const std::array<Vec3, 3>& matrix, const Vec3& vector) {
+    return matrix[0] * vector.x + matrix[1] * vector.y + matrix[2] * vector.z;
 }
\ No newline at end of file
@@ -2,6 +2,10 @@
 
 #define _USE_MATH_DEFINES // for intellisense
 #include <math.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -175,8 +179,16 @@ namespace ThreeDL {
                 {0, 0}
             };
 
+            std::vector<Vec3> normals_ = {
+                {0, 0, 0},
+                {0, 0, 0},
+                {0, 0, 0}
+            };
+
             void rotate(const Vec3& rotation);
             void translate(const Vec3& translation);
+
+            Vec3 face_normal() const;
         
             ~GSPTriangle() = default;
     };
@@ -184,4 +196,37 @@ namespace ThreeDL {
     std::vector<std::string> split(const std::string& str, char delim);
     double calculate_z_index(const Line& line, double x, double y);
     Vec2 vec2_intersection(const Vec2& a_pos, const Vec2& a_dir, const Vec2& b_pos, const Vec2& b_dir);
+
+    // rows of the rotation Vec3::rotate applies for these angles, so many vectors can share one set of trig calls
+    std::array<Vec3, 3> rotation_matrix(const Vec3& rotation);
+    Vec3 apply_rotation(const std::array<Vec3, 3>& matrix, const Vec3& vector);
+    Vec3 apply_transpose(const std::array<Vec3, 3>& matrix, const Vec3& vector); // the inverse rotation
+
+    // hash map key compared by bit pattern, so welding never merges values like 0.0 and -0.0 that only compare equal
+    template <size_t N>
+    class BitwiseKey {
+        public:
+            double values_[N];
+
+            bool operator==(const BitwiseKey& other) const {
+                return std::memcmp(values_, other.values_, sizeof(values_)) == 0;
+            }
+    };
+
+    template <size_t N>
+    class BitwiseKeyHash {
+        public:
+            size_t operator()(const BitwiseKey<N>& key) const {
+                uint64_t hash = 14695981039346656037ull;
+                uint64_t bits[N];
+                std::memcpy(bits, key.values_, sizeof(bits));
+
+                for (uint64_t value : bits) {
+                    hash = (hash ^ value) * 1099511628211ull;
+                    hash ^= hash >> 29;
+                }
+
+                return static_cast<size_t>(hash);
+            }
+    };
 };
\ No newline at end of file
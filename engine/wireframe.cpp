@@ -0,0 +1,195 @@
+#include "wireframe.hpp"
+
+namespace {
+    // as pack_color does
+    Uint32 pack(const SDL_Color& color) {
+        return (static_cast<Uint32>(color.a) << 24) | (static_cast<Uint32>(color.r) << 16) |
+               (static_cast<Uint32>(color.g) << 8) | static_cast<Uint32>(color.b);
+    }
+
+    // which sides of the clip rectangle a point is beyond
+    namespace Outcode {
+        constexpr uint8_t left = 1;
+        constexpr uint8_t right = 2;
+        constexpr uint8_t below = 4;
+        constexpr uint8_t above = 8;
+    };
+
+    uint8_t outcode(const ThreeDL::Vec2& point, double x_min, double y_min, double x_max, double y_max) {
+        uint8_t code = 0;
+
+        if (point.x < x_min) code |= Outcode::left;
+        else if (point.x > x_max) code |= Outcode::right;
+
+        if (point.y < y_min) code |= Outcode::below;
+        else if (point.y > y_max) code |= Outcode::above;
+
+        return code;
+    }
+}
+
+ThreeDL::EdgeList ThreeDL::extract_edges(const Mesh& mesh) {
+    EdgeList list;
+    size_t triangle_count = mesh.triangle_count();
+
+    std::unordered_map<BitwiseKey<3>, uint32_t, BitwiseKeyHash<3>> welded;
+    welded.reserve(triangle_count * 3);
+
+    // both ends in one word, so duplicates fall out of a sort
+    std::vector<uint64_t> keys;
+    keys.reserve(triangle_count * 3);
+
+    GSPTriangle decoded;
+
+    for (size_t t = 0; t < triangle_count; ++t) {
+        const GSPTriangle& triangle = mesh.compressed_ != nullptr ? (decoded = mesh.triangle(t)) : mesh.triangles_[t];
+        uint32_t ids[3];
+
+        for (int v = 0; v < 3; ++v) {
+            const Vec3& p = triangle.vertices_[v];
+            auto [it, inserted] = welded.try_emplace(BitwiseKey<3>{{p.x, p.y, p.z}}, static_cast<uint32_t>(list.positions_.size()));
+
+            if (inserted) list.positions_.push_back(p);
+            ids[v] = it->second;
+        }
+
+        for (int v = 0; v < 3; ++v) {
+            uint32_t a = ids[v];
+            uint32_t b = ids[(v + 1) % 3];
+
+            // collapsed edges of degenerate triangles have nothing to draw
+            if (a == b) continue;
+
+            keys.push_back((static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b));
+        }
+    }
+
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    list.edges_.reserve(keys.size());
+
+    for (uint64_t key : keys) {
+        list.edges_.emplace_back(static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key));
+    }
+
+    return list;
+}
+
+bool ThreeDL::clip_line(Vec2& a, Vec2& b, double x_min, double y_min, double x_max, double y_max) {
+    uint8_t code_a = outcode(a, x_min, y_min, x_max, y_max);
+    uint8_t code_b = outcode(b, x_min, y_min, x_max, y_max);
+
+    while (true) {
+        if ((code_a | code_b) == 0) return true;
+        if ((code_a & code_b) != 0) return false;
+
+        // move whichever end is outside onto the edge it is beyond, at most four times in all
+        bool first = code_a != 0;
+        uint8_t code = first ? code_a : code_b;
+        double t;
+
+        if (code & Outcode::above) {
+            t = (y_max - a.y) / (b.y - a.y);
+        } else if (code & Outcode::below) {
+            t = (y_min - a.y) / (b.y - a.y);
+        } else if (code & Outcode::right) {
+            t = (x_max - a.x) / (b.x - a.x);
+        } else {
+            t = (x_min - a.x) / (b.x - a.x);
+        }
+
+        Vec2 point = {a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), a.depth_info_ + t * (b.depth_info_ - a.depth_info_)};
+
+        // exactly on the edge, rounding must not leave it a hair outside
+        if (code & Outcode::above) point.y = y_max;
+        else if (code & Outcode::below) point.y = y_min;
+        else if (code & Outcode::right) point.x = x_max;
+        else point.x = x_min;
+
+        if (first) {
+            a = point;
+            code_a = outcode(a, x_min, y_min, x_max, y_max);
+        } else {
+            b = point;
+            code_b = outcode(b, x_min, y_min, x_max, y_max);
+        }
+    }
+}
+
+void ThreeDL::DebugLines::set_enabled(bool enabled) {
+    enabled_ = enabled;
+    if (!enabled_) clear();
+}
+
+void ThreeDL::DebugLines::clear() {
+    if (colors_.empty()) return;
+
+    points_.clear();
+    colors_.clear();
+    ++revision_;
+}
+
+void ThreeDL::DebugLines::add(const Vec3& a, const Vec3& b, const SDL_Color& color) {
+    points_.push_back(a);
+    points_.push_back(b);
+    colors_.push_back(pack(color));
+    ++revision_;
+}
+
+void ThreeDL::DebugLines::add_box(const Vec3& min, const Vec3& max, const SDL_Color& color) {
+    // corner i takes max on the axes whose bit is set, x then y then z
+    std::array<Vec3, 8> corners;
+
+    for (int i = 0; i < 8; ++i) {
+        corners[i] = {(i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z};
+    }
+
+    // every corner to the ones one bit away
+    for (int i = 0; i < 8; ++i) {
+        for (int bit = 1; bit < 8; bit <<= 1) {
+            if ((i & bit) == 0) add(corners[i], corners[i | bit], color);
+        }
+    }
+}
+
+void ThreeDL::DebugLines::add_hierarchy(const std::vector<BVHNode>& nodes, const SDL_Color& color, int max_depth) {
+    if (nodes.empty()) return;
+
+    std::vector<std::pair<uint32_t, int>> stack = {{0, 0}};
+
+    while (!stack.empty()) {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+
+        const BVHNode& node = nodes[index];
+        add_box(node.bounds_.min_, node.bounds_.max_, color);
+
+        if (node.count_ != 0 || depth == max_depth) continue;
+
+        // the left child directly follows its parent, first_ is the right one
+        stack.push_back({node.first_, depth + 1});
+        stack.push_back({index + 1, depth + 1});
+    }
+}
+
+void ThreeDL::DebugLines::add_frustum(const Camera& camera, double near, double far, double aspect, const SDL_Color& color, double tan_half_fov) {
+    std::array<Vec3, 3> rotation = camera.view_rotation();
+    std::array<Vec3, 8> corners;
+
+    // view space looks down -z, the transpose takes it back to world space
+    for (int i = 0; i < 8; ++i) {
+        double distance = (i & 4) ? far : near;
+        double half_width = distance * tan_half_fov;
+        double half_height = half_width / aspect;
+
+        Vec3 view = {(i & 1) ? half_width : -half_width, (i & 2) ? half_height : -half_height, -distance};
+        corners[i] = apply_transpose(rotation, view) + camera.position_;
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        for (int bit = 1; bit < 8; bit <<= 1) {
+            if ((i & bit) == 0) add(corners[i], corners[i | bit], color);
+        }
+    }
+}
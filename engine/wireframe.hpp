@@ -0,0 +1,94 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "objects.hpp"
+#include "utils.hpp"
+
+namespace ThreeDL {
+    // the edges of a mesh in mesh space, vertices welded by position so an edge shared by several
+    // triangles is only listed once
+    class EdgeList {
+        public:
+            std::vector<Vec3> positions_;
+            // index pairs into positions_, lower index first
+            std::vector<std::pair<uint32_t, uint32_t>> edges_;
+    };
+
+    EdgeList extract_edges(const Mesh& mesh);
+
+    // Cohen-Sutherland against x_min <= x <= x_max, y_min <= y <= y_max, depth_info_ is interpolated along
+    // with the ends, false when none of the segment is inside
+    bool clip_line(Vec2& a, Vec2& b, double x_min, double y_min, double x_max, double y_max);
+
+    // world space lines drawn over the frame for inspecting bounds, hierarchies and cameras, kept until
+    // cleared, every call returns straight away while disabled
+    class DebugLines {
+        public:
+            DebugLines() = default;
+
+            // disabling also clears
+            void set_enabled(bool enabled);
+
+            bool enabled() const {
+                return enabled_;
+            }
+
+            void line(const Vec3& a, const Vec3& b, const SDL_Color& color) {
+                if (enabled_) add(a, b, color);
+            }
+
+            void box(const Vec3& min, const Vec3& max, const SDL_Color& color) {
+                if (enabled_) add_box(min, max, color);
+            }
+
+            // the boxes of a flattened hierarchy, in its own space, down to max_depth levels below the root, all of them when negative
+            void hierarchy(const std::vector<BVHNode>& nodes, const SDL_Color& color, int max_depth = -1) {
+                if (enabled_) add_hierarchy(nodes, color, max_depth);
+            }
+
+            // what a camera sees from near to far, aspect is width over height and tan_half_fov is across the width,
+            // the renderer's by default
+            void frustum(const Camera& camera, double near, double far, double aspect, const SDL_Color& color, double tan_half_fov = 0.73205080757) {
+                if (enabled_) add_frustum(camera, near, far, aspect, color, tan_half_fov);
+            }
+
+            void clear();
+
+            bool empty() const {
+                return colors_.empty();
+            }
+
+            size_t size() const {
+                return colors_.size();
+            }
+
+            // bumped by every change, so the renderer knows when a cached frame is out of date
+            uint64_t revision() const {
+                return revision_;
+            }
+
+            // two ends per line, one packed colour per line
+            std::vector<Vec3> points_;
+            std::vector<Uint32> colors_;
+
+            ~DebugLines() = default;
+        private:
+            bool enabled_ = false;
+            uint64_t revision_ = 0;
+
+            void add(const Vec3& a, const Vec3& b, const SDL_Color& color);
+            void add_box(const Vec3& min, const Vec3& max, const SDL_Color& color);
+            void add_hierarchy(const std::vector<BVHNode>& nodes, const SDL_Color& color, int max_depth);
+            void add_frustum(const Camera& camera, double near, double far, double aspect, const SDL_Color& color, double tan_half_fov);
+    };
+};
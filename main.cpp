@@ -16,20 +16,34 @@ SDL_Renderer* renderer;
 SDL_Window* window;
 
 ThreeDL::OBJLoader plane ("plane.obj", SDL_Color {255, 0 , 0});
+ThreeDL::MeshOptimisationStats plane_stats = plane.optimise();
 ThreeDL::Object plane_obj (plane.export_mesh());
 
 ThreeDL::Camera cam ({0, 0, 0}, {0, 0, 0});
 
 int main(int argc, char** argv) {
+    std::cout << "plane.obj: " << plane_stats.triangles_ << " triangles, "
+              << plane_stats.vertices_before_ << " -> " << plane_stats.vertices_after_ << " vertices, ACMR "
+              << plane_stats.acmr_before_ << " -> " << plane_stats.acmr_after_ << ", "
+              << plane_stats.bytes_before_ / 1024 << " -> " << plane_stats.bytes_after_ / 1024 << " KiB\n";
+
     SDL_Init(SDL_INIT_VIDEO);
     SDL_CreateWindowAndRenderer(WINDOW_WIDTH, WINDOW_HEIGHT, 0, &window, &renderer);
 
     ThreeDL::Renderer scene (renderer, window, cam, WINDOW_WIDTH, WINDOW_HEIGHT);
 
     scene.add(&plane_obj);
+    scene.add_light(ThreeDL::DirectionalLight({0.3, -1, -0.5}, {255, 255, 255, 255}, 0.8));
+    scene.set_lighting_mode(ThreeDL::LightingMode::gouraud);
+    scene.set_incremental(true);
 
     while (true) {
-        SDL_PollEvent(&event);
+        // nothing moved last frame, sleep until there is input instead of spinning
+        if (scene.last_update() == ThreeDL::FrameUpdate::none) {
+            SDL_WaitEventTimeout(&event, 16);
+        } else {
+            SDL_PollEvent(&event);
+        }
 
         if (event.type == SDL_QUIT) {
             break;
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../engine/bvh.hpp"
+#include "../engine/compression.hpp"
+#include "../engine/kernels.hpp"
+#include "../engine/objects.hpp"
+#include "../engine/rendering.hpp"
+
+// ns/op of the math, raster and ray query stages and of every kernel at each instruction set this CPU runs,
+// run from the repository root, THREEDL_THREADS=1 keeps the frame timings to one core
+namespace {
+    volatile double sink;
+
+    // a tenth of the runs warm up first, returns ns per call
+    template <typename F>
+    double time_ns(F&& run, long count) {
+        for (long i = 0; i < count / 10; ++i) run(i);
+
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < count; ++i) run(i);
+
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    }
+
+    void report(const std::string& name, double ns, const std::string& extra = "") {
+        std::printf("%-34s %10.2f ns/op%s\n", name.c_str(), ns, extra.c_str());
+    }
+
+    // for a report's extra column, ns per item
+    std::string millions_per_second(double ns, const std::string& unit) {
+        return "  " + std::to_string(1000 / ns).substr(0, 6) + " M " + unit + "/s";
+    }
+
+    std::vector<ThreeDL::Vec3> test_points(size_t count) {
+        std::vector<ThreeDL::Vec3> points(count);
+
+        for (size_t i = 0; i < count; ++i) {
+            points[i] = {std::sin(i) * 3, std::cos(i * 0.7), -5.0 - static_cast<double>(i % 7)};
+        }
+
+        return points;
+    }
+
+    // positions of every triangle in draw order into one stream, as Renderer::setup_batch gathers them, from the
+    // full precision triangles and decoded from the compressed ones, plane.obj 64 times over so neither fits in cache
+    void position_gather(const ThreeDL::Object& plane) {
+        std::vector<ThreeDL::GSPTriangle> triangles;
+
+        for (int copy = 0; copy < 64; ++copy) {
+            triangles.insert(triangles.end(), plane.mesh_.triangles_.begin(), plane.mesh_.triangles_.end());
+        }
+
+        ThreeDL::Mesh mesh(triangles, nullptr);
+        ThreeDL::CompressedTriangles compressed(mesh.triangles_);
+        const std::vector<uint32_t>& ids = mesh.cluster_triangles_;
+        std::vector<ThreeDL::Vec3> out(ids.size() * 3);
+
+        double ns = time_ns([&](long) {
+            for (size_t i = 0; i < ids.size(); ++i) {
+                const ThreeDL::GSPTriangle& triangle = mesh.triangles_[ids[i]];
+
+                for (int v = 0; v < 3; ++v) {
+                    out[i * 3 + v] = triangle.vertices_[v];
+                }
+            }
+
+            sink = out[0].x;
+        }, 50) / ids.size();
+
+        report("triangle gather (full precision)", ns, "  " + std::to_string(mesh.memory_bytes() / 1024) + " KiB");
+
+        ns = time_ns([&](long) {
+            compressed.decode_positions(ids.data(), 0, ids.size(), out.data());
+            sink = out[0].x;
+        }, 50) / ids.size();
+
+        report("decode_positions (compressed)", ns, "  " + std::to_string(compressed.memory_bytes() / 1024) + " KiB");
+    }
+
+    // plane.obj instanced 16 times over a grid in front of one eye, rays from it through 256x256 directions,
+    // neighbours together so the packets stay coherent
+    void ray_queries(const ThreeDL::Object& plane) {
+        std::vector<ThreeDL::Object> objects;
+        std::vector<ThreeDL::Object*> pointers;
+        objects.reserve(16);
+
+        for (int i = 0; i < 16; ++i) {
+            ThreeDL::Vec3 rotation = {i * 7.0, i * 23.0, 0};
+            ThreeDL::Vec3 centre = {(i % 4 - 1.5) * 12, (i / 4 - 1.5) * 9, -30.0 - (i % 3) * 4};
+
+            objects.emplace_back(plane.mesh_);
+            objects.back().rotation_ = rotation;
+            objects.back().position_ = centre - ThreeDL::apply_rotation(ThreeDL::rotation_matrix(rotation), plane.mesh_.centre_);
+            pointers.push_back(&objects.back());
+        }
+
+        ThreeDL::SceneBVH bvh;
+        bvh.build(pointers);
+
+        std::vector<ThreeDL::Ray> rays;
+        std::vector<ThreeDL::RayHit> hits;
+
+        for (int y = 0; y < 256; ++y) {
+            for (int x = 0; x < 256; ++x) {
+                rays.emplace_back(ThreeDL::Vec3{0, 0, 0}, ThreeDL::Vec3{(x - 127.5) / 128 * 0.8, (y - 127.5) / 128 * 0.6, -1});
+            }
+        }
+
+        size_t count = rays.size();
+        bvh.closest_hits(rays, hits);
+        size_t hit = std::count_if(hits.begin(), hits.end(), [](const ThreeDL::RayHit& h) { return h.hit_; });
+        std::string hit_share = ", " + std::to_string(hit * 100 / count) + "% hit";
+
+        double ns = time_ns([&](long i) { sink = bvh.closest_hit(rays[i % count]).t_; }, count * 4);
+        report("SceneBVH::closest_hit", ns, millions_per_second(ns, "rays") + hit_share);
+
+        ns = time_ns([&](long i) { sink = bvh.any_hit(rays[i % count]); }, count * 4);
+        report("SceneBVH::any_hit", ns, millions_per_second(ns, "rays") + hit_share);
+
+        // per ray, the whole grid in packets of packet_size
+        ns = time_ns([&](long) { bvh.closest_hits(rays, hits); }, 20) / count;
+        report("SceneBVH::closest_hits", ns, millions_per_second(ns, "rays") + hit_share);
+    }
+}
+
+namespace ThreeDL {
+    // the renderer's private stages, timed one call at a time
+    class RendererBench {
+        public:
+            static void run(const Object& object) {
+                Camera camera({0, 0, -5}, {0, 0, 0});
+                Renderer renderer(camera, 1024, 768);
+
+                std::vector<Vec3> points = test_points(1024);
+                std::vector<GSPTriangle> triangles;
+
+                for (size_t i = 0; i < points.size(); ++i) {
+                    triangles.emplace_back(points[i], points[(i + 1) % 1024] + Vec3{1, 0, 0}, points[(i + 2) % 1024] + Vec3{0, 1, 3});
+                }
+
+                const Plane& near = renderer.clip_planes_[0];
+                const Kernels& kernels = *renderer.kernels_;
+
+                report("Renderer::clip_to_plane (near)", time_ns([&](long i) {
+                    sink = renderer.clip_to_plane({triangles[i & 1023]}, near, true).size();
+                }, 1000000));
+
+                std::vector<uint8_t> codes(points.size() * 3);
+
+                for (size_t i = 0; i < triangles.size(); ++i) {
+                    kernels.clip_outcodes(triangles[i].vertices_.data(), 3, renderer.clip_planes_.data(), static_cast<int>(renderer.clip_planes_.size()), &codes[i * 3]);
+                }
+
+                report("Renderer::clip_triangle", time_ns([&](long i) {
+                    sink = renderer.clip_triangle(triangles[i & 1023], &codes[(i & 1023) * 3]).size();
+                }, 1000000));
+
+                report("Renderer::project", time_ns([&](long i) {
+                    sink = renderer.project(triangles[i & 1023]).vertices_[0].x;
+                }, 1000000));
+
+                // 70 pixel wide triangles over the whole target, one flat colour
+                renderer.visible_triangles_.emplace_back(triangles[0], nullptr, 0, 0);
+
+                for (auto& color : renderer.visible_triangles_[0].colors_) {
+                    color = {255, 0, 0};
+                }
+
+                std::vector<SSPTriangle> projected;
+
+                for (int i = 0; i < 256; ++i) {
+                    double x = (i * 37) % 900 + 20;
+                    double y = (i * 53) % 650 + 20;
+                    projected.emplace_back(std::vector<Vec2>{{x, y, 0.1 + i * 1e-4}, {x + 70, y + 10, 0.1}, {x + 20, y + 70, 0.1}}, std::vector<Vec2>{{0, 0}, {0, 0}, {0, 0}});
+                }
+
+                renderer.scissor_ = {0, 0, 1024, 768};
+                renderer.stats_ = {};
+                long count = 20000;
+
+                double ns = time_ns([&](long i) {
+                    renderer.rasterise_triangle(projected[i & 255], 1);
+                    if ((i & 255) == 255) renderer.zbuffer_.clear(kernels);
+                }, count);
+
+                double fragments = static_cast<double>(renderer.stats_.fragments_tested_) / (count + count / 10);
+                report("Renderer::rasterise_triangle", ns, "  " + std::to_string(fragments / ns * 1000).substr(0, 6) + " M fragments/s");
+
+                // and everything together
+                Camera frame_camera({0, 0, -5}, {0, 0, 0});
+                Renderer frame_renderer(frame_camera, 1024, 768);
+                frame_renderer.add(const_cast<Object*>(&object));
+                frame_renderer.add_light(DirectionalLight({0.3, -1, -0.5}, {255, 255, 255, 255}, 0.8));
+
+                // what lighting adds to a frame, one directional light
+                const std::pair<LightingMode, const char*> modes[] = {
+                    {LightingMode::unlit, "unlit"},
+                    {LightingMode::flat, "flat"},
+                    {LightingMode::gouraud, "gouraud"}
+                };
+
+                for (const auto& [mode, name] : modes) {
+                    frame_renderer.set_lighting_mode(mode);
+
+                    report(std::string("plane.obj frame 1024x768 ") + name, time_ns([&](long) {
+                        frame_renderer.render_frame();
+                    }, 50));
+                }
+
+                // 2M points through the view, splatted and resolved against the depth buffer without the rest of a frame
+                const size_t point_count = 2000000;
+                std::vector<Vec3> positions(point_count);
+                std::vector<Uint32> colors(point_count);
+                uint32_t state = 1;
+
+                auto next = [&state]() {
+                    state = state * 1664525u + 1013904223u;
+                    return (state >> 8) / 16777216.0;
+                };
+
+                for (size_t i = 0; i < point_count; ++i) {
+                    positions[i] = {next() * 8 - 4, next() * 6 - 3, -10 - next() * 5};
+                    colors[i] = 0xff000000 | state >> 8;
+                }
+
+                PointCloud cloud(positions, colors);
+                Renderer point_renderer(frame_camera, 1024, 768);
+                point_renderer.add(&cloud);
+                point_renderer.render_frame();
+
+                ns = time_ns([&](long) {
+                    point_renderer.splat_points();
+                }, 20) / point_count;
+                report("Renderer::splat_points (2M)", ns, millions_per_second(ns, "points"));
+            }
+    };
+}
+
+int main() {
+    ThreeDL::OBJLoader plane("plane.obj", SDL_Color{255, 0, 0, 255});
+    ThreeDL::Object object(plane.export_mesh());
+
+    std::vector<ThreeDL::Vec3> points = test_points(1024);
+
+    report("Vec3::rotate", time_ns([&](long i) {
+        ThreeDL::Vec3 v = points[i & 1023];
+        v.rotate(10, 20, 30);
+        sink = v.x;
+    }, 2000000));
+
+    ThreeDL::Line line = {{10, 20, 0.1}, {500, 300, 0.3}};
+
+    report("calculate_z_index", time_ns([&](long i) {
+        sink = ThreeDL::calculate_z_index(line, 10 + (i & 255), 20 + (i & 127));
+    }, 20000000));
+
+    ThreeDL::RendererBench::run(object);
+    ray_queries(object);
+    position_gather(object);
+
+    // per element, every level this CPU runs
+    const size_t n = 4096;
+    std::vector<ThreeDL::Vec3> view(n);
+    std::vector<uint8_t> codes(n);
+    std::vector<int32_t> xs(n);
+    std::vector<int32_t> ys(n);
+    std::vector<float> depths(n);
+    std::vector<double> depth(n, -INFINITY);
+    std::vector<uint8_t> pass(n);
+    std::vector<Uint32> pixels(n);
+    std::vector<Uint32> samples(4 * n);
+    std::vector<float> occlusion(n, 0.5f);
+    std::array<ThreeDL::Vec3, 3> rotation = {ThreeDL::Vec3{1, 0, 0}, ThreeDL::Vec3{0, 0.8, 0.6}, ThreeDL::Vec3{0, -0.6, 0.8}};
+    std::vector<ThreeDL::Plane> planes = {ThreeDL::Plane({0, 0, -0.01}, {0, 0, -1}), ThreeDL::Plane({0, 0, 0}, {1, 0, -1}), ThreeDL::Plane({0, 0, 0}, {-1, 0, -1})};
+    ThreeDL::Vec2 a = {0, 0, 0.1};
+    ThreeDL::Vec2 b = {static_cast<double>(n), 0, 0.3};
+
+    for (ThreeDL::SimdLevel level : {ThreeDL::SimdLevel::sse2, ThreeDL::SimdLevel::avx2, ThreeDL::SimdLevel::avx512}) {
+        if (!ThreeDL::simd_supported(level)) continue;
+
+        ThreeDL::force_simd_level(level);
+        const ThreeDL::Kernels& k = ThreeDL::kernels();
+        std::string suffix = std::string(" [") + ThreeDL::simd_name(level) + "]";
+        double per = 1.0 / n;
+
+        report("transform_points" + suffix, per * time_ns([&](long) { k.transform_points(points.data(), view.data(), n / 4, rotation, {0, 0, 1}); }, 20000) * 4);
+        report("clip_outcodes" + suffix, per * time_ns([&](long) { k.clip_outcodes(points.data(), n / 4, planes.data(), 3, codes.data()); }, 20000) * 4);
+        report("depth_span" + suffix, per * time_ns([&](long) { std::fill(depth.begin(), depth.end(), -INFINITY); k.depth_span(depth.data(), pass.data(), n, 0, a, b, true); }, 20000));
+        report("project_points" + suffix, per * time_ns([&](long) { k.project_points(points.data(), n / 4, 437, 1024, 768, xs.data(), ys.data(), depths.data()); }, 20000) * 4);
+        report("fill_pixels" + suffix, per * time_ns([&](long i) { k.fill_pixels(pixels.data(), n, static_cast<Uint32>(i)); }, 100000));
+        report("resolve_samples" + suffix, per * time_ns([&](long) { k.resolve_samples(samples.data(), pixels.data(), n, n, 0); }, 20000));
+        report("occluder_span" + suffix, per * time_ns([&](long) { k.occluder_span(occlusion.data(), static_cast<int>(n), 0.25f, 1e-5f); }, 100000));
+        report("occlusion_test" + suffix, per * time_ns([&](long) { sink = k.occlusion_test(occlusion.data(), static_cast<int>(n), 0.1f); }, 100000));
+    }
+}
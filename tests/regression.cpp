@@ -0,0 +1,531 @@
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../engine/bvh.hpp"
+#include "../engine/capture.hpp"
+#include "../engine/objects.hpp"
+#include "../engine/offline.hpp"
+#include "../engine/rendering.hpp"
+
+// renders fixed poses of plane.obj headlessly and compares them against the goldens in tests/golden,
+// run from the repository root, --update writes the goldens again from the current build
+namespace {
+    const int width = 320;
+    const int height = 240;
+
+    // colour channels may differ by this much, depth by this fraction of itself
+    const int color_tolerance = 2;
+    const double depth_tolerance = 1e-5;
+    // of the pixels, what may be over the tolerance, edges move between compilers under -ffast-math
+    const double max_over = 2e-4;
+
+    int failures = 0;
+
+    void check(bool passed, const std::string& name, const std::string& detail = "") {
+        std::cout << (passed ? "pass " : "FAIL ") << name << (detail.empty() ? "" : ": " + detail) << "\n";
+        failures += !passed;
+    }
+
+    std::string describe(const ThreeDL::ImageDiff& diff) {
+        return std::to_string(diff.pixels_over_) + " of " + std::to_string(diff.pixels_compared_) + " over, max error " + std::to_string(diff.max_error_);
+    }
+
+    class Pose {
+        public:
+            ThreeDL::Vec3 position_;
+            ThreeDL::Vec3 rotation_;
+    };
+
+    const Pose poses[] = {
+        {{0, 0, -5}, {0, 0, 0}},
+        {{2, 1, -6}, {10, 20, 0}},
+        {{-3, 0.5, -4}, {-5, -30, 0}}
+    };
+
+    void set_up(ThreeDL::Renderer& renderer, ThreeDL::Object& object) {
+        renderer.add(&object);
+        renderer.add_light(ThreeDL::DirectionalLight({0.3, -1, -0.5}, {255, 255, 255, 255}, 0.8));
+        renderer.set_lighting_mode(ThreeDL::LightingMode::gouraud);
+        renderer.set_capture_depth(true);
+    }
+
+    // level names the kernels in use, in brackets after every check
+    void golden_poses(ThreeDL::Object& object, bool update, const std::string& level) {
+        for (size_t p = 0; p < std::size(poses); ++p) {
+            std::string name = "tests/golden/pose_" + std::to_string(p);
+            std::string label = "pose " + std::to_string(p);
+            std::string suffix = " [" + level + "]";
+
+            ThreeDL::Camera camera(poses[p].position_, poses[p].rotation_);
+            ThreeDL::Renderer renderer(camera, width, height);
+            set_up(renderer, object);
+            renderer.render_frame();
+
+            if (update) {
+                ThreeDL::save_frame(name + ".png", renderer.frame(), width, height);
+                ThreeDL::save_depth(name + ".depth", renderer.depth(), width, height);
+                std::cout << "wrote " << name << "\n";
+                continue;
+            }
+
+            std::vector<Uint32> golden_frame = ThreeDL::load_frame(name + ".png", width, height);
+            std::vector<double> golden_depth = ThreeDL::load_depth(name + ".depth", width, height);
+
+            ThreeDL::ImageDiff color = ThreeDL::compare_frames(renderer.frame(), golden_frame, color_tolerance);
+            ThreeDL::ImageDiff depth = ThreeDL::compare_depths(renderer.depth(), golden_depth, depth_tolerance);
+            check(color.passed(max_over), label + " colour" + suffix, describe(color));
+            check(depth.passed(max_over), label + " depth" + suffix, describe(depth));
+
+            // shading each pixel once after the fact gives the same picture
+            renderer.set_shading_mode(ThreeDL::ShadingMode::deferred);
+            renderer.render_frame();
+            color = ThreeDL::compare_frames(renderer.frame(), golden_frame, color_tolerance);
+            check(color.passed(max_over), label + " deferred colour" + suffix, describe(color));
+
+            // and the goldens are tight enough to see the camera move by a hair
+            renderer.set_shading_mode(ThreeDL::ShadingMode::forward);
+            camera.position_.x += 0.02;
+            renderer.render_frame();
+            depth = ThreeDL::compare_depths(renderer.depth(), golden_depth, depth_tolerance);
+            check(!depth.passed(max_over), label + " moved camera caught" + suffix, describe(depth));
+        }
+    }
+
+    // the compact depth formats draw the same picture, depth as close as each one stores it
+    void golden_depth_formats(ThreeDL::Object& object, const std::string& level) {
+        const std::pair<ThreeDL::DepthFormat, double> formats[] = {
+            {ThreeDL::DepthFormat::float32, 1e-5},
+            {ThreeDL::DepthFormat::unorm24, 1e-5},
+            {ThreeDL::DepthFormat::unorm16, 1e-4}
+        };
+        const char* names[] = {"float32", "unorm24", "unorm16"};
+
+        for (size_t p = 0; p < std::size(poses); ++p) {
+            std::string name = "tests/golden/pose_" + std::to_string(p);
+            std::vector<Uint32> golden_frame = ThreeDL::load_frame(name + ".png", width, height);
+            std::vector<double> golden_depth = ThreeDL::load_depth(name + ".depth", width, height);
+
+            for (size_t f = 0; f < std::size(formats); ++f) {
+                ThreeDL::Camera camera(poses[p].position_, poses[p].rotation_);
+                ThreeDL::Renderer renderer(camera, width, height);
+                set_up(renderer, object);
+                renderer.set_depth_format(formats[f].first);
+                renderer.render_frame();
+
+                ThreeDL::ImageDiff color = ThreeDL::compare_frames(renderer.frame(), golden_frame, color_tolerance);
+                ThreeDL::ImageDiff depth = ThreeDL::compare_depths(renderer.depth(), golden_depth, formats[f].second);
+                std::string label = "pose " + std::to_string(p) + " " + names[f];
+                check(color.passed(max_over), label + " colour [" + level + "]", describe(color));
+                check(depth.passed(max_over), label + " depth [" + level + "]", describe(depth));
+            }
+        }
+    }
+
+    // welding finds the vertices plane.obj shares, and the order the stats measure is the one the mesh draws in
+    void optimised_plane() {
+        ThreeDL::OBJLoader loader("plane.obj", SDL_Color{255, 0, 0, 255});
+        ThreeDL::MeshOptimisationStats stats = loader.optimise();
+        ThreeDL::Mesh mesh = loader.export_mesh();
+
+        std::vector<ThreeDL::GSPTriangle> drawn;
+
+        for (uint32_t index : mesh.cluster_triangles_) {
+            drawn.push_back(mesh.triangles_[index]);
+        }
+
+        ThreeDL::IndexedMesh welded = ThreeDL::weld_vertices(drawn);
+        double acmr_drawn = ThreeDL::average_cache_miss_ratio(welded.indices_, welded.vertex_count());
+
+        check(stats.triangles_ == 1675 && stats.vertices_before_ == 5025 && stats.vertices_after_ == 4244,
+              "plane.obj welded", std::to_string(stats.vertices_before_) + " -> " + std::to_string(stats.vertices_after_) + " vertices");
+        check(stats.acmr_after_ < stats.acmr_before_ && acmr_drawn == stats.acmr_after_, "plane.obj ACMR as drawn",
+              std::to_string(stats.acmr_before_) + " -> " + std::to_string(stats.acmr_after_) + ", drawn " + std::to_string(acmr_drawn));
+
+        ThreeDL::Object object(mesh);
+        ThreeDL::Camera camera(poses[0].position_, poses[0].rotation_);
+        ThreeDL::Renderer renderer(camera, width, height);
+        set_up(renderer, object);
+        renderer.render_frame();
+
+        std::vector<Uint32> golden_frame = ThreeDL::load_frame("tests/golden/pose_0.png", width, height);
+        ThreeDL::ImageDiff color = ThreeDL::compare_frames(renderer.frame(), golden_frame, color_tolerance);
+        check(color.passed(max_over), "optimised plane.obj colour", describe(color));
+    }
+
+    std::vector<ThreeDL::GSPTriangle> cube(double half) {
+        std::vector<ThreeDL::GSPTriangle> triangles;
+        ThreeDL::Vec3 corners[8];
+
+        for (int i = 0; i < 8; ++i) {
+            corners[i] = {(i & 1) ? half : -half, (i & 2) ? half : -half, (i & 4) ? half : -half};
+        }
+
+        const int faces[6][4] = {{0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3}};
+
+        for (const auto& face : faces) {
+            triangles.emplace_back(corners[face[0]], corners[face[2]], corners[face[1]]);
+            triangles.emplace_back(corners[face[0]], corners[face[3]], corners[face[2]]);
+        }
+
+        for (auto& triangle : triangles) {
+            ThreeDL::Vec3 normal = triangle.face_normal();
+            triangle.normals_ = {normal, normal, normal};
+        }
+
+        return triangles;
+    }
+
+    // a convex mesh never shadows its own lit faces, so with a turned camera the shadow map must change nothing,
+    // the faces turned from the shadow light show the shadowed colours and those still carry the second light
+    void unshadowed_lighting() {
+        ThreeDL::Object object(ThreeDL::Mesh(cube(1), nullptr, {200, 200, 200, 255}));
+        object.position_ = {0.5, -0.3, -5};
+        object.rotation_ = {20, 35, 0};
+
+        std::vector<Uint32> frames[2];
+
+        for (int shadowed = 0; shadowed < 2; ++shadowed) {
+            ThreeDL::Camera camera({1, 0.5, 0}, {8, 12, 5});
+            ThreeDL::Renderer renderer(camera, width, height);
+            renderer.add(&object);
+            renderer.add_light(ThreeDL::DirectionalLight({0.3, -1, -0.5}, {255, 255, 255, 255}, 0.8));
+            renderer.add_light(ThreeDL::DirectionalLight({-1, 0.2, -0.4}, {255, 255, 255, 255}, 0.5));
+
+            for (ThreeDL::LightingMode mode : {ThreeDL::LightingMode::flat, ThreeDL::LightingMode::gouraud}) {
+                renderer.set_lighting_mode(mode);
+                renderer.set_shadow_light(shadowed ? 0 : -1);
+                renderer.render_frame();
+                frames[shadowed].insert(frames[shadowed].end(), renderer.frame().begin(), renderer.frame().end());
+            }
+        }
+
+        ThreeDL::ImageDiff diff = ThreeDL::compare_frames(frames[1], frames[0], 1);
+        check(diff.passed(), "turned camera, shadow map with nothing occluded", describe(diff));
+    }
+
+    // a mesh replaced in the same object, at the same address, is a new caster
+    void shadow_map_follows_mesh() {
+        ThreeDL::Object object(ThreeDL::Mesh(cube(1), nullptr));
+        object.position_ = {0, 0, -5};
+
+        ThreeDL::Camera camera({0, 0, 0}, {0, 0, 0});
+        ThreeDL::Renderer renderer(camera, width, height);
+        renderer.add(&object);
+        renderer.add_light(ThreeDL::DirectionalLight({0.3, -1, -0.5}, {255, 255, 255, 255}, 0.8));
+        renderer.set_lighting_mode(ThreeDL::LightingMode::flat);
+        renderer.set_shadow_light(0);
+
+        renderer.render_frame();
+        renderer.render_frame();
+        check(renderer.stats().shadow_maps_drawn_ == 0, "still scene keeps its shadow map", "");
+
+        object.mesh_ = ThreeDL::Mesh(cube(2), nullptr);
+        renderer.render_frame();
+        check(renderer.stats().shadow_maps_drawn_ == 1, "replaced mesh redraws the shadow map", "");
+    }
+
+    // and is drawn from what was cached for it, not for the mesh it replaced
+    void mesh_replaced(const std::string& name, const std::function<void(ThreeDL::Renderer&)>& configure) {
+        ThreeDL::Object object(ThreeDL::Mesh(cube(1), nullptr));
+        object.position_ = {0, 0, -5};
+        object.rotation_ = {20, 35, 0};
+
+        ThreeDL::Camera camera({0, 0, 0}, {0, 0, 0});
+        std::vector<Uint32> frames[2];
+
+        for (int fresh = 0; fresh < 2; ++fresh) {
+            ThreeDL::Renderer renderer(camera, width, height);
+            renderer.add(&object);
+            renderer.set_lighting_mode(ThreeDL::LightingMode::unlit);
+            configure(renderer);
+
+            if (!fresh) {
+                object.mesh_ = ThreeDL::Mesh(cube(1), nullptr);
+                renderer.render_frame();
+            }
+
+            object.mesh_ = ThreeDL::Mesh(cube(0.5), nullptr);
+            renderer.render_frame();
+            frames[fresh] = renderer.frame();
+        }
+
+        ThreeDL::ImageDiff diff = ThreeDL::compare_frames(frames[0], frames[1], 0);
+        check(diff.passed(), name + " mesh replaced in place", describe(diff));
+    }
+
+    // triangles edited in place then marked changed draw as a mesh built from them would
+    void mesh_edited(const ThreeDL::Mesh& plane) {
+        ThreeDL::Object object(plane);
+        object.rotation_ = {10, 20, 0};
+
+        ThreeDL::Camera camera({0, 0, -5}, {0, 0, 0});
+        ThreeDL::Renderer renderer(camera, width, height);
+        set_up(renderer, object);
+        renderer.render_frame();
+
+        const std::function<void(std::vector<ThreeDL::GSPTriangle>&)> edits[] = {
+            [](std::vector<ThreeDL::GSPTriangle>& triangles) {
+                triangles.resize(triangles.size() / 3);
+            },
+            [](std::vector<ThreeDL::GSPTriangle>& triangles) {
+                for (auto& triangle : triangles) {
+                    triangle.translate({0.5, 0, 0});
+                }
+            },
+            [](std::vector<ThreeDL::GSPTriangle>& triangles) {
+                triangles.resize(1);
+            }
+        };
+
+        for (size_t e = 0; e < std::size(edits); ++e) {
+            edits[e](object.mesh_.triangles_);
+            object.mesh_.changed();
+            renderer.render_frame();
+
+            ThreeDL::Object rebuilt(ThreeDL::Mesh(object.mesh_.triangles_, nullptr, object.mesh_.color_));
+            rebuilt.rotation_ = object.rotation_;
+
+            ThreeDL::Renderer fresh(camera, width, height);
+            set_up(fresh, rebuilt);
+            fresh.render_frame();
+
+            ThreeDL::ImageDiff diff = ThreeDL::compare_frames(renderer.frame(), fresh.frame(), 0);
+            check(diff.passed(), "mesh edited in place " + std::to_string(e), describe(diff));
+        }
+    }
+
+    // an incrementally drawn frame after a change looks like one drawn from scratch
+    void incremental_matches(const std::string& name, const std::function<void(ThreeDL::Renderer&)>& configure,
+                             const std::function<void(std::vector<ThreeDL::Object>&, int)>& change) {
+        std::vector<ThreeDL::Object> objects;
+
+        for (int i = 0; i < 6; ++i) {
+            objects.emplace_back(ThreeDL::Mesh(cube(0.6), nullptr, {static_cast<Uint8>(60 + i * 30), 120, 200, 255}));
+            objects.back().position_ = {(i % 3 - 1) * 1.5, (i / 3) * 1.5 - 0.75, -6.0 - i * 0.3};
+            objects.back().rotation_ = {i * 10.0, i * 25.0, 0};
+        }
+
+        ThreeDL::Camera camera({0, 0, 0}, {0, 0, 0});
+        ThreeDL::Renderer renderer(camera, width, height);
+
+        for (auto& object : objects) {
+            renderer.add(&object);
+        }
+
+        renderer.add_light(ThreeDL::DirectionalLight({0.3, -1, -0.5}, {255, 255, 255, 255}, 0.8));
+        renderer.set_lighting_mode(ThreeDL::LightingMode::flat);
+        renderer.set_incremental(true);
+        configure(renderer);
+        renderer.render_frame();
+
+        uint64_t pixels_over = 0;
+        double max_error = 0;
+
+        for (int step = 0; step < 4; ++step) {
+            change(objects, step);
+            renderer.render_frame();
+
+            ThreeDL::Renderer fresh(camera, width, height);
+
+            for (auto& object : objects) {
+                fresh.add(&object);
+            }
+
+            fresh.add_light(ThreeDL::DirectionalLight({0.3, -1, -0.5}, {255, 255, 255, 255}, 0.8));
+            fresh.set_lighting_mode(ThreeDL::LightingMode::flat);
+            configure(fresh);
+            fresh.render_frame();
+
+            ThreeDL::ImageDiff diff = ThreeDL::compare_frames(renderer.frame(), fresh.frame(), 0);
+            pixels_over += diff.pixels_over_;
+            max_error = std::max(max_error, diff.max_error_);
+        }
+
+        check(pixels_over == 0, name, std::to_string(pixels_over) + " over, max error " + std::to_string(max_error));
+    }
+
+    // splats are kept at the full window size, a lower render scale indexes them by its own width
+    void points_rescaled() {
+        std::vector<ThreeDL::Vec3> positions;
+        std::vector<Uint32> colors;
+
+        for (int i = 0; i < 4000; ++i) {
+            positions.push_back({std::sin(i * 0.37) * 2, std::cos(i * 0.23) * 1.5, -5 + std::sin(i * 0.11)});
+            colors.push_back(0xff000000 | static_cast<Uint32>(i * 2654435761u >> 8));
+        }
+
+        ThreeDL::PointCloud cloud(positions, colors);
+        ThreeDL::Camera camera({0, 0, 0}, {0, 0, 0});
+        std::vector<Uint32> frames[2];
+
+        for (int fresh = 0; fresh < 2; ++fresh) {
+            ThreeDL::Renderer renderer(camera, width, height);
+            renderer.add(&cloud);
+
+            if (!fresh) renderer.render_frame();
+
+            renderer.set_render_scale(0.5);
+            renderer.render_frame();
+            frames[fresh] = renderer.frame();
+        }
+
+        ThreeDL::ImageDiff diff = ThreeDL::compare_frames(frames[0], frames[1], 0);
+        check(diff.passed(), "points after a render scale change", describe(diff));
+    }
+
+    int bvh_depth(const std::vector<ThreeDL::BVHNode>& nodes, uint32_t index) {
+        if (nodes[index].count_ > 0) return 0;
+
+        return 1 + std::max(bvh_depth(nodes, index + 1), bvh_depth(nodes, nodes[index].first_));
+    }
+
+    // triangles twice as far out each time, every split only peels off the last one
+    void bvh_depth_capped() {
+        std::vector<ThreeDL::GSPTriangle> triangles;
+        double x = 1;
+
+        for (int i = 0; i < 300; ++i, x *= 2) {
+            triangles.emplace_back(ThreeDL::Vec3{x, 0, 0}, ThreeDL::Vec3{x * (1 + 1e-6) + 1e-3, 1, 0}, ThreeDL::Vec3{x, 1, 1e-3});
+        }
+
+        ThreeDL::MeshBVH bvh(triangles);
+        int depth = bvh_depth(bvh.nodes(), 0);
+        size_t hits = 0;
+        x = 1;
+
+        for (uint32_t i = 0; i < triangles.size(); ++i, x *= 2) {
+            ThreeDL::RayHit hit;
+            hits += bvh.intersect(ThreeDL::Ray({x * (1 + 1e-9) + 1e-4, 0.5, -1}, {0, 0, 1}), hit, false) && hit.triangle_id_ == i;
+        }
+
+        check(depth <= ThreeDL::bvh_stack_size - 2 && hits == triangles.size(), "degenerate BVH fits the traversal stack",
+              "depth " + std::to_string(depth) + ", " + std::to_string(hits) + " of " + std::to_string(triangles.size()) + " hit");
+    }
+
+    // no frames are asked for, so only the pattern check can throw
+    void offline_patterns_checked() {
+        ThreeDL::OfflineRenderer renderer(32, 32, 1);
+        ThreeDL::CameraPath path;
+        std::string accepted, rejected;
+
+        for (const char* pattern : {"frames/%04d.bmp", "%d", "100%% %i.bmp"}) {
+            try {
+                renderer.render(path, 0, pattern);
+            } catch (const std::exception&) {
+                accepted += std::string(" ") + pattern;
+            }
+        }
+
+        for (const char* pattern : {"frames/%s.bmp", "%d_%d.bmp", "frame.bmp", "%.4d.bmp", "%999d.bmp", "%"}) {
+            try {
+                renderer.render(path, 0, pattern);
+                rejected += std::string(" ") + pattern;
+            } catch (const std::runtime_error&) {}
+        }
+
+        check(accepted.empty() && rejected.empty(), "offline output patterns checked",
+              "refused:" + accepted + ", allowed:" + rejected);
+    }
+
+    // the morph follows the eye in steps, a small move of it rebuilds few patches if any
+    void terrain_patches_kept() {
+        const int size = 257;
+        std::vector<float> heights(size * size);
+
+        for (int z = 0; z < size; ++z) {
+            for (int x = 0; x < size; ++x) {
+                heights[z * size + x] = static_cast<float>(10 * std::sin(x * 0.05) * std::cos(z * 0.04));
+            }
+        }
+
+        ThreeDL::Terrain terrain(heights, size, size, 1, {255, 255, 255, 255});
+        auto visible = [](const ThreeDL::Vec3&, double) { return true; };
+        std::vector<ThreeDL::Object*> objects;
+
+        ThreeDL::Vec3 eye = {128.2, 30, 128.2};
+        terrain.update(eye, visible, objects);
+
+        std::vector<uint64_t> generations;
+
+        for (const ThreeDL::Object* object : objects) {
+            generations.push_back(object->mesh_.generation());
+        }
+
+        objects.clear();
+        check(!terrain.update(eye, visible, objects), "still eye keeps every terrain patch");
+
+        objects.clear();
+        eye.x += 0.05;
+        terrain.update(eye, visible, objects);
+
+        size_t kept = 0;
+
+        for (size_t i = 0; i < objects.size() && i < generations.size(); ++i) {
+            kept += objects[i]->mesh_.generation() == generations[i];
+        }
+
+        check(objects.size() == generations.size() && kept > objects.size() / 2, "moved eye keeps most terrain patches",
+              std::to_string(kept) + " of " + std::to_string(objects.size()));
+    }
+}
+
+int main(int argc, char** argv) {
+    bool update = argc > 1 && std::strcmp(argv[1], "--update") == 0;
+
+    ThreeDL::OBJLoader plane("plane.obj", SDL_Color{255, 0, 0, 255});
+    ThreeDL::Object object(plane.export_mesh());
+
+    try {
+        if (update) {
+            golden_poses(object, true, ThreeDL::simd_name(ThreeDL::detect_simd_level()));
+            return 0;
+        }
+
+        // every kernel set this CPU runs draws the goldens, the rest only at the best of them
+        for (ThreeDL::SimdLevel level : {ThreeDL::SimdLevel::sse2, ThreeDL::SimdLevel::avx2, ThreeDL::SimdLevel::avx512}) {
+            if (!ThreeDL::simd_supported(level)) continue;
+
+            ThreeDL::force_simd_level(level);
+            golden_poses(object, false, ThreeDL::simd_name(level));
+            golden_depth_formats(object, ThreeDL::simd_name(level));
+        }
+
+        ThreeDL::force_simd_level(ThreeDL::detect_simd_level());
+    } catch (const std::exception& error) {
+        check(false, "goldens", error.what());
+    }
+
+    unshadowed_lighting();
+    mesh_edited(object.mesh_);
+    optimised_plane();
+    shadow_map_follows_mesh();
+    mesh_replaced("traced", [](ThreeDL::Renderer& renderer) {
+        renderer.set_render_mode(ThreeDL::RenderMode::ray_trace);
+    });
+    mesh_replaced("wireframe", [](ThreeDL::Renderer& renderer) {
+        renderer.set_wireframe(ThreeDL::WireframeMode::only);
+    });
+    incremental_matches("incremental multisampled frame", [](ThreeDL::Renderer& renderer) {
+        renderer.set_msaa(true);
+    }, [](std::vector<ThreeDL::Object>& objects, int step) {
+        objects[step].position_.x += 0.3;
+        objects[5 - step].rotation_.y += 15;
+    });
+    incremental_matches("incremental frame after a mesh change", [](ThreeDL::Renderer&) {}, [](std::vector<ThreeDL::Object>& objects, int step) {
+        if (step == 0) objects[1].mesh_ = ThreeDL::Mesh(cube(0.9), nullptr, {250, 250, 40, 255});
+        if (step == 1) objects[4].mesh_.opacity_ = 0.5;
+        if (step == 2) objects[4].mesh_.opacity_ = 1;
+        if (step == 3) objects[1].mesh_ = ThreeDL::Mesh(cube(0.3), nullptr, {250, 250, 40, 255});
+    });
+    terrain_patches_kept();
+    bvh_depth_capped();
+    points_rescaled();
+    offline_patterns_checked();
+
+    std::cout << (failures == 0 ? "all passed" : std::to_string(failures) + " failed") << "\n";
+    return failures == 0 ? 0 : 1;
+}